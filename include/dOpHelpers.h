@@ -2,6 +2,10 @@
 #define DOPHELPERS_H
 
 #include <omp.h>
+#include <chrono>
+#include "workspace.h"
+
+using namespace std::chrono;
 
 // Wilson stencil
 // D_{W}(n,m) = (m_{0} + 2r)\delta(n,m)
@@ -11,332 +15,962 @@
 // sigma_1 = | 0  1 |  sigma_2 = | 0 -i | sigma_3 = i*sigma_1*sigma_2 = | 1  0 |
 //           | 1  0 |            | i  0 |                               | 0 -1 |
 
-void Dpsi(Complex psi2[LX][LY][2], Complex psi1[LX][LY][2],
-	  const Complex gauge[LX][LY][2], param_t p){
-  
-  double m0 = p.m;
+// One x row of the stencil. in, inp and inm are the spinor rows x, x+1
+// and x-1, U and Um the gauge rows x and x-1. With dag the spin-1
+// components are flipped on the way in and out, giving g3 D g3 = D^dag.
+template<int ly>
+inline void wilsonRow(Complex *out, const Complex *in, const Complex *inp, const Complex *inm,
+		      const Complex *U, const Complex *Um, double m0, bool dag) {
+
+  const int ny = (ly ? ly : LY);
   double  r = 1.0;
   double constant = (2*r + m0);
-  int xp1, xm1, yp1, ym1;
+  double s = (dag ? -1.0 : 1.0);
   
-  //Sum over 0,1 directions.
-  for(int x=0; x<LX; x++) {
-    xp1 = (x+1)%LX;
-    xm1 = (x-1+LX)%LX;
-    for(int y=0; y<LY; y++) {
-      yp1 = (y+1)%LY;
-      ym1 = (y-1+LY)%LY;
+  for(int y=0; y<ny; y++) {
+    int yp1 = ly ? (y+1)%ly : nbr.yp[y];
+    int ym1 = ly ? (y-1+ly)%ly : nbr.ym[y];
+
+    const Complex *Un  = U  + 2*y;
+    const Complex *Uxm = Um + 2*y;
+    const Complex *Uym = U  + 2*ym1;
+    const Complex *n   = in + 2*y;
+    const Complex *xp  = inp + 2*y;
+    const Complex *xm  = inm + 2*y;
+    const Complex *yp  = in + 2*yp1;
+    const Complex *ym  = in + 2*ym1;
+    
+    //upper
+    out[2*y] = constant * n[0] -
       
-      //upper
-      psi2[x][y][0] = constant * psi1[x][y][0] -
-	
-	0.5*(     gauge[x][y][0]    * (r*psi1[xp1][y][0] - psi1[xp1][y][1]) +
-	     conj(gauge[xm1][y][0]) * (r*psi1[xm1][y][0] + psi1[xm1][y][1]) +
-		  
-		  gauge[x][y][1]    * (r*psi1[x][yp1][0] + I*psi1[x][yp1][1]) +
-	     conj(gauge[x][ym1][1]) * (r*psi1[x][ym1][0] - I*psi1[x][ym1][1]));
+      0.5*(     Un[0]   * (r*xp[0] - s*xp[1]) +
+	   conj(Uxm[0]) * (r*xm[0] + s*xm[1]) +
+		
+		Un[1]   * (r*yp[0] + I*(s*yp[1])) +
+	   conj(Uym[1]) * (r*ym[0] - I*(s*ym[1])));
+    
+    //lower
+    out[2*y+1] = s*(constant * (s*n[1]) -
       
-      //lower
-      psi2[x][y][1] = constant * psi1[x][y][1] -
-	
-	0.5*(     gauge[x][y][0]    * (-psi1[xp1][y][0] + r*psi1[xp1][y][1]) -
-	     conj(gauge[xm1][y][0]) * (-psi1[xm1][y][0] - r*psi1[xm1][y][1]) +
+      0.5*(     Un[0]   * (-xp[0] + r*(s*xp[1])) -
+	   conj(Uxm[0]) * (-xm[0] - r*(s*xm[1])) +
 
-		  gauge[x][y][1]    * (-I*psi1[x][yp1][0] + r*psi1[x][yp1][1]) -
-	     conj(gauge[x][ym1][1]) * (-I*psi1[x][ym1][0] - r*psi1[x][ym1][1]));
-      
-      
-    }
+		Un[1]   * (-I*yp[0] + r*(s*yp[1])) -
+	   conj(Uym[1]) * (-I*ym[0] - r*(s*ym[1]))));
   }
 }
 
-void Dpsi(Complex*** psi2, Complex*** psi1, Complex*** gauge, param_t p){
+template<int lx, int ly>
+void wilsonDslash(Complex *psi2, const Complex *psi1, const Complex *gauge, double m0) {
 
-  auto start = high_resolution_clock::now();
-
-  double m0 = p.m;
-  double  r = 1.0;
-  double constant = (2*r + m0);
-  int xp1, xm1, yp1, ym1;
+  const int nx = (lx ? lx : LX);
+  const int ny = (ly ? ly : LY);
   
   //Sum over 0,1 directions.
-  #pragma omp parallel for
-  for(int x=0; x<LX; x++) {
-    xp1 = (x+1)%LX;
-    xm1 = (x-1+LX)%LX;
-    for(int y=0; y<LY; y++) {
-      yp1 = (y+1)%LY;
-      ym1 = (y-1+LY)%LY;
-      
-      //upper
-      psi2[x][y][0] = constant * psi1[x][y][0] -
-	
-	0.5*(     gauge[x][y][0]    * (r*psi1[xp1][y][0] - psi1[xp1][y][1]) +
-	     conj(gauge[xm1][y][0]) * (r*psi1[xm1][y][0] + psi1[xm1][y][1]) +
-		  
-		  gauge[x][y][1]    * (r*psi1[x][yp1][0] + I*psi1[x][yp1][1]) +
-	     conj(gauge[x][ym1][1]) * (r*psi1[x][ym1][0] - I*psi1[x][ym1][1]));
-      
-      //lower
-      psi2[x][y][1] = constant * psi1[x][y][1] -
-	
-	0.5*(     gauge[x][y][0]    * (-psi1[xp1][y][0] + r*psi1[xp1][y][1]) -
-	     conj(gauge[xm1][y][0]) * (-psi1[xm1][y][0] - r*psi1[xm1][y][1]) +
+#pragma omp parallel for
+  for(int x=0; x<nx; x++) {
+    int xp1 = lx ? (x+1)%lx : nbr.xp[x];
+    int xm1 = lx ? (x-1+lx)%lx : nbr.xm[x];
 
-		  gauge[x][y][1]    * (-I*psi1[x][yp1][0] + r*psi1[x][yp1][1]) -
-	     conj(gauge[x][ym1][1]) * (-I*psi1[x][ym1][0] - r*psi1[x][ym1][1]));
-      
-      
-    }
+    wilsonRow<ly>(psi2 + 2L*x*ny, psi1 + 2L*x*ny, psi1 + 2L*xp1*ny, psi1 + 2L*xm1*ny,
+		  gauge + 2L*x*ny, gauge + 2L*xm1*ny, m0, false);
   }
+}
 
-  auto stop = high_resolution_clock::now();
-  auto duration = duration_cast<microseconds>(stop - start);
-  gst.matmul_time += duration.count();
+/*
+  For a 2D square lattice, the stencil is:
+
+  psi2[x] = D_xy psi_y = m psi_x delta_xy 
+  - eta_mu(x) [U(x,x+mu) psi[x+mu] - U*(x-mu,x) psi[x-mu]]
+
+  The even/odd anti-hermiticity             
+
+  eta_mu(x) [U(x,y)\deta_x+mu,y - U(y,x) delta_y+mu,
+ 
+  1 |  0 -eta1  0 |
+  - | +1    0  -1 |  , where eta0 = 1, eta1 = (-)^x = 1 - 2*(x%2)
+  2 |  0 +eta1  0 |
+
+*/
+
+// sign = -1 applies D, sign = +1 applies D^dag. One x row, with in, inp
+// and inm the rows x, x+1 and x-1, U and Um the gauge rows x and x-1 and
+// eta1 the phase of row x.
+template<int ly>
+inline void staggeredRow(Complex *out, const Complex *in, const Complex *inp, const Complex *inm,
+			 const Complex *U, const Complex *Um, double eta1, double m, double sign) {
+
+  const int ny = (ly ? ly : LY);
+
+  for(int y=0; y<ny; y++) {
+    int yp1 = ly ? (y+1)%ly : nbr.yp[y];
+    int ym1 = ly ? (y-1+ly)%ly : nbr.ym[y];
+    
+    out[y] = m*in[y];
+    
+    out[y] += sign*(U[2*y] * inp[y]
+		    - conj(Um[2*y]) * inm[y]);
+    
+    out[y] += sign*eta1*(U[2*y+1] * in[yp1]
+			 - conj(U[2*ym1+1]) * in[ym1]);
+  }
 }
 
-void g3psi(Complex psi2[LX][LY][2], Complex psi1[LX][LY][2]){
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++) {
-      psi2[x][y][0] =  psi1[x][y][0];
-      psi2[x][y][1] = -psi1[x][y][1];
-    }
+template<int lx, int ly>
+void staggeredDslash(Complex *psi2, const Complex *psi1, const Complex *gauge,
+		     double m, double sign) {
+
+  const int nx = (lx ? lx : LX);
+  const int ny = (ly ? ly : LY);
+
+#pragma omp parallel for
+  for(int x=0; x<nx; x++) {
+    double eta1 =(1-2*(x%2));
+    int xp1 = lx ? (x+1)%lx : nbr.xp[x];
+    int xm1 = lx ? (x-1+lx)%lx : nbr.xm[x];
+
+    staggeredRow<ly>(psi2 + (long)x*ny, psi1 + (long)x*ny, psi1 + (long)xp1*ny, psi1 + (long)xm1*ny,
+		     gauge + 2L*x*ny, gauge + 2L*xm1*ny, eta1, m, sign);
+  }
 }
 
-void g3psi(Complex psi1[LX][LY][2]){
+//Wilson stencil on a block of fields
+//---------------------------------------------------------------------------
+// A block holds N Wilson fields in one latField with nd = 2N, spin major
+// with the field index innermost,
+//
+//   f(x,y,s*N + k),  s = 0,1,  k = 0..N-1
+//
+// (see insertBlock). Each link is loaded once per site and applied to all
+// N fields, which sit next to each other in memory. Arguments are those
+// of wilsonRow; fields k0..N-1 are computed, so that the SIMD kernels in
+// dOpHelpersSIMD.h can hand their remainder to this one.
+inline void wilsonRowBlockBody(Complex *psi2, const Complex *psi1, const Complex *psi1p, const Complex *psi1m,
+			       const Complex *gauge, const Complex *gaugem, double m0, bool dag, int N, int k0) {
+
+  const long ns = 4L*N; //doubles per site
+  const double k = 2.0 + m0;
+  const double s = (dag ? -1.0 : 1.0);
   
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++) {
-      psi1[x][y][1] *= -1.0;
+  for(int y=0; y<LY; y++) {
+    int yp1 = nbr.yp[y];
+    int ym1 = nbr.ym[y];
+    
+    const double u0r = real(gauge[2*y]),      u0i = imag(gauge[2*y]);
+    const double u1r = real(gauge[2*y+1]),    u1i = imag(gauge[2*y+1]);
+    const double uxr = real(gaugem[2*y]),     uxi = imag(gaugem[2*y]);
+    const double uyr = real(gauge[2*ym1+1]),  uyi = imag(gauge[2*ym1+1]);
+    
+    const double *n  = (const double *)psi1  + ns*y;
+    const double *xp = (const double *)psi1p + ns*y;
+    const double *xm = (const double *)psi1m + ns*y;
+    const double *yp = (const double *)psi1  + ns*yp1;
+    const double *ym = (const double *)psi1  + ns*ym1;
+    double *out = (double *)psi2 + ns*y;
+    
+    //Spin 0 of field j is at 2j, spin 1 at 2N + 2j
+    for(int j=2*k0; j<2*N; j+=2) {
+      const int l = 2*N + j;
+      double tr, ti;
+
+      //a = U_x(n) (psi(n+x)_0 - s psi(n+x)_1)
+      tr = xp[j] - s*xp[l];
+      ti = xp[j+1] - s*xp[l+1];
+      double ar = u0r*tr - u0i*ti;
+      double ai = u0r*ti + u0i*tr;
+
+      //b = U_x(n-x)^* (psi(n-x)_0 + s psi(n-x)_1)
+      tr = xm[j] + s*xm[l];
+      ti = xm[j+1] + s*xm[l+1];
+      double br = uxr*tr + uxi*ti;
+      double bi = uxr*ti - uxi*tr;
+
+      //c = U_y(n) (psi(n+y)_0 + i s psi(n+y)_1)
+      tr = yp[j] - s*yp[l+1];
+      ti = yp[j+1] + s*yp[l];
+      double cr = u1r*tr - u1i*ti;
+      double ci = u1r*ti + u1i*tr;
+
+      //d = U_y(n-y)^* (psi(n-y)_0 - i s psi(n-y)_1)
+      tr = ym[j] + s*ym[l+1];
+      ti = ym[j+1] - s*ym[l];
+      double dr = uyr*tr + uyi*ti;
+      double di = uyr*ti - uyi*tr;
+
+      //upper = k psi_0 - (a + b + c + d)/2
+      //lower = k psi_1 - s(-a + b - i c + i d)/2
+      out[j]   = k*n[j]   - 0.5*(ar + br + cr + dr);
+      out[j+1] = k*n[j+1] - 0.5*(ai + bi + ci + di);
+      out[l]   = k*n[l]   - 0.5*s*(br - ar + ci - di);
+      out[l+1] = k*n[l+1] - 0.5*s*(bi - ai - cr + dr);
     }
+  }
 }
 
-void g3psi(Complex*** psi1){
+typedef void (*wilsonRowBlock_t)(Complex *, const Complex *, const Complex *, const Complex *,
+				 const Complex *, const Complex *, double, bool, int);
 
-  #pragma omp parallel for
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++) {
-      psi1[x][y][1] *= -1.0;
-    }
+void wilsonRowBlock(Complex *psi2, const Complex *psi1, const Complex *psi1p, const Complex *psi1m,
+		    const Complex *gauge, const Complex *gaugem, double m0, bool dag, int N) {
+  wilsonRowBlockBody(psi2, psi1, psi1p, psi1m, gauge, gaugem, m0, dag, N, 0);
 }
 
-void g2psi(Complex psi2[LX][LY][2], Complex psi1[LX][LY][2]){
+//Checkerboard rows
+//---------------------------------------------------------------------------
+// The even-odd operators further down act on half fields (see
+// extractParity): row x of parity p holds the sites y = 2j + o with
+// o = (x+p)%2. The parity q = 1-p neighbours of site j are at j in rows
+// x+1 and x-1, and at j+o (y+1) and j-1+o (y-1) in row x. The gauge field
+// is passed in the same checkerboard order (see checkerboardGauge), and
+// for output parity p, U is row x of the parity p links and Um, Uq are
+// rows x-1 and x of the parity q links, so every operand is read along
+// the row.
+
+// The hopping rows are templates on the real type, so that the mixed
+// precision solvers (see AinvpsiEO) can run them in single precision.
+
+// One row of the staggered hopping term H, eta1 the phase of row x.
+template<typename R>
+inline void staggeredHopRow(complex<R> *out, const complex<R> *in, const complex<R> *inp, const complex<R> *inm,
+			    const complex<R> *U, const complex<R> *Um, const complex<R> *Uq, int o, double eta1) {
+
+  const int nh = LY/2;
+  const R eta = eta1;
   
+  for(int j=0; j<nh; j++) {
+    int jp = j + o;
+    int jm = j - 1 + o;
+    if(jp == nh) jp = 0;
+    if(jm < 0) jm = nh - 1;
+    
+    out[j] = (U[2*j] * inp[j] - conj(Um[2*j]) * inm[j]) +
+      eta*(U[2*j+1] * in[jp] - conj(Uq[2*jm+1]) * in[jm]);
+  }
+}
+
+// One row of the Wilson hopping term H, D = (m0 + 2) - H/2 at r = 1.
+// s = -1 gives g3 H g3 instead.
+template<typename R>
+inline void wilsonHopRow(complex<R> *out, const complex<R> *in, const complex<R> *inp, const complex<R> *inm,
+			 const complex<R> *U, const complex<R> *Um, const complex<R> *Uq, int o, double s) {
+
+  typedef complex<R> C;
+  const int nh = LY/2;
+  const R sg = s;
+  const C i(0, 1);
+  
+  for(int j=0; j<nh; j++) {
+    int jp = j + o;
+    int jm = j - 1 + o;
+    if(jp == nh) jp = 0;
+    if(jm < 0) jm = nh - 1;
+
+    const C *Un  = U  + 2*j;
+    const C *Uxm = Um + 2*j;
+    const C *Uym = Uq + 2*jm;
+    const C *xp  = inp + 2*j;
+    const C *xm  = inm + 2*j;
+    const C *yp  = in + 2*jp;
+    const C *ym  = in + 2*jm;
+
+    //upper
+    out[2*j] = (     Un[0]   * (xp[0] - sg*xp[1]) +
+		conj(Uxm[0]) * (xm[0] + sg*xm[1]) +
+		     Un[1]   * (yp[0] + i*(sg*yp[1])) +
+		conj(Uym[1]) * (ym[0] - i*(sg*ym[1])));
+
+    //lower
+    out[2*j+1] = (     Un[0]   * (xp[1] - sg*xp[0]) +
+		  conj(Uxm[0]) * (xm[1] + sg*xm[0]) +
+		       Un[1]   * (yp[1] - i*(sg*yp[0])) +
+		  conj(Uym[1]) * (ym[1] + i*(sg*ym[0])));
+  }
+}
+
+#include "dOpHelpersSIMD.h"
+
+typedef void (*wilsonRow_t)(Complex *, const Complex *, const Complex *, const Complex *,
+			    const Complex *, const Complex *, double, bool);
+template<typename R>
+using wilsonHopRow_t = void (*)(complex<R> *, const complex<R> *, const complex<R> *, const complex<R> *,
+				const complex<R> *, const complex<R> *, const complex<R> *, int, double);
+
+//Full lattice Wilson operator from a row kernel
+template<wilsonRow_t row>
+void wilsonDslashRows(Complex *psi2, const Complex *psi1, const Complex *gauge, double m0) {
+
+  const long n = 2L*LY;
+#pragma omp parallel for
   for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++) {
-      psi2[x][y][0] = -I*psi1[x][y][1];
-      psi2[x][y][1] =  I*psi1[x][y][0];
-    }
+    row(psi2 + x*n, psi1 + x*n, psi1 + nbr.xp[x]*n, psi1 + nbr.xm[x]*n,
+	gauge + x*n, gauge + nbr.xm[x]*n, m0, false);
 }
 
-void g2psi(Complex psi1[LX][LY][2]){
+//Lattice size fast paths
+//---------------------------------------------------------------------------
+// The stencils above are templates on the lattice extents. A non-zero
+// template argument makes that extent a compile time constant, so the
+// periodic wrap reduces to a mask and the site strides fold into the
+// addressing. The generic instance <0,0> reads the runtime LX and LY and
+// takes its neighbours from the shared tables. selectDiracKernels()
+// is called once at startup and points the operators at a specialised
+// instance when the lattice is one of the common square sizes. The Wilson
+// operator is then replaced by the widest SIMD kernel the CPU supports,
+// when LY is a multiple of its vector length, and the even-odd hopping
+// rows of both precisions likewise when LY/2 is. The block kernel vectorises over the fields
+// and has no such restriction. The scalar kernels remain the fallback.
+
+void (*wilsonKernel)(Complex *, const Complex *, const Complex *, double) = wilsonDslash<0,0>;
+void (*staggeredKernel)(Complex *, const Complex *, const Complex *, double, double) = staggeredDslash<0,0>;
+wilsonRow_t wilsonRowKernel = wilsonRow<0>;
+wilsonHopRow_t<double> wilsonHopRowKernel = wilsonHopRow<double>;
+wilsonHopRow_t<float> wilsonHopRowKernelF = wilsonHopRow<float>;
+wilsonRowBlock_t wilsonRowBlockKernel = wilsonRowBlock;
+void (*staggeredRowKernel)(Complex *, const Complex *, const Complex *, const Complex *,
+			   const Complex *, const Complex *, double, double, double) = staggeredRow<0>;
+
+template<int L> void setDiracKernels() {
+  wilsonKernel = wilsonDslash<L,L>;
+  wilsonRowKernel = wilsonRow<L>;
+  staggeredKernel = staggeredDslash<L,L>;
+  staggeredRowKernel = staggeredRow<L>;
+}
+
+void selectDiracKernels() {
 
-  Complex tmp = 0.0;
-  for(int x=0; x<LX; x++)    
-    for(int y=0; y<LY; y++) {
-      tmp = psi1[x][y][1];      
-      psi1[x][y][1] =  I*psi1[x][y][0];
-      psi1[x][y][0] = -I*tmp;
+  bool special = true;
+  wilsonKernel = wilsonDslash<0,0>;
+  wilsonRowKernel = wilsonRow<0>;
+  wilsonHopRowKernel = wilsonHopRow<double>;
+  wilsonHopRowKernelF = wilsonHopRow<float>;
+  wilsonRowBlockKernel = wilsonRowBlock;
+  staggeredKernel = staggeredDslash<0,0>;
+  staggeredRowKernel = staggeredRow<0>;
+  
+  if(LX != LY) special = false;
+  else {
+    switch(LX) {
+    case 16:  setDiracKernels<16>();  break;
+    case 32:  setDiracKernels<32>();  break;
+    case 64:  setDiracKernels<64>();  break;
+    case 128: setDiracKernels<128>(); break;
+    case 256: setDiracKernels<256>(); break;
+    case 512: setDiracKernels<512>(); break;
+    default: special = false;
     }
+  }
+  string wilsonISA = "scalar";
+  string hopISA = "scalar";
+  string hopISAF = "scalar";
+#ifdef WILSON_SIMD
+  if(__builtin_cpu_supports("avx512f") && LY%8 == 0) {
+    wilsonKernel = wilsonDslashRows<wilsonRowAVX512>;
+    wilsonRowKernel = wilsonRowAVX512;
+    wilsonISA = "AVX-512";
+  } else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && LY%4 == 0) {
+    wilsonKernel = wilsonDslashRows<wilsonRowAVX2>;
+    wilsonRowKernel = wilsonRowAVX2;
+    wilsonISA = "AVX2";
+  }
+  if(__builtin_cpu_supports("avx512f")) wilsonRowBlockKernel = wilsonRowBlockAVX512;
+  else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) wilsonRowBlockKernel = wilsonRowBlockAVX2;
+  if(__builtin_cpu_supports("avx512f") && LY%16 == 0) {
+    wilsonHopRowKernel = wilsonHopRowAVX512;
+    hopISA = "AVX-512";
+  } else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && LY%8 == 0) {
+    wilsonHopRowKernel = wilsonHopRowAVX2;
+    hopISA = "AVX2";
+  }
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && LY%16 == 0) {
+    wilsonHopRowKernelF = wilsonHopRowAVX2;
+    hopISAF = "AVX2";
+  }
+#endif
+  
+  cout << "Dirac kernels: " << (special ? "specialised" : "generic")
+       << " for " << LX << "x" << LY << ", Wilson " << wilsonISA
+       << ", even-odd Wilson " << hopISA << " (single " << hopISAF << ")" << endl;
 }
 
+//The selected hopping row kernel of each precision
+inline wilsonHopRow_t<double> wilsonHopRowFor(double) { return wilsonHopRowKernel; }
+inline wilsonHopRow_t<float> wilsonHopRowFor(float) { return wilsonHopRowKernelF; }
 
-void g1psi(Complex psi2[LX][LY][2], Complex psi1[LX][LY][2]){
-  
+//Wilson operator on a block of N fields, one row at a time
+void wilsonBlock(Complex *psi2, const Complex *psi1, const Complex *gauge, double m0, int N) {
+
+  const long n = 2L*N*LY;
+  const long ng = 2L*LY;
+#pragma omp parallel for
   for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++) {
-      psi2[x][y][0] = psi1[x][y][1];
-      psi2[x][y][1] = psi1[x][y][0];
-    }
+    wilsonRowBlockKernel(psi2 + x*n, psi1 + x*n, psi1 + nbr.xp[x]*n, psi1 + nbr.xm[x]*n,
+			 gauge + x*ng, gauge + nbr.xm[x]*ng, m0, false, N);
 }
 
-void g1psi(Complex psi1[LX][LY][2]){
+//Dirac operators
+//---------------------------------------------------------------------------
+// Staggered fields carry one component per site (nd = 1), Wilson fields
+// carry two spin components (nd = 2) and a block of N Wilson fields
+// carries nd = 2N (see wilsonRowBlockBody).
+
+void Dpsi(latField<Complex> &psi2, const latField<Complex> &psi1,
+	  const latField<Complex> &gauge, param_t p){
+
+  auto start = high_resolution_clock::now();
+
+  if(psi1.nd == 1) staggeredKernel(psi2.v, psi1.v, gauge.v, p.m, -1.0);
+  else if(psi1.nd == 2) wilsonKernel(psi2.v, psi1.v, gauge.v, p.m);
+  else wilsonBlock(psi2.v, psi1.v, gauge.v, p.m, psi1.nd/2);
 
-  Complex tmp = 0.0;
-  for(int x=0; x<LX; x++)    
-    for(int y=0; y<LY; y++) {
-      tmp = psi1[x][y][1];      
-      psi1[x][y][1] = psi1[x][y][0];
-      psi1[x][y][0] = tmp;
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.matmul_time += duration.count();
+}
+
+//g3 flips the second half of the site components, spin 1 of every field
+//in a block.
+void g3psi(latField<Complex> &psi2, const latField<Complex> &psi1){
+
+  const int N = psi1.nd/2;
+#pragma omp parallel for
+  for(long i=0; i<psi1.vol; i++)
+    for(int k=0; k<N; k++) {
+      psi2.v[2*N*i + k]     =  psi1.v[2*N*i + k];
+      psi2.v[2*N*i + N + k] = -psi1.v[2*N*i + N + k];
     }
 }
 
+void g3psi(latField<Complex> &psi1){
 
-void g3Dpsi(Complex psi2[LX][LY][2], Complex psi1[LX][LY][2],
-	    const Complex gauge[LX][LY][2], param_t p ){
+  const int N = psi1.nd/2;
+#pragma omp parallel for
+  for(long i=0; i<psi1.vol; i++)
+    for(int k=0; k<N; k++) psi1.v[2*N*i + N + k] *= -1.0;
+}
 
-  Dpsi(psi2, psi1, gauge, p);
-  g3psi(psi2);
+void g2psi(latField<Complex> &psi2, const latField<Complex> &psi1){
+
+#pragma omp parallel for
+  for(long i=0; i<psi1.vol; i++) {
+    psi2.v[2*i]   = -I*psi1.v[2*i+1];
+    psi2.v[2*i+1] =  I*psi1.v[2*i];
+  }
 }
 
-void g3Dpsi(Complex*** psi2, Complex*** psi1, Complex*** gauge, param_t p ){
+void g2psi(latField<Complex> &psi1){
 
-  Dpsi(psi2, psi1, gauge, p);
-  g3psi(psi2);
+#pragma omp parallel for
+  for(long i=0; i<psi1.vol; i++) {
+    Complex tmp = psi1.v[2*i+1];
+    psi1.v[2*i+1] =  I*psi1.v[2*i];
+    psi1.v[2*i]   = -I*tmp;
+  }
 }
 
+void g1psi(latField<Complex> &psi2, const latField<Complex> &psi1){
 
-void Ddagpsi(Complex psi2[LX][LY][2], Complex psi1[LX][LY][2],
-	     const Complex gauge[LX][LY][2], param_t p){
-  
-  g3psi(psi1);
-  Dpsi(psi2, psi1, gauge, p);
-  g3psi(psi2);  
+#pragma omp parallel for
+  for(long i=0; i<psi1.vol; i++) {
+    psi2.v[2*i]   = psi1.v[2*i+1];
+    psi2.v[2*i+1] = psi1.v[2*i];
+  }
 }
 
+void g1psi(latField<Complex> &psi1){
 
-void DdagDpsi(Complex psi2[LX][LY][2], Complex psi1[LX][LY][2],
-	      const Complex gauge[LX][LY][2], param_t p) {
-  
-  //Hack for now
-  Complex temp[LX][LY][2];
-  Dpsi(temp, psi1, gauge, p);
-  g3psi(temp);
-  Dpsi(psi2, temp, gauge, p);
+#pragma omp parallel for
+  for(long i=0; i<psi1.vol; i++) {
+    Complex tmp = psi1.v[2*i+1];
+    psi1.v[2*i+1] = psi1.v[2*i];
+    psi1.v[2*i]   = tmp;
+  }
+}
+
+void g3Dpsi(latField<Complex> &psi2, const latField<Complex> &psi1,
+	    const latField<Complex> &gauge, param_t p ){
+
+  Dpsi(psi2, psi1, gauge, p);
   g3psi(psi2);
 }
 
-void DdagDpsi(Complex*** psi2, Complex*** psi1,
-	      Complex*** gauge, param_t p) {
+void Ddagpsi(latField<Complex> &psi2, const latField<Complex> &psi1,
+	     const latField<Complex> &gauge, param_t p){
+
+  if(psi1.nd == 1) {
+    auto start = high_resolution_clock::now();
+    staggeredKernel(psi2.v, psi1.v, gauge.v, p.m, 1.0);
+    auto stop = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(stop - start);
+    gst.matmul_time += duration.count();
+  } else {
+    // D^dag = g3 D g3
+    tmpField<Complex> temp(psi1.nd);
+    g3psi(temp, psi1);
+    Dpsi(psi2, temp, gauge, p);
+    g3psi(psi2);
+  }
+}
 
-  Complex*** temp = gst.b0X;
+//Fused Wilson normal operator
+//---------------------------------------------------------------------------
+// psi2 = g3 D g3 D psi1 in a single sweep. Each thread walks a contiguous
+// band of x rows and keeps D psi1 for rows x-1, x and x+1 in a three row
+// ring, so D^dag (the row kernel with the g3 flips folded in) is applied
+// to row x as soon as row x+1 of D psi1 exists. The intermediate never
+// leaves cache. Returns <psi1, DdagD psi1> = |D psi1|^2, which is summed
+// from the ring rows on the way.
 
-  //Hack for now
-  //Complex temp[LX][LY][2];
+double wilsonDdagD(Complex *psi2, const Complex *psi1, const Complex *gauge, double m0) {
 
-  Dpsi(temp, psi1, gauge, p);
-  g3psi(temp);
-  Dpsi(psi2, temp, gauge, p);
-  g3psi(psi2);
+  const long n = 2L*LY;
+  double pAp = 0.0;
+  
+#pragma omp parallel reduction(+:pAp)
+  {
+    int nt = omp_get_num_threads();
+    int t = omp_get_thread_num();
+    int x0 = (LX*t)/nt;
+    int x1 = (LX*(t+1))/nt;
+    
+    if(x0 < x1) {
+      tmpField<Complex> ring(2, 3, LY);
+      Complex *slot[3] = {ring.v, ring.v + n, ring.v + 2*n};
+      
+      //Row x of D psi1 lives in slot[(x - x0 + 1)%3]
+      int xm = nbr.xm[x0];
+      wilsonRowKernel(slot[0], psi1 + xm*n, psi1 + x0*n, psi1 + nbr.xm[xm]*n,
+		      gauge + xm*n, gauge + nbr.xm[xm]*n, m0, false);
+      wilsonRowKernel(slot[1], psi1 + x0*n, psi1 + nbr.xp[x0]*n, psi1 + xm*n,
+		      gauge + x0*n, gauge + xm*n, m0, false);
+      
+      for(int x=x0; x<x1; x++) {
+	Complex *Dm = slot[(x - x0)%3];
+	Complex *D0 = slot[(x - x0 + 1)%3];
+	Complex *Dp = slot[(x - x0 + 2)%3];
+	int xp = nbr.xp[x];
+	
+	wilsonRowKernel(Dp, psi1 + xp*n, psi1 + nbr.xp[xp]*n, psi1 + x*n,
+			gauge + xp*n, gauge + x*n, m0, false);
+	wilsonRowKernel(psi2 + x*n, D0, Dp, Dm,
+			gauge + x*n, gauge + nbr.xm[x]*n, m0, true);
+	
+	for(long i=0; i<n; i++) pAp += norm(D0[i]);
+      }
+    }
+  }
+  return pAp;
 }
 
-void deflate(Complex guess_defl[LX][LY][2], Complex guess[LX][LY][2],
-	     Complex evecs[NEV][LX][LY][2],
-	     Complex evals[NEV], param_t p) {
+// Staggered D^dag D in one sweep, the same way: D psi1 is kept for rows
+// x-1, x and x+1 in a per thread ring and D^dag is applied to row x from
+// it. Returns <psi1, DdagD psi1> = |D psi1|^2.
+
+double staggeredDdagD(Complex *psi2, const Complex *psi1, const Complex *gauge, double m) {
 
-#ifdef USE_ARPACK
-  zeroField(guess_defl);
-  Complex scalar;
-  //Deflate each converged eigenpair from the guess
-  // guess_defl = (v * lambda^-1 * v^dag) * guess
-  for(int i=0; i<NEV; i++) {
+  const long n = LY;
+  double pAp = 0.0;
+  
+#pragma omp parallel reduction(+:pAp)
+  {
+    int nt = omp_get_num_threads();
+    int t = omp_get_thread_num();
+    int x0 = (LX*t)/nt;
+    int x1 = (LX*(t+1))/nt;
     
-    //Compute scalar part: s = (lambda)^-1 * (v^dag * guess)
-    scalar = dotField(evecs[i], guess);
-    scalar /= real(evals[i]);
-    //Accumulate in guess defl_guess: defl_guess = defl_guess + v * s
-    caxpy(scalar, evecs[i], guess_defl);
+    if(x0 < x1) {
+      tmpField<Complex> ring(1, 3, LY);
+      Complex *slot[3] = {ring.v, ring.v + n, ring.v + 2*n};
+      
+      //Row x of D psi1 lives in slot[(x - x0 + 1)%3]
+      int xm = nbr.xm[x0];
+      staggeredRowKernel(slot[0], psi1 + xm*n, psi1 + x0*n, psi1 + nbr.xm[xm]*n,
+			 gauge + 2*xm*n, gauge + 2*nbr.xm[xm]*n, 1-2*(xm%2), m, -1.0);
+      staggeredRowKernel(slot[1], psi1 + x0*n, psi1 + nbr.xp[x0]*n, psi1 + xm*n,
+			 gauge + 2*x0*n, gauge + 2*xm*n, 1-2*(x0%2), m, -1.0);
+      
+      for(int x=x0; x<x1; x++) {
+	Complex *Dm = slot[(x - x0)%3];
+	Complex *D0 = slot[(x - x0 + 1)%3];
+	Complex *Dp = slot[(x - x0 + 2)%3];
+	int xp = nbr.xp[x];
+	
+	staggeredRowKernel(Dp, psi1 + xp*n, psi1 + nbr.xp[xp]*n, psi1 + x*n,
+			   gauge + 2*xp*n, gauge + 2*x*n, 1-2*(xp%2), m, -1.0);
+	staggeredRowKernel(psi2 + x*n, D0, Dp, Dm,
+			   gauge + 2*x*n, gauge + 2*nbr.xm[x]*n, 1-2*(x%2), m, 1.0);
+	
+	for(long i=0; i<n; i++) pAp += norm(D0[i]);
+      }
+    }
   }
-#endif
+  return pAp;
 }
 
-void deflate(Complex*** guess_defl, Complex*** guess,
-	     Complex evecs[NEV][LX][LY][2],
-	     Complex evals[NEV], param_t p) {
+// Wilson D^dag D on a block of N fields in one sweep, as wilsonDdagD.
+// pAp[k] = <psi1_k, DdagD psi1_k> for each field when pAp is given.
 
-#ifdef USE_ARPACK
-  zeroField(guess_defl);
-  Complex scalar;
-  //Deflate each converged eigenpair from the guess
-  // guess_defl = (v * lambda^-1 * v^dag) * guess
-  for(int i=0; i<NEV; i++) {
+void wilsonDdagDBlock(Complex *psi2, const Complex *psi1, const Complex *gauge,
+		      double m0, int N, double *pAp) {
+
+  const long n = 2L*N*LY;
+  const long ng = 2L*LY;
+  vector<double> dot(N, 0.0);
+  double *d = dot.data();
+  
+#pragma omp parallel reduction(+:d[:N])
+  {
+    int nt = omp_get_num_threads();
+    int t = omp_get_thread_num();
+    int x0 = (LX*t)/nt;
+    int x1 = (LX*(t+1))/nt;
     
-    //Compute scalar part: s = (lambda)^-1 * (v^dag * guess)
-    scalar = dotField(evecs[i], guess);
-    scalar /= real(evals[i]);
-    //Accumulate in guess defl_guess: defl_guess = defl_guess + v * s
-    caxpy(scalar, evecs[i], guess_defl);
+    if(x0 < x1) {
+      tmpField<Complex> ring(2*N, 3, LY);
+      Complex *slot[3] = {ring.v, ring.v + n, ring.v + 2*n};
+      
+      //Row x of D psi1 lives in slot[(x - x0 + 1)%3]
+      int xm = nbr.xm[x0];
+      wilsonRowBlockKernel(slot[0], psi1 + xm*n, psi1 + x0*n, psi1 + nbr.xm[xm]*n,
+			   gauge + xm*ng, gauge + nbr.xm[xm]*ng, m0, false, N);
+      wilsonRowBlockKernel(slot[1], psi1 + x0*n, psi1 + nbr.xp[x0]*n, psi1 + xm*n,
+			   gauge + x0*ng, gauge + xm*ng, m0, false, N);
+      
+      for(int x=x0; x<x1; x++) {
+	Complex *Dm = slot[(x - x0)%3];
+	Complex *D0 = slot[(x - x0 + 1)%3];
+	Complex *Dp = slot[(x - x0 + 2)%3];
+	int xp = nbr.xp[x];
+	
+	wilsonRowBlockKernel(Dp, psi1 + xp*n, psi1 + nbr.xp[xp]*n, psi1 + x*n,
+			     gauge + xp*ng, gauge + x*ng, m0, false, N);
+	wilsonRowBlockKernel(psi2 + x*n, D0, Dp, Dm,
+			     gauge + x*ng, gauge + nbr.xm[x]*ng, m0, true, N);
+	
+	if(pAp)
+	  for(long i=0; i<2L*LY; i++)
+	    for(int k=0; k<N; k++) d[k] += norm(D0[N*i + k]);
+      }
+    }
   }
-#endif
+  if(pAp) for(int k=0; k<N; k++) pAp[k] = d[k];
 }
 
+//=======================//
+// Note: Ddag D = D Ddag //
+///======================//
+
+void DdagDpsi(latField<Complex> &psi2, const latField<Complex> &psi1,
+	      const latField<Complex> &gauge, param_t p) {
 
-/*
-  For a 2D square lattice, the stencil is:
+  auto start = high_resolution_clock::now();
+  
+  if(psi1.nd == 1) staggeredDdagD(psi2.v, psi1.v, gauge.v, p.m);
+  else if(psi1.nd == 2) wilsonDdagD(psi2.v, psi1.v, gauge.v, p.m);
+  else wilsonDdagDBlock(psi2.v, psi1.v, gauge.v, p.m, psi1.nd/2, nullptr);
+  
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.matmul_time += duration.count();
+}
 
-  psi2[x] = D_xy psi_y = m psi_x delta_xy 
-  - eta_mu(x) [U(x,x+mu) psi[x+mu] - U*(x-mu,x) psi[x-mu]]
+// As above, also returning pAp = <psi1, DdagD psi1>.
+void DdagDpsi(latField<Complex> &psi2, const latField<Complex> &psi1,
+	      const latField<Complex> &gauge, param_t p, double &pAp) {
 
-  The even/odd anti-hermiticity             
+  auto start = high_resolution_clock::now();
+  
+  if(psi1.nd == 1) pAp = staggeredDdagD(psi2.v, psi1.v, gauge.v, p.m);
+  else if(psi1.nd == 2) pAp = wilsonDdagD(psi2.v, psi1.v, gauge.v, p.m);
+  else {
+    // A block: pAp over the whole field is the sum over its fields
+    vector<double> d(psi1.nd/2);
+    wilsonDdagDBlock(psi2.v, psi1.v, gauge.v, p.m, psi1.nd/2, d.data());
+    pAp = 0.0;
+    for(double dk : d) pAp += dk;
+  }
 
-  eta_mu(x) [U(x,y)\deta_x+mu,y - U(y,x) delta_y+mu,
- 
-  1 |  0 -eta1  0 |
-  - | +1    0  -1 |  , where eta0 = 1, eta1 = (-)^x = 1 - 2*(x%2)
-  2 |  0 +eta1  0 |
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.matmul_time += duration.count();
+}
 
-*/
+// A block of N Wilson fields, returning pAp[k] = <psi1_k, DdagD psi1_k>.
+void DdagDpsi(latField<Complex> &psi2, const latField<Complex> &psi1,
+	      const latField<Complex> &gauge, param_t p, double *pAp) {
+
+  auto start = high_resolution_clock::now();
+  wilsonDdagDBlock(psi2.v, psi1.v, gauge.v, p.m, psi1.nd/2, pAp);
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.matmul_time += duration.count();
+}
 
-void Dpsi(Complex psi2[LX][LY], Complex psi1[LX][LY],
-	  const Complex gauge[LX][LY][2], param_t p ){
+//Checkerboarded staggered operator
+//---------------------------------------------------------------------------
+// D^dag D = m^2 - H^2 for the staggered hopping term H, and H only links
+// opposite parities, so D^dag D is block diagonal and each parity block
+//
+//   A_pp = m^2 - H_pq H_qp,  q = 1 - p
+//
+// can be solved on its own on half fields. The layout of the fields and
+// of the checkerboarded gauge field gaugeEO is given above staggeredHopRow.
 
-  int xp1, xm1, yp1, ym1;
-  double eta1;  
+// psi2 (parity par) = H psi1 (parity 1-par)
+void DhopEO(latField<Complex> &psi2, const latField<Complex> &psi1,
+	    const latField<Complex> &gaugeEO, int par) {
+
+  const long nh = LY/2;
+  const Complex *Up = gaugeEO.v + (long)par*LX*LY;
+  const Complex *Uq = gaugeEO.v + (long)(1-par)*LX*LY;
   
-  for(int x=0; x<LX; x++) {
-    eta1 =(1-2*(x%2));
-    xp1 = (x+1)%LX;
-    xm1 = (x-1+LX)%LX;    
-    for(int y=0; y<LY; y++) {
-      yp1 = (y+1)%LY;
-      ym1 = (y-1+LY)%LY;
-
-      psi2[x][y] = p.m*psi1[x][y];
-      
-      psi2[x][y] += - (gauge[x][y][0] * psi1[xp1][y]
-		       - conj(gauge[xm1][y][0]) * psi1[xm1][y]);
+#pragma omp parallel for
+  for(int x=0; x<LX; x++)
+    staggeredHopRow(psi2.v + x*nh, psi1.v + x*nh, psi1.v + nbr.xp[x]*nh, psi1.v + nbr.xm[x]*nh,
+		    Up + x*LY, Uq + nbr.xm[x]*LY, Uq + x*LY, (x+par)%2, 1-2*(x%2));
+}
+
+// psi2 = A_pp psi1 on parity par, in one sweep with H_qp psi1 held in a
+// three row ring as in wilsonDdagD. Returns <psi1, A_pp psi1>
+// = m^2 |psi1|^2 + |H_qp psi1|^2.
+template<typename R>
+double staggeredDdagDEO(complex<R> *psi2, const complex<R> *psi1, const complex<R> *gaugeEO, double m, int par) {
+
+  typedef complex<R> C;
+
+  const long nh = LY/2;
+  const int q = 1 - par;
+  const C *Up = gaugeEO + (long)par*LX*LY;
+  const C *Uq = gaugeEO + (long)q*LX*LY;
+  const R m2 = m*m;
+  double pAp = 0.0;
+  
+#pragma omp parallel reduction(+:pAp)
+  {
+    int nt = omp_get_num_threads();
+    int t = omp_get_thread_num();
+    int x0 = (LX*t)/nt;
+    int x1 = (LX*(t+1))/nt;
+    
+    if(x0 < x1) {
+      tmpField<C> ring(1, 3, nh);
+      C *slot[3] = {ring.v, ring.v + nh, ring.v + 2*nh};
       
-      psi2[x][y] += - eta1*(gauge[x][y][1]*psi1[x][yp1]
-			    - conj(gauge[x][ym1][1])*psi1[x][ym1]);
+      //Row x of H_qp psi1 lives in slot[(x - x0 + 1)%3]
+      int xm = nbr.xm[x0];
+      staggeredHopRow(slot[0], psi1 + xm*nh, psi1 + x0*nh, psi1 + nbr.xm[xm]*nh,
+		      Uq + xm*LY, Up + nbr.xm[xm]*LY, Up + xm*LY, (xm+q)%2, 1-2*(xm%2));
+      staggeredHopRow(slot[1], psi1 + x0*nh, psi1 + nbr.xp[x0]*nh, psi1 + xm*nh,
+		      Uq + x0*LY, Up + xm*LY, Up + x0*LY, (x0+q)%2, 1-2*(x0%2));
       
+      for(int x=x0; x<x1; x++) {
+	C *Hm = slot[(x - x0)%3];
+	C *H0 = slot[(x - x0 + 1)%3];
+	C *Hp = slot[(x - x0 + 2)%3];
+	int xp = nbr.xp[x];
+	
+	staggeredHopRow(Hp, psi1 + xp*nh, psi1 + nbr.xp[xp]*nh, psi1 + x*nh,
+			Uq + xp*LY, Up + x*LY, Up + xp*LY, (xp+q)%2, 1-2*(xp%2));
+	
+	C *out = psi2 + x*nh;
+	const C *in = psi1 + x*nh;
+	staggeredHopRow(out, H0, Hp, Hm,
+			Up + x*LY, Uq + nbr.xm[x]*LY, Uq + x*LY, (x+par)%2, 1-2*(x%2));
+	
+	for(long j=0; j<nh; j++) {
+	  pAp += m2*norm(in[j]) + norm(H0[j]);
+	  out[j] = m2*in[j] - out[j];
+	}
+      }
     }
   }
+  return pAp;
+}
+
+//Checkerboarded Wilson operator
+//---------------------------------------------------------------------------
+// With r = 1, D = (m0 + 2)(1 - kappa H), kappa = 1/(2(m0 + 2)), where the
+// hopping term H only links opposite parities. Eliminating the parity q
+// sites leaves the Schur complement on parity p,
+//
+//   Dhat = 1 - kappa^2 H_pq H_qp,
+//
+// and det D is det Dhat up to a gauge independent constant. Dhat is g3
+// hermitian like D, Dhat^dag = g3 Dhat g3. Fields and gauge are laid out
+// as for the staggered operator.
+
+// psi2 (parity par) = H psi1 (parity 1-par), or g3 H g3 psi1 for s = -1
+void wilsonHopEO(latField<Complex> &psi2, const latField<Complex> &psi1,
+		 const latField<Complex> &gaugeEO, int par, double s) {
+
+  const long n = LY; //2 spins, or 2 links, on LY/2 sites
+  const Complex *Up = gaugeEO.v + (long)par*LX*LY;
+  const Complex *Uq = gaugeEO.v + (long)(1-par)*LX*LY;
+  
+#pragma omp parallel for
+  for(int x=0; x<LX; x++)
+    wilsonHopRowKernel(psi2.v + x*n, psi1.v + x*n, psi1.v + nbr.xp[x]*n, psi1.v + nbr.xm[x]*n,
+		       Up + x*n, Uq + nbr.xm[x]*n, Uq + x*n, (x+par)%2, s);
 }
 
-void Ddagpsi(Complex psi2[LX][LY], Complex  psi1[LX][LY],
-	     const Complex gauge[LX][LY][2], param_t p ) {
+// psi2 = Dhat psi1 (s = 1) or Dhat^dag psi1 (s = -1) on parity par, in one
+// sweep with H_qp psi1 held in a three row ring as in wilsonDdagD.
+// Returns |psi2|^2.
+template<typename R>
+double wilsonDhatEO(complex<R> *psi2, const complex<R> *psi1, const complex<R> *gaugeEO,
+		    double m0, int par, double s) {
+
+  typedef complex<R> C;
+  const long n = LY; //2 spins, or 2 links, on LY/2 sites
+  const int q = 1 - par;
+  const C *Up = gaugeEO + (long)par*LX*LY;
+  const C *Uq = gaugeEO + (long)q*LX*LY;
+  const double kappa = 0.5/(m0 + 2.0);
+  const R k2 = kappa*kappa;
+  const wilsonHopRow_t<R> hopRow = wilsonHopRowFor(R());
+  double dsq = 0.0;
   
-  // For a 2D square lattice, the stencil is:
-  //   1 |  0 -eta1  0 |
-  //   - | +1    0  -1 |  , where eta0 = 1, eta1 = (-)^x = 1 - 2(x%L)
-  //   2 |  0 +eta1  0 |
-
-  int xp1, xm1, yp1, ym1;
-  double eta1;
-
-  for(int x=0; x<LX; x++) {
-    eta1 =(1-2*(x%2));
-    xp1 = (x+1)%LX;
-    xm1 = (x-1+LX)%LX;    
-    for(int y=0; y<LY; y++) {
-      yp1 = (y+1)%LY;
-      ym1 = (y-1+LY)%LY;
-
-      psi2[x][y] = p.m*psi1[x][y];
+#pragma omp parallel reduction(+:dsq)
+  {
+    int nt = omp_get_num_threads();
+    int t = omp_get_thread_num();
+    int x0 = (LX*t)/nt;
+    int x1 = (LX*(t+1))/nt;
+    
+    if(x0 < x1) {
+      tmpField<C> ring(2, 3, LY/2);
+      C *slot[3] = {ring.v, ring.v + n, ring.v + 2*n};
       
-      psi2[x][y] += (gauge[x][y][0] * psi1[xp1][y]
-		     - conj(gauge[xm1][y][0]) * psi1[xm1][y]);
+      //Row x of H_qp psi1 lives in slot[(x - x0 + 1)%3]
+      int xm = nbr.xm[x0];
+      hopRow(slot[0], psi1 + xm*n, psi1 + x0*n, psi1 + nbr.xm[xm]*n,
+	     Uq + xm*n, Up + nbr.xm[xm]*n, Up + xm*n, (xm+q)%2, s);
+      hopRow(slot[1], psi1 + x0*n, psi1 + nbr.xp[x0]*n, psi1 + xm*n,
+	     Uq + x0*n, Up + xm*n, Up + x0*n, (x0+q)%2, s);
       
-      psi2[x][y] += eta1*(gauge[x][y][1]*psi1[x][yp1]
-			  - conj(gauge[x][ym1][1])*psi1[x][ym1]);
+      for(int x=x0; x<x1; x++) {
+	C *Hm = slot[(x - x0)%3];
+	C *H0 = slot[(x - x0 + 1)%3];
+	C *Hp = slot[(x - x0 + 2)%3];
+	int xp = nbr.xp[x];
+	
+	hopRow(Hp, psi1 + xp*n, psi1 + nbr.xp[xp]*n, psi1 + x*n,
+	       Uq + xp*n, Up + x*n, Up + xp*n, (xp+q)%2, s);
+	
+	C *out = psi2 + x*n;
+	const C *in = psi1 + x*n;
+	hopRow(out, H0, Hp, Hm,
+	       Up + x*n, Uq + nbr.xm[x]*n, Uq + x*n, (x+par)%2, s);
+	
+	//Over the real components, so that the single precision row vectorises
+	R *o = (R *)out;
+	const R *v = (const R *)in;
+	double rowsq = 0.0;
+#pragma omp simd reduction(+:rowsq)
+	for(long i=0; i<2*n; i++) {
+	  o[i] = v[i] - k2*o[i];
+	  rowsq += o[i]*o[i];
+	}
+	dsq += rowsq;
+      }
     }
   }
+  return dsq;
 }
 
-//=======================//
-// Note: Ddag D = D Ddag //
-///======================//
+// psi2 = g3 Dhat psi1 on the EVEN sites
+void g3DpsiEO(latField<Complex> &psi2, const latField<Complex> &psi1,
+	      const latField<Complex> &gaugeEO, param_t p) {
 
-void DdagDpsi(Complex psi2[LX][LY], Complex  psi1[LX][LY],
-	      const Complex gauge[LX][LY][2], param_t p ) {
+  auto start = high_resolution_clock::now();
+  wilsonDhatEO(psi2.v, psi1.v, gaugeEO.v, p.m, 0, 1.0);
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.matmul_time += duration.count();
   
-  Complex psitmp[LX][LY];
-  zeroField(psitmp);
-  Dpsi(psitmp, psi1, gauge, p);
-  Ddagpsi(psi2, psitmp, gauge, p);
+  g3psi(psi2);
 }
 
+// psi2 = A_pp psi1 on parity par: the staggered block above, or
+// Dhat^dag Dhat for Wilson fields. Also returns pAp = <psi1, A_pp psi1>.
+// Double or single precision, with gaugeEO in the precision of the fields.
+template<typename R>
+void DdagDpsiEO(latField<complex<R>> &psi2, const latField<complex<R>> &psi1,
+		const latField<complex<R>> &gaugeEO, param_t p, int par, double &pAp) {
 
+  auto start = high_resolution_clock::now();
+  
+  if(psi1.nd == 1) pAp = staggeredDdagDEO(psi2.v, psi1.v, gaugeEO.v, p.m, par);
+  else {
+    tmpField<complex<R>> temp(2, LX, LY/2);
+    pAp = wilsonDhatEO(temp.v, psi1.v, gaugeEO.v, p.m, par, 1.0);
+    wilsonDhatEO(psi2.v, temp.v, gaugeEO.v, p.m, par, -1.0);
+  }
+  
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.matmul_time += duration.count();
+}
+
+//The operator that Ainvpsi inverts on each layout. Wilson half fields
+//take the links gaugeEO of checkerboardGauge, which callers applying A
+//many times build once.
+void Apsi(latField<Complex> &psi2, const latField<Complex> &psi1, const latField<Complex> &gauge,
+	  const latField<Complex> &gaugeEO, param_t param) {
+
+  if(psi1.nd == 2 && psi1.ny == LY/2) {
+    double pAp;
+    DdagDpsiEO(psi2, psi1, gaugeEO, param, 0, pAp);
+  }
+  else DdagDpsi(psi2, psi1, gauge, param);
+}
+
+void Apsi(latField<Complex> &psi2, const latField<Complex> &psi1,
+	  const latField<Complex> &gauge, param_t param) {
+
+  tmpField<Complex> gaugeEO;
+  if(psi1.nd == 2 && psi1.ny == LY/2) checkerboardGauge(gaugeEO, gauge);
+  Apsi(psi2, psi1, gauge, gaugeEO, param);
+}
+
+// guess = V lambda^-1 V^dag rhs for the blocks rhs and guess of N fields
+// (see insertBlock), V the p.nEv eigenvectors in the block evecs, in single
+// or double precision. One sweep projects every field on every eigenvector,
+// and a second one accumulates the guesses, so that each streams evecs once.
+template<typename T> void deflate(latField<Complex> &guess, const latField<Complex> &rhs,
+				  const latField<T> &evecs, const Complex *evals, param_t p) {
+
+  const int nev = p.nEv, nd = evecs.nd/nev, N = rhs.nd/nd, n = nev*N;
+  vector<double> re(n, 0.0), im(n, 0.0);
+  double *cr = re.data(), *ci = im.data();
+#pragma omp parallel for reduction(+:cr[:n], ci[:n])
+  for(long x=0; x<evecs.vol; x++) {
+    const T *v = evecs.v + x*evecs.nd;
+    const Complex *r = rhs.v + x*rhs.nd;
+    for(int s=0; s<nd; s++)
+      for(int i=0; i<nev; i++) {
+	const Complex vi = Complex(v[s*nev + i]);
+	for(int k=0; k<N; k++) {
+	  const Complex t = cdagtimes(vi, r[s*N + k]);
+	  cr[i*N + k] += t.real();
+	  ci[i*N + k] += t.imag();
+	}
+      }
+  }
+
+  vector<Complex> c(n);
+  for(int l=0; l<n; l++) c[l] = Complex(cr[l], ci[l])/real(evals[l/N]);
+
+#pragma omp parallel for
+  for(long x=0; x<evecs.vol; x++) {
+    const T *v = evecs.v + x*evecs.nd;
+    Complex *g = guess.v + x*guess.nd;
+    for(int s=0; s<nd; s++)
+      for(int k=0; k<N; k++) {
+	Complex sum = 0.0;
+	for(int i=0; i<nev; i++) sum += ctimes(Complex(v[s*nev + i]), c[i*N + k]);
+	g[s*N + k] = sum;
+      }
+  }
+}
 
 #endif
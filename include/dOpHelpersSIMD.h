@@ -0,0 +1,600 @@
+#ifndef DOPHELPERS_SIMD_H
+#define DOPHELPERS_SIMD_H
+
+//Vectorised Wilson hopping term
+//---------------------------------------------------------------------------
+// A Wilson spinor and a 2D gauge link are both four doubles per site,
+//
+//   psi : re0 im0 re1 im1        U : re(U_x) im(U_x) re(U_y) im(U_y)
+//
+// so W consecutive y sites can be loaded as W registers and transposed in
+// place into four vectors holding one real or imaginary part for W sites
+// (SoA). The stencil is then evaluated for W sites per instruction and
+// transposed back on the store. W = 4 for AVX2 and W = 8 for AVX-512, and
+// LY must be a multiple of W. The y neighbours of the first and last block
+// in a row wrap, and are gathered into a small buffer first.
+//
+// Like the scalar wilsonRow, each kernel computes one x row and applies
+// D^dag = g3 D g3 when dag is set, by flipping the spin-1 components on
+// the way in and out. The even-odd hopping rows work the same way on half
+// field rows (wilsonHopRow), where LY/2 must be a multiple of W.
+//
+// The single precision hopping row (AVX2, W = 8) holds one site in each
+// 128 bit lane and transposes the four floats within the lanes. The sites
+// then sit in the vectors in a permuted order, which is the same for every
+// operand and undone on the store. At W = 16 most blocks would wrap on
+// the usual lattice sizes, so there is no AVX-512 version.
+//
+// The kernels are compiled for their instruction set with target pragmas
+// and only selected when the CPU reports support (selectDiracKernels), so
+// the rest of the code needs no -m flags. Build with -DDISABLE_SIMD to
+// keep the scalar kernels only.
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(DISABLE_SIMD)
+#define WILSON_SIMD
+
+#include <immintrin.h>
+
+//Pointer to W sites starting at y0+shift in a row, wrapped through buf at
+//the row ends.
+template<typename R>
+inline const R *siteBlock(const R *row, int y0, int shift, int W, int ny, R *buf) {
+
+  int y = y0 + shift;
+  if(y >= 0 && y + W <= ny) return row + 4*y;
+  for(int i=0; i<W; i++) {
+    int yw = y + i;
+    if(yw < 0) yw += ny;
+    else if(yw >= ny) yw -= ny;
+    for(int k=0; k<4; k++) buf[4*i+k] = row[4*yw+k];
+  }
+  return buf;
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+//AVX2, 4 sites
+inline void loadSites(const double *p, __m256d &a, __m256d &b, __m256d &c, __m256d &d) {
+
+  __m256d r0 = _mm256_loadu_pd(p);
+  __m256d r1 = _mm256_loadu_pd(p + 4);
+  __m256d r2 = _mm256_loadu_pd(p + 8);
+  __m256d r3 = _mm256_loadu_pd(p + 12);
+  __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+  __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+  __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+  __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+  a = _mm256_permute2f128_pd(t0, t2, 0x20);
+  b = _mm256_permute2f128_pd(t1, t3, 0x20);
+  c = _mm256_permute2f128_pd(t0, t2, 0x31);
+  d = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+inline void storeSites(double *p, __m256d a, __m256d b, __m256d c, __m256d d) {
+
+  __m256d t0 = _mm256_unpacklo_pd(a, b);
+  __m256d t1 = _mm256_unpackhi_pd(a, b);
+  __m256d t2 = _mm256_unpacklo_pd(c, d);
+  __m256d t3 = _mm256_unpackhi_pd(c, d);
+  _mm256_storeu_pd(p,      _mm256_permute2f128_pd(t0, t2, 0x20));
+  _mm256_storeu_pd(p + 4,  _mm256_permute2f128_pd(t1, t3, 0x20));
+  _mm256_storeu_pd(p + 8,  _mm256_permute2f128_pd(t0, t2, 0x31));
+  _mm256_storeu_pd(p + 12, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+// (cr,ci) = (ur,ui) * (xr,xi)
+inline void cmul(__m256d ur, __m256d ui, __m256d xr, __m256d xi, __m256d &cr, __m256d &ci) {
+  cr = _mm256_fmsub_pd(ur, xr, _mm256_mul_pd(ui, xi));
+  ci = _mm256_fmadd_pd(ur, xi, _mm256_mul_pd(ui, xr));
+}
+
+// (cr,ci) = conj(ur,ui) * (xr,xi)
+inline void cmulc(__m256d ur, __m256d ui, __m256d xr, __m256d xi, __m256d &cr, __m256d &ci) {
+  cr = _mm256_fmadd_pd(ur, xr, _mm256_mul_pd(ui, xi));
+  ci = _mm256_fmsub_pd(ur, xi, _mm256_mul_pd(ui, xr));
+}
+
+void wilsonRowAVX2(Complex *psi2, const Complex *psi1, const Complex *psi1p, const Complex *psi1m,
+		    const Complex *gauge, const Complex *gaugem, double m0, bool dag) {
+
+  const int W = 4;
+  const int ny = LY;
+  const __m256d k = _mm256_set1_pd(2.0 + m0);
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256d sg = _mm256_set1_pd(dag ? -1.0 : 1.0);
+
+  alignas(32) double buf[3][4*W];
+  const double *in  = (const double *)psi1;
+  const double *inp = (const double *)psi1p;
+  const double *inm = (const double *)psi1m;
+  const double *U   = (const double *)gauge;
+  const double *Um  = (const double *)gaugem;
+  double *out = (double *)psi2;
+  
+  for(int y0=0; y0<ny; y0+=W) {
+
+    __m256d s0r, s0i, s1r, s1i, u0r, u0i, u1r, u1i, t0r, t0i, t1r, t1i;
+    __m256d ar, ai, br, bi, cr, ci, dr, di;
+
+    //a = U_x(n) (psi(n+x)_0 - psi(n+x)_1)
+    loadSites(U + 4*y0, u0r, u0i, u1r, u1i);
+    loadSites(inp + 4*y0, s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    cmul(u0r, u0i, _mm256_sub_pd(s0r, s1r), _mm256_sub_pd(s0i, s1i), ar, ai);
+
+    //c = U_y(n) (psi(n+y)_0 + i psi(n+y)_1)
+    loadSites(siteBlock(in, y0, 1, W, ny, buf[0]), s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    cmul(u1r, u1i, _mm256_sub_pd(s0r, s1i), _mm256_add_pd(s0i, s1r), cr, ci);
+
+    //b = U_x(n-x)^* (psi(n-x)_0 + psi(n-x)_1)
+    loadSites(Um + 4*y0, u0r, u0i, t0r, t0i);
+    loadSites(inm + 4*y0, s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    cmulc(u0r, u0i, _mm256_add_pd(s0r, s1r), _mm256_add_pd(s0i, s1i), br, bi);
+
+    //d = U_y(n-y)^* (psi(n-y)_0 - i psi(n-y)_1)
+    loadSites(siteBlock(U, y0, -1, W, ny, buf[1]), t0r, t0i, u1r, u1i);
+    loadSites(siteBlock(in, y0, -1, W, ny, buf[2]), s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    cmulc(u1r, u1i, _mm256_add_pd(s0r, s1i), _mm256_sub_pd(s0i, s1r), dr, di);
+
+    //upper = k psi_0 - (a + b + c + d)/2
+    //lower = k psi_1 - (-a + b - i c + i d)/2
+    loadSites(in + 4*y0, s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    t0r = _mm256_add_pd(_mm256_add_pd(ar, br), _mm256_add_pd(cr, dr));
+    t0i = _mm256_add_pd(_mm256_add_pd(ai, bi), _mm256_add_pd(ci, di));
+    t1r = _mm256_add_pd(_mm256_sub_pd(br, ar), _mm256_sub_pd(ci, di));
+    t1i = _mm256_add_pd(_mm256_sub_pd(bi, ai), _mm256_sub_pd(dr, cr));
+
+    storeSites(out + 4*y0,
+	       _mm256_fnmadd_pd(half, t0r, _mm256_mul_pd(k, s0r)),
+	       _mm256_fnmadd_pd(half, t0i, _mm256_mul_pd(k, s0i)),
+	       _mm256_mul_pd(sg, _mm256_fnmadd_pd(half, t1r, _mm256_mul_pd(k, s1r))),
+	       _mm256_mul_pd(sg, _mm256_fnmadd_pd(half, t1i, _mm256_mul_pd(k, s1i))));
+  }
+}
+
+//Even-odd hopping row (see wilsonHopRow), 4 half field sites
+void wilsonHopRowAVX2(Complex *psi2, const Complex *psi1, const Complex *psi1p, const Complex *psi1m,
+		       const Complex *gauge, const Complex *gaugem, const Complex *gaugeq, int o, double s) {
+
+  const int W = 4;
+  const int nh = LY/2;
+  const __m256d sg = _mm256_set1_pd(s);
+
+  alignas(32) double buf[3][4*W];
+  const double *in  = (const double *)psi1;
+  const double *inp = (const double *)psi1p;
+  const double *inm = (const double *)psi1m;
+  const double *U   = (const double *)gauge;
+  const double *Um  = (const double *)gaugem;
+  const double *Uq  = (const double *)gaugeq;
+  double *out = (double *)psi2;
+  
+  for(int j0=0; j0<nh; j0+=W) {
+
+    __m256d s0r, s0i, s1r, s1i, u0r, u0i, u1r, u1i, t0r, t0i, t1r, t1i;
+    __m256d ar, ai, br, bi, cr, ci, dr, di;
+
+    loadSites(U + 4*j0, u0r, u0i, u1r, u1i);
+    loadSites(inp + 4*j0, s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    cmul(u0r, u0i, _mm256_sub_pd(s0r, s1r), _mm256_sub_pd(s0i, s1i), ar, ai);
+
+    loadSites(siteBlock(in, j0, o, W, nh, buf[0]), s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    cmul(u1r, u1i, _mm256_sub_pd(s0r, s1i), _mm256_add_pd(s0i, s1r), cr, ci);
+
+    loadSites(Um + 4*j0, u0r, u0i, t0r, t0i);
+    loadSites(inm + 4*j0, s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    cmulc(u0r, u0i, _mm256_add_pd(s0r, s1r), _mm256_add_pd(s0i, s1i), br, bi);
+
+    loadSites(siteBlock(Uq, j0, o-1, W, nh, buf[1]), t0r, t0i, u1r, u1i);
+    loadSites(siteBlock(in, j0, o-1, W, nh, buf[2]), s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_pd(sg, s1r); s1i = _mm256_mul_pd(sg, s1i);
+    cmulc(u1r, u1i, _mm256_add_pd(s0r, s1i), _mm256_sub_pd(s0i, s1r), dr, di);
+
+    //upper = a + b + c + d, lower = -a + b - i c + i d
+    t0r = _mm256_add_pd(_mm256_add_pd(ar, br), _mm256_add_pd(cr, dr));
+    t0i = _mm256_add_pd(_mm256_add_pd(ai, bi), _mm256_add_pd(ci, di));
+    t1r = _mm256_add_pd(_mm256_sub_pd(br, ar), _mm256_sub_pd(ci, di));
+    t1i = _mm256_add_pd(_mm256_sub_pd(bi, ai), _mm256_sub_pd(dr, cr));
+
+    storeSites(out + 4*j0, t0r, t0i, _mm256_mul_pd(sg, t1r), _mm256_mul_pd(sg, t1i));
+  }
+}
+
+//AVX2, 8 single precision sites
+inline void loadSites(const float *p, __m256 &a, __m256 &b, __m256 &c, __m256 &d) {
+
+  __m256 r0 = _mm256_loadu_ps(p);
+  __m256 r1 = _mm256_loadu_ps(p + 8);
+  __m256 r2 = _mm256_loadu_ps(p + 16);
+  __m256 r3 = _mm256_loadu_ps(p + 24);
+  __m256 t0 = _mm256_shuffle_ps(r0, r1, 0x44);
+  __m256 t1 = _mm256_shuffle_ps(r0, r1, 0xEE);
+  __m256 t2 = _mm256_shuffle_ps(r2, r3, 0x44);
+  __m256 t3 = _mm256_shuffle_ps(r2, r3, 0xEE);
+  a = _mm256_shuffle_ps(t0, t2, 0x88);
+  b = _mm256_shuffle_ps(t0, t2, 0xDD);
+  c = _mm256_shuffle_ps(t1, t3, 0x88);
+  d = _mm256_shuffle_ps(t1, t3, 0xDD);
+}
+
+//The in-lane transpose is its own inverse
+inline void storeSites(float *p, __m256 a, __m256 b, __m256 c, __m256 d) {
+
+  __m256 r0, r1, r2, r3;
+  __m256 t0 = _mm256_shuffle_ps(a, b, 0x44);
+  __m256 t1 = _mm256_shuffle_ps(a, b, 0xEE);
+  __m256 t2 = _mm256_shuffle_ps(c, d, 0x44);
+  __m256 t3 = _mm256_shuffle_ps(c, d, 0xEE);
+  r0 = _mm256_shuffle_ps(t0, t2, 0x88);
+  r1 = _mm256_shuffle_ps(t0, t2, 0xDD);
+  r2 = _mm256_shuffle_ps(t1, t3, 0x88);
+  r3 = _mm256_shuffle_ps(t1, t3, 0xDD);
+  _mm256_storeu_ps(p,      r0);
+  _mm256_storeu_ps(p + 8,  r1);
+  _mm256_storeu_ps(p + 16, r2);
+  _mm256_storeu_ps(p + 24, r3);
+}
+
+inline void cmul(__m256 ur, __m256 ui, __m256 xr, __m256 xi, __m256 &cr, __m256 &ci) {
+  cr = _mm256_fmsub_ps(ur, xr, _mm256_mul_ps(ui, xi));
+  ci = _mm256_fmadd_ps(ur, xi, _mm256_mul_ps(ui, xr));
+}
+
+inline void cmulc(__m256 ur, __m256 ui, __m256 xr, __m256 xi, __m256 &cr, __m256 &ci) {
+  cr = _mm256_fmadd_ps(ur, xr, _mm256_mul_ps(ui, xi));
+  ci = _mm256_fmsub_ps(ur, xi, _mm256_mul_ps(ui, xr));
+}
+
+//Even-odd hopping row in single precision, 8 half field sites
+void wilsonHopRowAVX2(complex<float> *psi2, const complex<float> *psi1, const complex<float> *psi1p,
+		       const complex<float> *psi1m, const complex<float> *gauge, const complex<float> *gaugem,
+		       const complex<float> *gaugeq, int o, double s) {
+
+  const int W = 8;
+  const int nh = LY/2;
+  const __m256 sg = _mm256_set1_ps(s);
+
+  alignas(32) float buf[3][4*W];
+  const float *in  = (const float *)psi1;
+  const float *inp = (const float *)psi1p;
+  const float *inm = (const float *)psi1m;
+  const float *U   = (const float *)gauge;
+  const float *Um  = (const float *)gaugem;
+  const float *Uq  = (const float *)gaugeq;
+  float *out = (float *)psi2;
+  
+  for(int j0=0; j0<nh; j0+=W) {
+
+    __m256 s0r, s0i, s1r, s1i, u0r, u0i, u1r, u1i, t0r, t0i, t1r, t1i;
+    __m256 ar, ai, br, bi, cr, ci, dr, di;
+
+    loadSites(U + 4*j0, u0r, u0i, u1r, u1i);
+    loadSites(inp + 4*j0, s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_ps(sg, s1r); s1i = _mm256_mul_ps(sg, s1i);
+    cmul(u0r, u0i, _mm256_sub_ps(s0r, s1r), _mm256_sub_ps(s0i, s1i), ar, ai);
+
+    loadSites(siteBlock(in, j0, o, W, nh, buf[0]), s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_ps(sg, s1r); s1i = _mm256_mul_ps(sg, s1i);
+    cmul(u1r, u1i, _mm256_sub_ps(s0r, s1i), _mm256_add_ps(s0i, s1r), cr, ci);
+
+    loadSites(Um + 4*j0, u0r, u0i, t0r, t0i);
+    loadSites(inm + 4*j0, s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_ps(sg, s1r); s1i = _mm256_mul_ps(sg, s1i);
+    cmulc(u0r, u0i, _mm256_add_ps(s0r, s1r), _mm256_add_ps(s0i, s1i), br, bi);
+
+    loadSites(siteBlock(Uq, j0, o-1, W, nh, buf[1]), t0r, t0i, u1r, u1i);
+    loadSites(siteBlock(in, j0, o-1, W, nh, buf[2]), s0r, s0i, s1r, s1i);
+    s1r = _mm256_mul_ps(sg, s1r); s1i = _mm256_mul_ps(sg, s1i);
+    cmulc(u1r, u1i, _mm256_add_ps(s0r, s1i), _mm256_sub_ps(s0i, s1r), dr, di);
+
+    //upper = a + b + c + d, lower = -a + b - i c + i d
+    t0r = _mm256_add_ps(_mm256_add_ps(ar, br), _mm256_add_ps(cr, dr));
+    t0i = _mm256_add_ps(_mm256_add_ps(ai, bi), _mm256_add_ps(ci, di));
+    t1r = _mm256_add_ps(_mm256_sub_ps(br, ar), _mm256_sub_ps(ci, di));
+    t1i = _mm256_add_ps(_mm256_sub_ps(bi, ai), _mm256_sub_ps(dr, cr));
+
+    storeSites(out + 4*j0, t0r, t0i, _mm256_mul_ps(sg, t1r), _mm256_mul_ps(sg, t1i));
+  }
+}
+
+//Block stencil (see wilsonRowBlockBody), 2 fields per vector. The
+//fields are complex interleaved, so the products use fmaddsub on the
+//real/imaginary swapped operand. An odd last field is left to the
+//scalar stencil.
+inline __m256d swapRI(__m256d z) { return _mm256_shuffle_pd(z, z, 0x5); }
+
+void wilsonRowBlockAVX2(Complex *psi2, const Complex *psi1, const Complex *psi1p, const Complex *psi1m,
+			 const Complex *gauge, const Complex *gaugem, double m0, bool dag, int N) {
+
+  const int W = 2;
+  const int NW = N - N%W;
+  const long ns = 4L*N;
+  const __m256d k = _mm256_set1_pd(2.0 + m0);
+  const __m256d half = _mm256_set1_pd(dag ? -0.5 : 0.5);
+  const __m256d sg = _mm256_set1_pd(dag ? -1.0 : 1.0);
+  const __m256d isg = _mm256_set_pd(1.0, -1.0, 1.0, -1.0); //i*z = isg*swapRI(z)
+  
+  for(int y=0; y<LY; y++) {
+    int yp1 = nbr.yp[y];
+    int ym1 = nbr.ym[y];
+
+    const __m256d u0r = _mm256_set1_pd(real(gauge[2*y])),     u0i = _mm256_set1_pd(imag(gauge[2*y]));
+    const __m256d u1r = _mm256_set1_pd(real(gauge[2*y+1])),   u1i = _mm256_set1_pd(imag(gauge[2*y+1]));
+    const __m256d uxr = _mm256_set1_pd(real(gaugem[2*y])),    uxi = _mm256_set1_pd(imag(gaugem[2*y]));
+    const __m256d uyr = _mm256_set1_pd(real(gauge[2*ym1+1])), uyi = _mm256_set1_pd(imag(gauge[2*ym1+1]));
+
+    const double *n  = (const double *)psi1  + ns*y;
+    const double *xp = (const double *)psi1p + ns*y;
+    const double *xm = (const double *)psi1m + ns*y;
+    const double *yp = (const double *)psi1  + ns*yp1;
+    const double *ym = (const double *)psi1  + ns*ym1;
+    double *out = (double *)psi2 + ns*y;
+    
+    for(int j=0; j<2*NW; j+=2*W) {
+      const int l = 2*N + j;
+      __m256d z, a, b, c, d;
+
+      //a = U_x(n) (psi(n+x)_0 - s psi(n+x)_1)
+      z = _mm256_fnmadd_pd(sg, _mm256_loadu_pd(xp + l), _mm256_loadu_pd(xp + j));
+      a = _mm256_fmaddsub_pd(u0r, z, _mm256_mul_pd(u0i, swapRI(z)));
+
+      //b = U_x(n-x)^* (psi(n-x)_0 + s psi(n-x)_1)
+      z = _mm256_fmadd_pd(sg, _mm256_loadu_pd(xm + l), _mm256_loadu_pd(xm + j));
+      b = _mm256_fmsubadd_pd(uxr, z, _mm256_mul_pd(uxi, swapRI(z)));
+
+      //c = U_y(n) (psi(n+y)_0 + i s psi(n+y)_1)
+      z = _mm256_fmadd_pd(_mm256_mul_pd(sg, isg), swapRI(_mm256_loadu_pd(yp + l)), _mm256_loadu_pd(yp + j));
+      c = _mm256_fmaddsub_pd(u1r, z, _mm256_mul_pd(u1i, swapRI(z)));
+
+      //d = U_y(n-y)^* (psi(n-y)_0 - i s psi(n-y)_1)
+      z = _mm256_fnmadd_pd(_mm256_mul_pd(sg, isg), swapRI(_mm256_loadu_pd(ym + l)), _mm256_loadu_pd(ym + j));
+      d = _mm256_fmsubadd_pd(uyr, z, _mm256_mul_pd(uyi, swapRI(z)));
+
+      //upper = k psi_0 - (a + b + c + d)/2
+      //lower = k psi_1 - s(b - a + i(d - c))/2
+      z = _mm256_add_pd(_mm256_add_pd(a, b), _mm256_add_pd(c, d));
+      _mm256_storeu_pd(out + j, _mm256_fnmadd_pd(_mm256_set1_pd(0.5), z, _mm256_mul_pd(k, _mm256_loadu_pd(n + j))));
+      z = _mm256_fmadd_pd(isg, swapRI(_mm256_sub_pd(d, c)), _mm256_sub_pd(b, a));
+      _mm256_storeu_pd(out + l, _mm256_fnmadd_pd(half, z, _mm256_mul_pd(k, _mm256_loadu_pd(n + l))));
+    }
+  }
+  
+  if(NW < N) wilsonRowBlockBody(psi2, psi1, psi1p, psi1m, gauge, gaugem, m0, dag, N, NW);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+
+//AVX-512, 8 sites
+inline void loadSites(const double *p, __m512d &a, __m512d &b, __m512d &c, __m512d &d) {
+
+  const __m512i lo = _mm512_set_epi64(13, 9, 5, 1, 12, 8, 4, 0);
+  const __m512i hi = _mm512_set_epi64(15, 11, 7, 3, 14, 10, 6, 2);
+  const __m512i f0 = _mm512_set_epi64(11, 10, 9, 8, 3, 2, 1, 0);
+  const __m512i f1 = _mm512_set_epi64(15, 14, 13, 12, 7, 6, 5, 4);
+
+  __m512d z0 = _mm512_loadu_pd(p);
+  __m512d z1 = _mm512_loadu_pd(p + 8);
+  __m512d z2 = _mm512_loadu_pd(p + 16);
+  __m512d z3 = _mm512_loadu_pd(p + 24);
+  //[a0..a3 b0..b3], [a4..a7 b4..b7], [c0..c3 d0..d3], [c4..c7 d4..d7]
+  __m512d u0 = _mm512_permutex2var_pd(z0, lo, z1);
+  __m512d u1 = _mm512_permutex2var_pd(z2, lo, z3);
+  __m512d v0 = _mm512_permutex2var_pd(z0, hi, z1);
+  __m512d v1 = _mm512_permutex2var_pd(z2, hi, z3);
+  a = _mm512_permutex2var_pd(u0, f0, u1);
+  b = _mm512_permutex2var_pd(u0, f1, u1);
+  c = _mm512_permutex2var_pd(v0, f0, v1);
+  d = _mm512_permutex2var_pd(v0, f1, v1);
+}
+
+inline void storeSites(double *p, __m512d a, __m512d b, __m512d c, __m512d d) {
+
+  const __m512i lo = _mm512_set_epi64(13, 9, 5, 1, 12, 8, 4, 0);
+  const __m512i hi = _mm512_set_epi64(15, 11, 7, 3, 14, 10, 6, 2);
+  const __m512i f0 = _mm512_set_epi64(11, 10, 9, 8, 3, 2, 1, 0);
+  const __m512i f1 = _mm512_set_epi64(15, 14, 13, 12, 7, 6, 5, 4);
+
+  __m512d u0 = _mm512_permutex2var_pd(a, f0, b);
+  __m512d u1 = _mm512_permutex2var_pd(a, f1, b);
+  __m512d v0 = _mm512_permutex2var_pd(c, f0, d);
+  __m512d v1 = _mm512_permutex2var_pd(c, f1, d);
+  _mm512_storeu_pd(p,      _mm512_permutex2var_pd(u0, lo, v0));
+  _mm512_storeu_pd(p + 8,  _mm512_permutex2var_pd(u0, hi, v0));
+  _mm512_storeu_pd(p + 16, _mm512_permutex2var_pd(u1, lo, v1));
+  _mm512_storeu_pd(p + 24, _mm512_permutex2var_pd(u1, hi, v1));
+}
+
+inline void cmul(__m512d ur, __m512d ui, __m512d xr, __m512d xi, __m512d &cr, __m512d &ci) {
+  cr = _mm512_fmsub_pd(ur, xr, _mm512_mul_pd(ui, xi));
+  ci = _mm512_fmadd_pd(ur, xi, _mm512_mul_pd(ui, xr));
+}
+
+inline void cmulc(__m512d ur, __m512d ui, __m512d xr, __m512d xi, __m512d &cr, __m512d &ci) {
+  cr = _mm512_fmadd_pd(ur, xr, _mm512_mul_pd(ui, xi));
+  ci = _mm512_fmsub_pd(ur, xi, _mm512_mul_pd(ui, xr));
+}
+
+void wilsonRowAVX512(Complex *psi2, const Complex *psi1, const Complex *psi1p, const Complex *psi1m,
+		    const Complex *gauge, const Complex *gaugem, double m0, bool dag) {
+
+  const int W = 8;
+  const int ny = LY;
+  const __m512d k = _mm512_set1_pd(2.0 + m0);
+  const __m512d half = _mm512_set1_pd(0.5);
+  const __m512d sg = _mm512_set1_pd(dag ? -1.0 : 1.0);
+
+  alignas(64) double buf[3][4*W];
+  const double *in  = (const double *)psi1;
+  const double *inp = (const double *)psi1p;
+  const double *inm = (const double *)psi1m;
+  const double *U   = (const double *)gauge;
+  const double *Um  = (const double *)gaugem;
+  double *out = (double *)psi2;
+  
+  for(int y0=0; y0<ny; y0+=W) {
+
+    __m512d s0r, s0i, s1r, s1i, u0r, u0i, u1r, u1i, t0r, t0i, t1r, t1i;
+    __m512d ar, ai, br, bi, cr, ci, dr, di;
+
+    loadSites(U + 4*y0, u0r, u0i, u1r, u1i);
+    loadSites(inp + 4*y0, s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    cmul(u0r, u0i, _mm512_sub_pd(s0r, s1r), _mm512_sub_pd(s0i, s1i), ar, ai);
+
+    loadSites(siteBlock(in, y0, 1, W, ny, buf[0]), s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    cmul(u1r, u1i, _mm512_sub_pd(s0r, s1i), _mm512_add_pd(s0i, s1r), cr, ci);
+
+    loadSites(Um + 4*y0, u0r, u0i, t0r, t0i);
+    loadSites(inm + 4*y0, s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    cmulc(u0r, u0i, _mm512_add_pd(s0r, s1r), _mm512_add_pd(s0i, s1i), br, bi);
+
+    loadSites(siteBlock(U, y0, -1, W, ny, buf[1]), t0r, t0i, u1r, u1i);
+    loadSites(siteBlock(in, y0, -1, W, ny, buf[2]), s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    cmulc(u1r, u1i, _mm512_add_pd(s0r, s1i), _mm512_sub_pd(s0i, s1r), dr, di);
+
+    loadSites(in + 4*y0, s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    t0r = _mm512_add_pd(_mm512_add_pd(ar, br), _mm512_add_pd(cr, dr));
+    t0i = _mm512_add_pd(_mm512_add_pd(ai, bi), _mm512_add_pd(ci, di));
+    t1r = _mm512_add_pd(_mm512_sub_pd(br, ar), _mm512_sub_pd(ci, di));
+    t1i = _mm512_add_pd(_mm512_sub_pd(bi, ai), _mm512_sub_pd(dr, cr));
+
+    storeSites(out + 4*y0,
+	       _mm512_fnmadd_pd(half, t0r, _mm512_mul_pd(k, s0r)),
+	       _mm512_fnmadd_pd(half, t0i, _mm512_mul_pd(k, s0i)),
+	       _mm512_mul_pd(sg, _mm512_fnmadd_pd(half, t1r, _mm512_mul_pd(k, s1r))),
+	       _mm512_mul_pd(sg, _mm512_fnmadd_pd(half, t1i, _mm512_mul_pd(k, s1i))));
+  }
+}
+
+//Even-odd hopping row (see wilsonHopRow), 8 half field sites
+void wilsonHopRowAVX512(Complex *psi2, const Complex *psi1, const Complex *psi1p, const Complex *psi1m,
+		       const Complex *gauge, const Complex *gaugem, const Complex *gaugeq, int o, double s) {
+
+  const int W = 8;
+  const int nh = LY/2;
+  const __m512d sg = _mm512_set1_pd(s);
+
+  alignas(64) double buf[3][4*W];
+  const double *in  = (const double *)psi1;
+  const double *inp = (const double *)psi1p;
+  const double *inm = (const double *)psi1m;
+  const double *U   = (const double *)gauge;
+  const double *Um  = (const double *)gaugem;
+  const double *Uq  = (const double *)gaugeq;
+  double *out = (double *)psi2;
+  
+  for(int j0=0; j0<nh; j0+=W) {
+
+    __m512d s0r, s0i, s1r, s1i, u0r, u0i, u1r, u1i, t0r, t0i, t1r, t1i;
+    __m512d ar, ai, br, bi, cr, ci, dr, di;
+
+    loadSites(U + 4*j0, u0r, u0i, u1r, u1i);
+    loadSites(inp + 4*j0, s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    cmul(u0r, u0i, _mm512_sub_pd(s0r, s1r), _mm512_sub_pd(s0i, s1i), ar, ai);
+
+    loadSites(siteBlock(in, j0, o, W, nh, buf[0]), s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    cmul(u1r, u1i, _mm512_sub_pd(s0r, s1i), _mm512_add_pd(s0i, s1r), cr, ci);
+
+    loadSites(Um + 4*j0, u0r, u0i, t0r, t0i);
+    loadSites(inm + 4*j0, s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    cmulc(u0r, u0i, _mm512_add_pd(s0r, s1r), _mm512_add_pd(s0i, s1i), br, bi);
+
+    loadSites(siteBlock(Uq, j0, o-1, W, nh, buf[1]), t0r, t0i, u1r, u1i);
+    loadSites(siteBlock(in, j0, o-1, W, nh, buf[2]), s0r, s0i, s1r, s1i);
+    s1r = _mm512_mul_pd(sg, s1r); s1i = _mm512_mul_pd(sg, s1i);
+    cmulc(u1r, u1i, _mm512_add_pd(s0r, s1i), _mm512_sub_pd(s0i, s1r), dr, di);
+
+    //upper = a + b + c + d, lower = -a + b - i c + i d
+    t0r = _mm512_add_pd(_mm512_add_pd(ar, br), _mm512_add_pd(cr, dr));
+    t0i = _mm512_add_pd(_mm512_add_pd(ai, bi), _mm512_add_pd(ci, di));
+    t1r = _mm512_add_pd(_mm512_sub_pd(br, ar), _mm512_sub_pd(ci, di));
+    t1i = _mm512_add_pd(_mm512_sub_pd(bi, ai), _mm512_sub_pd(dr, cr));
+
+    storeSites(out + 4*j0, t0r, t0i, _mm512_mul_pd(sg, t1r), _mm512_mul_pd(sg, t1i));
+  }
+}
+
+//Block stencil (see wilsonRowBlockBody), 4 fields per vector and the
+//last vector masked.
+inline __m512d swapRI(__m512d z) { return _mm512_shuffle_pd(z, z, 0x55); }
+
+void wilsonRowBlockAVX512(Complex *psi2, const Complex *psi1, const Complex *psi1p, const Complex *psi1m,
+			 const Complex *gauge, const Complex *gaugem, double m0, bool dag, int N) {
+
+  const int W = 4;
+  const long ns = 4L*N;
+  const __m512d k = _mm512_set1_pd(2.0 + m0);
+  const __m512d half = _mm512_set1_pd(dag ? -0.5 : 0.5);
+  const __m512d sg = _mm512_set1_pd(dag ? -1.0 : 1.0);
+  const __m512d isg = _mm512_set_pd(1.0, -1.0, 1.0, -1.0, 1.0, -1.0, 1.0, -1.0); //i*z = isg*swapRI(z)
+  
+  for(int y=0; y<LY; y++) {
+    int yp1 = nbr.yp[y];
+    int ym1 = nbr.ym[y];
+
+    const __m512d u0r = _mm512_set1_pd(real(gauge[2*y])),     u0i = _mm512_set1_pd(imag(gauge[2*y]));
+    const __m512d u1r = _mm512_set1_pd(real(gauge[2*y+1])),   u1i = _mm512_set1_pd(imag(gauge[2*y+1]));
+    const __m512d uxr = _mm512_set1_pd(real(gaugem[2*y])),    uxi = _mm512_set1_pd(imag(gaugem[2*y]));
+    const __m512d uyr = _mm512_set1_pd(real(gauge[2*ym1+1])), uyi = _mm512_set1_pd(imag(gauge[2*ym1+1]));
+
+    const double *n  = (const double *)psi1  + ns*y;
+    const double *xp = (const double *)psi1p + ns*y;
+    const double *xm = (const double *)psi1m + ns*y;
+    const double *yp = (const double *)psi1  + ns*yp1;
+    const double *ym = (const double *)psi1  + ns*ym1;
+    double *out = (double *)psi2 + ns*y;
+    
+    for(int j=0; j<2*N; j+=2*W) {
+      const int l = 2*N + j;
+      const __mmask8 m = (2*N - j >= 2*W) ? 0xff : (1 << (2*N - j)) - 1;
+      __m512d z, a, b, c, d;
+
+      //a = U_x(n) (psi(n+x)_0 - s psi(n+x)_1)
+      z = _mm512_fnmadd_pd(sg, _mm512_maskz_loadu_pd(m, xp + l), _mm512_maskz_loadu_pd(m, xp + j));
+      a = _mm512_fmaddsub_pd(u0r, z, _mm512_mul_pd(u0i, swapRI(z)));
+
+      //b = U_x(n-x)^* (psi(n-x)_0 + s psi(n-x)_1)
+      z = _mm512_fmadd_pd(sg, _mm512_maskz_loadu_pd(m, xm + l), _mm512_maskz_loadu_pd(m, xm + j));
+      b = _mm512_fmsubadd_pd(uxr, z, _mm512_mul_pd(uxi, swapRI(z)));
+
+      //c = U_y(n) (psi(n+y)_0 + i s psi(n+y)_1)
+      z = _mm512_fmadd_pd(_mm512_mul_pd(sg, isg), swapRI(_mm512_maskz_loadu_pd(m, yp + l)), _mm512_maskz_loadu_pd(m, yp + j));
+      c = _mm512_fmaddsub_pd(u1r, z, _mm512_mul_pd(u1i, swapRI(z)));
+
+      //d = U_y(n-y)^* (psi(n-y)_0 - i s psi(n-y)_1)
+      z = _mm512_fnmadd_pd(_mm512_mul_pd(sg, isg), swapRI(_mm512_maskz_loadu_pd(m, ym + l)), _mm512_maskz_loadu_pd(m, ym + j));
+      d = _mm512_fmsubadd_pd(uyr, z, _mm512_mul_pd(uyi, swapRI(z)));
+
+      //upper = k psi_0 - (a + b + c + d)/2
+      //lower = k psi_1 - s(b - a + i(d - c))/2
+      z = _mm512_add_pd(_mm512_add_pd(a, b), _mm512_add_pd(c, d));
+      _mm512_mask_storeu_pd(out + j, m, _mm512_fnmadd_pd(_mm512_set1_pd(0.5), z, _mm512_mul_pd(k, _mm512_maskz_loadu_pd(m, n + j))));
+      z = _mm512_fmadd_pd(isg, swapRI(_mm512_sub_pd(d, c)), _mm512_sub_pd(b, a));
+      _mm512_mask_storeu_pd(out + l, m, _mm512_fnmadd_pd(half, z, _mm512_mul_pd(k, _mm512_maskz_loadu_pd(m, n + l))));
+    }
+  }
+}
+
+#pragma GCC pop_options
+
+#endif
+
+#endif
@@ -7,283 +7,414 @@
 #include <string.h>
 #include <cmath>
 #include <complex>
+#include <omp.h>
+#include "latField.h"
 
 using namespace std;
 
-//Wilson Fermion Utilities
+//Fermion Utilities
 //---------------------------------------------------------------------------------
-// Zero fermion field
-template<typename T> inline void zeroField(T psi) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	psi[x][y][s] = 0.0;
+// The linear algebra runs over the flat field, so the same routines serve
+// Wilson (nd = 2) and staggered (nd = 1) fermions, in double or single
+// precision. Real coefficients are applied in the precision of the field.
+
+template<typename T> struct realOf { typedef T type; };
+template<typename T> struct realOf<complex<T>> { typedef T type; };
+
+// a*x without the C99 inf/nan recovery of complex operator*, whose
+// library call keeps the field loops from vectorising
+template<typename T> inline complex<T> ctimes(const complex<T> a, const complex<T> x) {
+  return complex<T>(a.real()*x.real() - a.imag()*x.imag(), a.real()*x.imag() + a.imag()*x.real());
 }
 
-// Zero fermion field
-template<typename T> inline void zeroField(T psi[LX][LY][2]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	psi[x][y][s] = 0.0;
+// conj(a)*x
+template<typename T> inline complex<T> cdagtimes(const complex<T> a, const complex<T> x) {
+  return complex<T>(a.real()*x.real() + a.imag()*x.imag(), a.real()*x.imag() - a.imag()*x.real());
 }
 
-// Copy fermion field
-template<typename T> inline void copyField(T*** psi2, T*** psi1) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	psi2[x][y][s] = psi1[x][y][s];
+// Zero fermion field
+template<typename T> inline void zeroField(latField<T> &psi) {
+#pragma omp parallel for
+  for(long i=0; i<psi.len; i++) psi.v[i] = 0.0;
 }
 
 // Copy fermion field
-template<typename T> inline void copyField(T psi2[LX][LY][2], const T psi1[LX][LY][2]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	psi2[x][y][s] = psi1[x][y][s];
+template<typename T> inline void copyField(latField<T> &psi2, const latField<T> &psi1) {
+#pragma omp parallel for
+  for(long i=0; i<psi2.len; i++) psi2.v[i] = psi1.v[i];
 }
 
-// Inner product
-template<typename T> inline T dotField(const T psi1[LX][LY][2], const T psi2[LX][LY][2]) {
-  T scalar = (T) 0.0;
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	scalar += conj(psi1[x][y][s])*psi2[x][y][s];
-  return scalar;
+// Copy between precisions
+template<typename T, typename U> inline void convertField(latField<T> &psi2, const latField<U> &psi1) {
+#pragma omp parallel for
+  for(long i=0; i<psi2.len; i++) psi2.v[i] = T(psi1.v[i]);
 }
 
 // Inner product
-template<typename T> inline T dotField(T*** psi1, T*** psi2) {
-  double scalar = (double) 0.0;
-  int nr_elems = LX*LY*2;
-
-  #pragma omp parallel for reduction(+:scalar)
-  for(int i=0; i < nr_elems; i++){
-
-    int x = i / (LY*2);
-    int y = (i % (LY*2)) / 2;
-    int s = i % 2;
-
-    scalar += real(conj(psi1[x][y][s])*psi2[x][y][s]);
+template<typename T> inline T dotField(const latField<T> &psi1, const latField<T> &psi2) {
+  double re = 0.0, im = 0.0;
+#pragma omp parallel for reduction(+:re,im)
+  for(long i=0; i<psi1.len; i++) {
+    T prod = cdagtimes(psi1.v[i], psi2.v[i]);
+    re += prod.real();
+    im += prod.imag();
   }
-  return scalar;
+  return T(re, im);
 }
 
 // Norm squared 
-template<typename T> inline double norm2(const T psi[LX][LY][2]) {  
+template<typename T> inline double norm2(const latField<T> &psi) {
   double norm2 = 0.0;
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	norm2 += (psi[x][y][s].real() * psi[x][y][s].real() + psi[x][y][s].imag() * psi[x][y][s].imag());
-  
+#pragma omp parallel for reduction(+:norm2)
+  for(long i=0; i<psi.len; i++)
+    norm2 += (psi.v[i].real() * psi.v[i].real() + psi.v[i].imag() * psi.v[i].imag());
   return norm2;
 }
 
-// Norm squared 
-template<typename T> inline double norm2(T psi) {
-  double norm2 = 0.0;
-  int nr_elems = LX*LY*2;
+template<typename T> inline void caxpby(const T a, const latField<T> &X,
+					const T b, const latField<T> &Y,
+					latField<T> &result){
+#pragma omp parallel for
+  for(long i=0; i<X.len; i++) result.v[i] = ctimes(a, X.v[i]) + ctimes(b, Y.v[i]);
+}
 
-  #pragma omp parallel for reduction(+:norm2)
-  for(int i=0; i < nr_elems; i++){
+template<typename T> inline void axpby(const double a, const latField<T> &X,
+				       const double b, const latField<T> &Y,
+				       latField<T> &result){
+  const typename realOf<T>::type ar = a, br = b;
+#pragma omp parallel for
+  for(long i=0; i<X.len; i++) result.v[i] = ar*X.v[i] + br*Y.v[i];
+}
 
-    int x = i / (LY*2);
-    int y = (i % (LY*2)) / 2;
-    int s = i % 2;
+//caxpy in place 
+template<typename T> inline void caxpy(const T a, const latField<T> &X, latField<T> &Y){
+#pragma omp parallel for
+  for(long i=0; i<X.len; i++) Y.v[i] += ctimes(a, X.v[i]);
+}
 
-    norm2 += real((psi[x][y][s].real() * psi[x][y][s].real() + psi[x][y][s].imag() * psi[x][y][s].imag()));
-  }
-  return norm2;
+//axpy in place 
+template<typename T> inline void axpy(const double a, const latField<T> &X, latField<T> &Y){
+  const typename realOf<T>::type ar = a;
+#pragma omp parallel for
+  for(long i=0; i<X.len; i++) Y.v[i] += ar*X.v[i];
 }
 
-template<typename T> inline void caxpby(const T a, const T X[LX][LY][2],
-					const T b, const T Y[LX][LY][2],
-					T result[LX][LY][2]){  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	result[x][y][s] = a*X[x][y][s] + b*Y[x][y][s];
+//axpy in result
+template<typename T> inline void axpy(const double a, const latField<T> &X,
+				      const latField<T> &Y, latField<T> &result){  
+  const typename realOf<T>::type ar = a;
+#pragma omp parallel for
+  for(long i=0; i<X.len; i++) result.v[i] = ar*X.v[i] + Y.v[i];
 }
 
-template<typename T> inline void axpby(const double a, const T X[LX][LY][2],
-				       const double b, const T Y[LX][LY][2],
-				       T result[LX][LY][2]){
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	result[x][y][s] = a*X[x][y][s] + b*Y[x][y][s];
+template<typename T> inline void xpaypbz(const latField<T> &X,
+					 const double a, const latField<T> &Y,
+					 const double b, latField<T> &Z) {
+  const typename realOf<T>::type ar = a, br = b;
+#pragma omp parallel for
+  for(long i=0; i<X.len; i++) Z.v[i] = br*Z.v[i] + X.v[i] + ar*Y.v[i];
 }
 
-//caxpy in place 
-template<typename T> inline void caxpy(const T a, const T X[LX][LY][2], T Y[LX][LY][2]){
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	Y[x][y][s] += a*X[x][y][s];
+template<typename T> inline void ax(const double a, latField<T> &X){ 
+  const typename realOf<T>::type ar = a;
+#pragma omp parallel for
+  for(long i=0; i<X.len; i++) X.v[i] *= ar;
 }
 
-//caxpy in result
-template<typename T> inline void caxpy(const T a, const T X[LX][LY][2], 
-				       const T Y[LX][LY][2],
-				       T result[LX][LY][2]){  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	result[x][y][s] = a*X[x][y][s] + Y[x][y][s];
+template<typename T> inline void printVector(const latField<T> &X){
+  for(int x=0; x<X.nx; x++)
+    for(int y=0; y<X.ny; y++) {
+      cout << "(" << x << "," << y << ") =";
+      for(int s=0; s<X.nd; s++) cout << " " << X(x,y,s);
+      cout << endl;
+    }
 }
 
-//axpy in place 
-template<typename T> inline void axpy(const double a, const T X[LX][LY][2], T Y[LX][LY][2]){
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	Y[x][y][s] = a*X[x][y][s] + Y[x][y][s];
+//Blocks of fields
+//---------------------------------------------------------------------------------
+// A block of N fields with nd components each is one field with nd*N
+// components, component major and the field index innermost (see
+// wilsonRowBlockBody). insertBlock/extractBlock copy field k in and out,
+// converting the precision as convertField does.
+
+template<typename T, typename U> inline void insertBlock(latField<T> &block, const latField<U> &f, int k) {
+  const int N = block.nd/f.nd;
+#pragma omp parallel for
+  for(long i=0; i<f.vol; i++)
+    for(int s=0; s<f.nd; s++) block.v[i*block.nd + s*N + k] = T(f.v[i*f.nd + s]);
 }
 
-//axpy in place 
-template<typename T> inline void axpy(const double a, T*** X, T*** Y){
-  #pragma omp parallel for
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	Y[x][y][s] = a*X[x][y][s] + Y[x][y][s];
+template<typename T, typename U> inline void extractBlock(latField<T> &f, const latField<U> &block, int k) {
+  const int N = block.nd/f.nd;
+#pragma omp parallel for
+  for(long i=0; i<f.vol; i++)
+    for(int s=0; s<f.nd; s++) f.v[i*f.nd + s] = T(block.v[i*block.nd + s*N + k]);
 }
 
-//axpy in result
-template<typename T> inline void axpy(const double a, const T X[LX][LY][2], 
-				      const T Y[LX][LY][2],
-				      T result[LX][LY][2]){  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	result[x][y][s] = a*X[x][y][s] + Y[x][y][s];
+// The block solvers combine the N fields of a block with small N x N
+// matrices (row major, M[k*N + l], see linAlgHelpers.h). Every N
+// consecutive elements of a block hold one component of all N fields.
+//
+// These sums cost N^2 per component against N for the Dirac operator, so
+// they are written out in real arithmetic, compiled for the usual block
+// sizes (n = 0 is the generic version, N <= 64), and, like the Dirac kernels,
+// built for AVX2 and AVX-512 with target pragmas and picked at run time.
+// The range bodies carry no OpenMP of their own so that they inline into
+// the targeted versions; the threads split the range above them.
+
+// The complex N x N products are done as real 2N x 2N ones on the
+// interleaved (re, im) components, which keeps the inner loops unit
+// stride. O[a*2N + b] += V_a W_b over the components i0..i1-1, for the
+// real components a, b of one block component (see blockDotN). Two rows
+// of O are accumulated at a time over chunks of the field that stay in
+// cache.
+template<int n, typename R>
+inline __attribute__((always_inline)) void blockDotRange(double *O, const R *V, const R *W,
+							 long i0, long i1, int N_) {
+  const int N2 = 2*(n ? n : N_);
+  const long chunk = 64;
+  double o0[n ? 2*n : 128], o1[n ? 2*n : 128];
+  for(long c0=i0; c0<i1; c0+=chunk) {
+    long c1 = min(c0 + chunk, i1);
+    for(int a=0; a<N2; a+=2) {
+      for(int b=0; b<N2; b++) o0[b] = o1[b] = 0.0;
+      for(long i=c0; i<c1; i++) {
+	const R *v = V + N2*i, *w = W + N2*i;
+	const double v0 = v[a], v1 = v[a+1];
+#pragma omp simd
+	for(int b=0; b<N2; b++) {
+	  o0[b] += v0*w[b];
+	  o1[b] += v1*w[b];
+	}
+      }
+      for(int b=0; b<N2; b++) {
+	O[a*N2 + b]     += o0[b];
+	O[(a+1)*N2 + b] += o1[b];
+      }
+    }
+  }
 }
 
-//axpy in result
-template<typename T> inline void axpy(const double a, T*** X,
-				      T*** Y, T*** result){  
-  #pragma omp parallel for
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	result[x][y][s] = a*X[x][y][s] + Y[x][y][s];
-}
-
-template<typename T> inline void xpaypbz(const T X[LX][LY][2],
-					 const double a, const T Y[LX][LY][2],
-					 const double b, T Z[LX][LY][2]) {  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++) {
-	Z[x][y][s] *= b;
-	Z[x][y][s] += X[x][y][s] + a*Y[x][y][s];
+// Y = A + V Mr over the components i0..i1-1, with Mr the real 2N x 2N
+// form of M (see blockMulN). A may be null. For N < 4 the rows are
+// shorter than a vector register and are better left to the compiler
+// than forced through omp simd.
+template<int n, typename R>
+inline __attribute__((always_inline)) void blockMulRange(R *Y, const R *A, const R *V, const R *Mr,
+							 long i0, long i1, int N_) {
+  const int N2 = 2*(n ? n : N_);
+  // Local copies so that the stores to Y cannot alias the matrix
+  alignas(64) R m[n ? 4*n*n : 1], y[n ? 2*n : 128];
+  vector<R> mv;
+  const R *Ml = m;
+  if(n) for(int k=0; k<N2*N2; k++) m[k] = Mr[k];
+  else {
+    mv.assign(Mr, Mr + N2*N2);
+    Ml = mv.data();
+  }
+  const R zero[n ? 2*n : 128] = {};
+  for(long i=i0; i<i1; i++) {
+    const R *v = V + N2*i;
+    const R *a0 = A ? A + N2*i : zero;
+    for(int b=0; b<N2; b++) y[b] = a0[b];
+    if(n == 0 || n >= 4) {
+      for(int a=0; a<N2; a++) {
+	const R va = v[a];
+#pragma omp simd
+	for(int b=0; b<N2; b++) y[b] += va*Ml[a*N2 + b];
       }
+    } else {
+      for(int a=0; a<N2; a++)
+	for(int b=0; b<N2; b++) y[b] += v[a]*Ml[a*N2 + b];
+    }
+    for(int b=0; b<N2; b++) Y[N2*i + b] = y[b];
+  }
 }
 
-template<typename T> inline void ax(const double a, T X[LX][LY][2]){ 
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int s=0; s<2; s++)
-	X[x][y][s] *= a;
+template<int n, typename R>
+void blockDotScalar(double *G, const R *V, const R *W, long i0, long i1, int N) {
+  blockDotRange<n>(G, V, W, i0, i1, N);
 }
 
-template<typename T> inline void printVector(T const X[LX][LY][2]){
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      cout << "(" << x << "," << y << ") = " << X[x][y][0] << " " << X[x][y][1]<<endl; 
+template<int n, typename R>
+void blockMulScalar(R *Y, const R *A, const R *V, const R *Mr, long i0, long i1, int N) {
+  blockMulRange<n>(Y, A, V, Mr, i0, i1, N);
 }
-    
-//Staggered Fermion Utilities
-//---------------------------------------------------------------------------------
-// Zero fermion field
-template<typename T> inline void zeroField(T psi[LX][LY]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      psi[x][y] = 0.0;
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(DISABLE_SIMD)
+#define BLOCK_SIMD
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+template<int n, typename R>
+void blockDotAVX2(double *G, const R *V, const R *W, long i0, long i1, int N) {
+  blockDotRange<n>(G, V, W, i0, i1, N);
 }
 
-// Copy fermion field
-template<typename T> inline void copyField(T psi2[LX][LY], const T psi1[LX][LY]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      psi2[x][y] = psi1[x][y];
+template<int n, typename R>
+void blockMulAVX2(R *Y, const R *A, const R *V, const R *Mr, long i0, long i1, int N) {
+  blockMulRange<n>(Y, A, V, Mr, i0, i1, N);
 }
+#pragma GCC pop_options
 
-// Inner product 
-template<typename T> inline T dotField(const T psi1[LX][LY], const T psi2[LX][LY]) {
-  T scalar = (T) 0.0;
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      scalar += conj(psi1[x][y])*psi2[x][y];
-  return scalar;
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+template<int n, typename R>
+void blockDotAVX512(double *G, const R *V, const R *W, long i0, long i1, int N) {
+  blockDotRange<n>(G, V, W, i0, i1, N);
 }
 
-// Norm squared 
-template<typename T> inline double norm2(const T psi[LX][LY]) {
-  
-  double norm2 = 0.0;
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      norm2 += (psi[x][y].real() * psi[x][y].real() + psi[x][y].imag() * psi[x][y].imag());
-  
-  return norm2;
+template<int n, typename R>
+void blockMulAVX512(R *Y, const R *A, const R *V, const R *Mr, long i0, long i1, int N) {
+  blockMulRange<n>(Y, A, V, Mr, i0, i1, N);
+}
+#pragma GCC pop_options
+
+#endif
+
+//0 scalar, 1 AVX2, 2 AVX-512
+inline int blockISA() {
+#ifdef BLOCK_SIMD
+  static const int isa = (__builtin_cpu_supports("avx512f") ? 2 :
+			  (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? 1 : 0));
+  return isa;
+#else
+  return 0;
+#endif
+}
+
+template<int n, typename R>
+void blockDotN(double *G, const R *V, const R *W, long len, int N) {
+
+  void (*kernel)(double *, const R *, const R *, long, long, int) = blockDotScalar<n, R>;
+#ifdef BLOCK_SIMD
+  if(blockISA() == 2) kernel = blockDotAVX512<n, R>;
+  else if(blockISA() == 1) kernel = blockDotAVX2<n, R>;
+#endif
+
+  const int N2 = 2*N, NN = 4*N*N;
+  vector<double> osum(NN, 0.0);
+  double *os = osum.data();
+#pragma omp parallel reduction(+:os[:NN])
+  {
+    int nt = omp_get_num_threads();
+    int t = omp_get_thread_num();
+    vector<double> o(NN, 0.0);
+    kernel(o.data(), V, W, (len*t)/nt, (len*(t+1))/nt, N);
+    for(int k=0; k<NN; k++) os[k] += o[k];
+  }
+  // <V_k, W_l> = (vr wr + vi wi) + i (vr wi - vi wr)
+  for(int k=0; k<N; k++)
+    for(int l=0; l<N; l++) {
+      G[2*(k*N + l)]   = os[2*k*N2 + 2*l]     + os[(2*k+1)*N2 + 2*l+1];
+      G[2*(k*N + l)+1] = os[2*k*N2 + 2*l + 1] - os[(2*k+1)*N2 + 2*l];
+    }
 }
 
+template<int n, typename R>
+void blockMulN(R *Y, const R *A, const R *V, const double *M, long len, int N) {
 
-template<typename T> inline void caxpby(const T a, const T X[LX][LY],
-					const T b, const T Y[LX][LY],
-					T result[LX][LY]){  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      result[x][y] = a*X[x][y] + b*Y[x][y];
+  void (*kernel)(R *, const R *, const R *, const R *, long, long, int) = blockMulScalar<n, R>;
+#ifdef BLOCK_SIMD
+  if(blockISA() == 2) kernel = blockMulAVX512<n, R>;
+  else if(blockISA() == 1) kernel = blockMulAVX2<n, R>;
+#endif
+
+  // Row 2k (2k+1) of Mr takes the real (imaginary) part of V_k to the
+  // real and imaginary parts of Y_l
+  const int N2 = 2*N;
+  vector<R> Mr(N2*N2);
+  for(int k=0; k<N; k++)
+    for(int l=0; l<N; l++) {
+      const double mr = M[2*(k*N + l)], mi = M[2*(k*N + l)+1];
+      Mr[2*k*N2 + 2*l]       =  mr;
+      Mr[2*k*N2 + 2*l+1]     =  mi;
+      Mr[(2*k+1)*N2 + 2*l]   = -mi;
+      Mr[(2*k+1)*N2 + 2*l+1] =  mr;
+    }
+#pragma omp parallel
+  {
+    int nt = omp_get_num_threads();
+    int t = omp_get_thread_num();
+    kernel(Y, A, V, Mr.data(), (len*t)/nt, (len*(t+1))/nt, N);
+  }
 }
 
-template<typename T> inline void axpby(const double a, const T X[LX][LY], 
-				       const double b,
-				       const T Y[LX][LY], T result[LX][LY]){
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      result[x][y] = a*X[x][y] + b*Y[x][y];
+template<typename T> inline void blockDot(vector<T> &G, const latField<T> &V, const latField<T> &W, int N) {
+  typedef typename realOf<T>::type R;
+  const R *v = (const R *)V.v, *w = (const R *)W.v;
+  const long len = V.len/N;
+  G.resize(N*N);
+  double *g = (double *)G.data();
+  switch(N) {
+  case 1:  blockDotN<1>(g, v, w, len, N); break;
+  case 2:  blockDotN<2>(g, v, w, len, N); break;
+  case 4:  blockDotN<4>(g, v, w, len, N); break;
+  case 8:  blockDotN<8>(g, v, w, len, N); break;
+  default: blockDotN<0>(g, v, w, len, N);
+  }
 }
 
-//Staggered fermion axpy in place 
-template<typename T> inline void axpy(const double a, const T X[LX][LY], 
-				      T Y[LX][LY]){ 
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      Y[x][y] = a*X[x][y] + Y[x][y];
+// Y_l = A_l + sum_k V_k M[k*N + l], or Y = V M without A. Y may be the
+// same field as A or V.
+template<typename T> inline void blockMulAdd(latField<T> &Y, const latField<T> *A, const latField<T> &V,
+					     const vector<T> &M, int N) {
+  typedef typename realOf<T>::type R;
+  R *y = (R *)Y.v;
+  const R *a = (A ? (const R *)A->v : nullptr), *v = (const R *)V.v;
+  const double *m = (const double *)M.data();
+  const long len = V.len/N;
+  switch(N) {
+  case 1:  blockMulN<1>(y, a, v, m, len, N); break;
+  case 2:  blockMulN<2>(y, a, v, m, len, N); break;
+  case 4:  blockMulN<4>(y, a, v, m, len, N); break;
+  case 8:  blockMulN<8>(y, a, v, m, len, N); break;
+  default: blockMulN<0>(y, a, v, m, len, N);
+  }
 }
 
-//Staggered fermion axpy in result
-template<typename T> inline void axpy(const double a, const T X[LX][LY], 
-				      const T Y[LX][LY],
-				      T result[LX][LY]){ 
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      result[x][y] = a*X[x][y] + Y[x][y];
+template<typename T> inline void blockMul(latField<T> &Y, const latField<T> &A, const latField<T> &V,
+					  const vector<T> &M, int N) {
+  blockMulAdd(Y, &A, V, M, N);
 }
 
-template<typename T> inline void xpaypbz(const T X[LX][LY],
-					 const double a, const T Y[LX][LY],
-					 const double b, T Z[LX][LY]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++) {
-      Z[x][y] *= b;
-      Z[x][y] += X[x][y] + a*Y[x][y];
-    }
+template<typename T> inline void blockMul(latField<T> &Y, const latField<T> &V, const vector<T> &M, int N) {
+  blockMulAdd(Y, (const latField<T> *)nullptr, V, M, N);
 }
 
-template<typename T> inline void ax(const double a, T X[LX][LY]){
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      X[x][y] *= a;
+//Checkerboard fields
+//---------------------------------------------------------------------------------
+// A field of one parity lives on half the lattice, nx = LX and ny = LY/2.
+// Row x holds the sites y = 2j + (x+par)%2 of parity par = (x+y)%2, in
+// order. LY must be even.
+
+template<typename T> inline void extractParity(latField<T> &half, const latField<T> &full, int par) {
+#pragma omp parallel for
+  for(int x=0; x<full.nx; x++) {
+    int o = (x+par)%2;
+    for(int j=0; j<half.ny; j++)
+      for(int s=0; s<full.nd; s++)
+	half[x][j][s] = full[x][2*j+o][s];
+  }
+}
+
+template<typename T> inline void insertParity(latField<T> &full, const latField<T> &half, int par) {
+#pragma omp parallel for
+  for(int x=0; x<full.nx; x++) {
+    int o = (x+par)%2;
+    for(int j=0; j<half.ny; j++)
+      for(int s=0; s<full.nd; s++)
+	full[x][2*j+o][s] = half[x][j][s];
+  }
+}
+
+// The gauge field in checkerboard order: the parity 0 links as a half
+// field, followed by the parity 1 links. gaugeEO has the size of gauge.
+inline void checkerboardGauge(latField<Complex> &gaugeEO, const latField<Complex> &gauge) {
+  for(int par=0; par<2; par++) {
+    latField<Complex> half(gaugeEO.v + (long)par*gauge.nx*gauge.ny, 2, gauge.nx, gauge.ny/2);
+    extractParity(half, gauge, par);
+  }
 }
 
 #endif
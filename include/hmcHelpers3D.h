@@ -4,7 +4,7 @@
 //3D Routines
 //----------------------------------------------------------------------------------
 // All Wilson loops are computed clockwise.
-void forceU(double fU[LX][LY][LZ][D], const Complex gauge[LX][LY][LZ][D], param_t p) {
+void forceU(latField3D<double> &fU, const latField3D<Complex> &gauge, param_t p) {
 
   zeroLat(fU);
 
@@ -14,57 +14,58 @@ void forceU(double fU[LX][LY][LZ][D], const Complex gauge[LX][LY][LZ][D], param_
   
   int xp1, xm1, yp1, ym1, zp1, zm1;
   
+#pragma omp parallel for private(plaq, plaq0, xp1, xm1, yp1, ym1, zp1, zm1)
   for(int x=0; x<LX; x++) {
-    xp1 = (x+1)%LX;
-    xm1 = (x-1+LX)%LX;
+    xp1 = nbr.xp[x];
+    xm1 = nbr.xm[x];
     for(int y=0; y<LY; y++) {
-      yp1 = (y+1)%LY;
-      ym1 = (y-1+LY)%LY;
+      yp1 = nbr.yp[y];
+      ym1 = nbr.ym[y];
       for(int z=0; z<LZ; z++) {
-	zp1 = (z+1)%LZ;
-	zm1 = (z-1+LZ)%LZ;
+	zp1 = nbr.zp[z];
+	zm1 = nbr.zm[z];
 	
 	//X dir
 	//-------
 	// +x, +y, -x, -x
-	plaq0 = gauge[x][y][z][0] * gauge[xp1][y][z][1] * conj(gauge[x][yp1][z][0]) * conj(gauge[x][y][z][1]);
-	fU[x][y][z][0] += beta*imag(plaq0);
+	plaq0 = gauge(x,y,z,0) * gauge(xp1,y,z,1) * conj(gauge(x,yp1,z,0)) * conj(gauge(x,y,z,1));
+	fU(x,y,z,0) += beta*imag(plaq0);
 
 	// -y, +x, +y, -x
-       	plaq = conj(gauge[x][ym1][z][1])*gauge[x][ym1][z][0] * gauge[xp1][ym1][z][1]*conj(gauge[x][y][z][0]);
-	fU[x][y][z][0] -= beta*imag(plaq);
+       	plaq = conj(gauge(x,ym1,z,1))*gauge(x,ym1,z,0) * gauge(xp1,ym1,z,1)*conj(gauge(x,y,z,0));
+	fU(x,y,z,0) -= beta*imag(plaq);
       
 	if(z != LZ-1) {
 	  // +x, +z, -x, -z
-	  plaq = gauge[x][y][z][0] * cUnit * conj(gauge[x][y][zp1][0]) * cUnit;
-	  fU[x][y][z][0] += betaz*imag(plaq);
+	  plaq = gauge(x,y,z,0) * cUnit * conj(gauge(x,y,zp1,0)) * cUnit;
+	  fU(x,y,z,0) += betaz*imag(plaq);
 	}
 	  
 	if(z != 0) {
 	  // -z, +x, +z, -x
-	  plaq = cUnit * gauge[x][y][zm1][0] * cUnit * conj(gauge[x][y][z][0]);
-	  fU[x][y][z][0] -= betaz*imag(plaq);
+	  plaq = cUnit * gauge(x,y,zm1,0) * cUnit * conj(gauge(x,y,z,0));
+	  fU(x,y,z,0) -= betaz*imag(plaq);
 	}
 	
 	//Y dir
 	//------
 	// +y, -x, -y, +x
-	plaq = gauge[x][y][z][1] * conj(gauge[xm1][yp1][z][0]) * conj(gauge[xm1][y][z][1]) * gauge[xm1][y][z][0];
-	fU[x][y][z][1] += beta*imag(plaq);
+	plaq = gauge(x,y,z,1) * conj(gauge(xm1,yp1,z,0)) * conj(gauge(xm1,y,z,1)) * gauge(xm1,y,z,0);
+	fU(x,y,z,1) += beta*imag(plaq);
 	
 	//This plaquette was aleady computed. We want the conjugate.
-	fU[x][y][z][1] -= beta*imag(plaq0);
+	fU(x,y,z,1) -= beta*imag(plaq0);
 	
 	if(z != LZ-1) {
 	  // y, z, -y, -z
-	  plaq = gauge[x][y][z][1] * cUnit * conj(gauge[x][y][zp1][1]) * cUnit;
-	  fU[x][y][z][1] += betaz*imag(plaq);
+	  plaq = gauge(x,y,z,1) * cUnit * conj(gauge(x,y,zp1,1)) * cUnit;
+	  fU(x,y,z,1) += betaz*imag(plaq);
 	}
 	
 	if(z != 0) {
 	  // -z, +y, +z, -y
-	  plaq = cUnit * gauge[x][y][zm1][1] * cUnit * conj(gauge[x][y][z][1]);
-	  fU[x][y][z][1] -= betaz*imag(plaq);
+	  plaq = cUnit * gauge(x,y,zm1,1) * cUnit * conj(gauge(x,y,z,1));
+	  fU(x,y,z,1) -= betaz*imag(plaq);
 	}
 	
 	//Z dir
@@ -73,20 +74,20 @@ void forceU(double fU[LX][LY][LZ][D], const Complex gauge[LX][LY][LZ][D], param_
 	if(z != LZ-1 && !p.lockedZ) {
 	  /*
 	  //z, x, -z, -x
-	  plaq = gauge[x][y][z][2]*gauge[x][y][zp1][0]*conj(gauge[xp1][y][z][2])*conj(gauge[x][y][z][0]);
-	  fU[x][y][z][2] -= betaz*imag(plaq);
+	  plaq = gauge(x,y,z,2)*gauge(x,y,zp1,0)*conj(gauge(xp1,y,z,2))*conj(gauge(x,y,z,0));
+	  fU(x,y,z,2) -= betaz*imag(plaq);
 	  
 	  //z, -x, -z, x
-	  plaq = gauge[x][y][z][2]*conj(gauge[xm1][y][zp1][0])*conj(gauge[xm1][y][z][2])*gauge[xm1][y][z][0];
-	  fU[x][y][z][2] -= betaz*imag(plaq);
+	  plaq = gauge(x,y,z,2)*conj(gauge(xm1,y,zp1,0))*conj(gauge(xm1,y,z,2))*gauge(xm1,y,z,0);
+	  fU(x,y,z,2) -= betaz*imag(plaq);
 	  
 	  //z, y, -z, -y
-	  plaq = gauge[x][y][z][2]*gauge[x][y][zp1][1]*conj(gauge[x][yp1][z][2])*conj(gauge[x][y][z][1]);
-	  fU[x][y][z][2] -= betaz*imag(plaq);
+	  plaq = gauge(x,y,z,2)*gauge(x,y,zp1,1)*conj(gauge(x,yp1,z,2))*conj(gauge(x,y,z,1));
+	  fU(x,y,z,2) -= betaz*imag(plaq);
 	  
 	  //z, -y, -z, y
-	  plaq = gauge[x][y][z][2]*conj(gauge[x][ym1][zp1][1])*conj(gauge[x][ym1][z][2])*gauge[x][ym1][z][1];
-	  fU[x][y][z][2] -= betaz*imag(plaq);
+	  plaq = gauge(x,y,z,2)*conj(gauge(x,ym1,zp1,1))*conj(gauge(x,ym1,z,2))*gauge(x,ym1,z,1);
+	  fU(x,y,z,2) -= betaz*imag(plaq);
 	  */
 	}
       }
@@ -95,49 +96,53 @@ void forceU(double fU[LX][LY][LZ][D], const Complex gauge[LX][LY][LZ][D], param_
 }
 
 //P_{k+1/2} = P_{k-1/2} - dtau * (fU + fD)
-void update_mom(double fU[LX][LY][LZ][D], double fD[LX][LY][2], double mom[LX][LY][LZ][D], double dtau, param_t p){
+void update_mom(const latField3D<double> &fU, const latField<double> &fD, latField3D<double> &mom, double dtau, param_t p){
   
   int x,y,z,mu;
   
   //Always update from the 2D gauge fields
+#pragma omp parallel for private(y, z, mu)
   for(x=0; x<LX; x++)
     for(y=0; y<LY; y++) 
       for(z=0; z<LZ; z++)
 	for(mu=0; mu<2; mu++) {
-	  mom[x][y][z][mu] -= fU[x][y][z][mu]*dtau;	  
+	  mom(x,y,z,mu) -= fU(x,y,z,mu)*dtau;	  
 	}
   
   //Update from the fermion field if dynamic
   if(p.dynamic == true) {
+#pragma omp parallel for private(y, mu)
     for(x=0; x<LX; x++)
       for(y=0; y<LY; y++)
 	for(mu=0; mu<2; mu++) {
-	  mom[x][y][(LZ-1)/2][mu] += fD[x][y][mu]*dtau;
+	  mom(x,y,(LZ-1)/2,mu) += fD[x][y][mu]*dtau;
 	}  
   }
 }
       
 
 //U_{k} = exp(i dtau P_{k-1/2}) * U_{k-1}
-void update_gauge(Complex gauge[LX][LY][LZ][D], double mom[LX][LY][LZ][D], double dtau, param_t p){
+void update_gauge(latField3D<Complex> &gauge, const latField3D<double> &mom, double dtau, param_t p){
   
   int x,y,z,mu;
   
   //Always update from the 2D gauge fields
+#pragma omp parallel for private(y, z, mu)
   for(x=0; x<LX; x++)
     for(y=0; y<LY; y++)
       for(z=0; z<LZ; z++)
 	for(mu=0; mu<2; mu++) {
-	  gauge[x][y][z][mu] *= polar(1.0, mom[x][y][z][mu] * dtau);
+	  gauge(x,y,z,mu) *= polar(1.0, mom(x,y,z,mu) * dtau);
 	}
   
   //Update from the extra dimension if not z locked.
   if(p.lockedZ == false) {
+#pragma omp parallel for private(y, z, mu)
     for(x=0; x<LX; x++)
       for(y=0; y<LY; y++) 
 	for(z=0; z<LZ; z++)
 	  for(mu=2; mu<D; mu++) {
-	    gauge[x][y][z][mu] *= polar(1.0, mom[x][y][z][mu] * dtau);
+	    gauge(x,y,z,mu) *= polar(1.0, mom(x,y,z,mu) * dtau);
 	  }
   }
 }
@@ -0,0 +1,103 @@
+#ifndef INTEGRATORS_H
+#define INTEGRATORS_H
+
+#include <vector>
+#include "utils.h"
+#include "latHelpers.h"
+#include "workspace.h"
+
+using namespace std;
+
+// Symplectic integrators for the HMC
+//---------------------------------------------------------------------------
+// A step of dtau = p.tau/p.nstep alternates momentum updates by the force,
+// P -= a_i dtau (fU - fD), with gauge updates U = exp(i b_i dtau P) U, in
+// a sequence symmetric about its middle, so that the trajectory stays
+// reversible and area preserving. The last momentum update of a step
+// merges with the first of the next, so a step costs one force less than
+// it has momentum updates. p.integrator picks
+//
+//  INTEGRATOR_LEAPFROG  a = 1/2 1/2, b = 1: second order, 1 force a step.
+//  INTEGRATOR_2MN       Omelyan's minimum norm scheme (Omelyan, Mryglod and
+//                       Folk, Comput. Phys. Commun. 146 (2002) 188), second
+//                       order, 2 forces. Its error is about a tenth of the
+//                       leapfrog's at the same step, so it takes steps about
+//                       twice as long at the same acceptance.
+//  INTEGRATOR_4MN       Their fourth order minimum norm scheme (Comput. Phys.
+//                       Commun. 151 (2003) 272), 5 forces.
+//  INTEGRATOR_FG        The force gradient scheme, fourth order, 3 forces.
+//                       The middle update is by 2/3 dtau the force at
+//                       U' = exp(-i dtau^2/24 (fU - fD)) U, which adds the
+//                       force gradient term to the order needed (Yin and
+//                       Mawhinney, PoS LATTICE2011 051).
+//
+// The caller provides force(), which puts the forces at the current gauge
+// field in its fU and fD, kick(P, eps), P -= eps (fU - fD), and drift(P,
+// eps), U = exp(i eps P) U.
+
+#ifndef OMELYAN_LAMBDA
+#define OMELYAN_LAMBDA 0.1931833275037836
+#endif
+
+template<typename M, typename G, typename Force, typename Kick, typename Drift>
+void integrate(M &mom, G &gauge, Force force, Kick kick, Drift drift, param_t p) {
+
+  vector<double> a, b;
+  int fg = -1; // The momentum update with the force gradient
+  switch(p.integrator) {
+  case INTEGRATOR_LEAPFROG:
+    a = {0.5, 0.5};
+    b = {1.0};
+    break;
+  case INTEGRATOR_2MN:
+    a = {OMELYAN_LAMBDA, 1.0 - 2.0*OMELYAN_LAMBDA, OMELYAN_LAMBDA};
+    b = {0.5, 0.5};
+    break;
+  case INTEGRATOR_4MN: {
+    const double theta = 0.08398315262876693, rho = 0.2539785108410595;
+    const double lambda = 0.6822365335719091, mu = -0.03230286765269967;
+    const double kappa = 0.5 - lambda - theta;
+    a = {theta, lambda, kappa, kappa, lambda, theta};
+    b = {rho, mu, 1.0 - 2.0*(mu + rho), mu, rho};
+    break;
+  }
+  case INTEGRATOR_FG:
+    a = {1.0/6.0, 2.0/3.0, 1.0/6.0};
+    b = {0.5, 0.5};
+    fg = 1;
+    break;
+  default:
+    cout << "Error in integrate: unknown integrator " << p.integrator << endl;
+    exit(0);
+  }
+
+  const double dtau = p.tau/p.nstep;
+  const int nb = b.size();
+
+  force();
+  kick(mom, a[0]*dtau);
+  for(int k=0; k<p.nstep; k++)
+    for(int i=1; i<=nb; i++) {
+      drift(mom, b[i-1]*dtau);
+      double eps = a[i]*dtau;
+      if(i == nb && k < p.nstep-1) eps += a[0]*dtau;
+      if(i == fg) {
+	// Views of pool scratch shaped as mom and gauge
+	tmpField<double> shiftBuf(mom.nd*mom.nz, mom.nx, mom.ny);
+	tmpField<Complex> gaugeBuf(gauge.nd*gauge.nz, gauge.nx, gauge.ny);
+	M shift(shiftBuf.v, mom.nd);
+	G gaugeOld(gaugeBuf.v, gauge.nd);
+	force();
+	zeroLat(shift);
+	kick(shift, dtau*dtau/24.0);
+	copyLat(gaugeOld, gauge);
+	drift(shift, 1.0);
+	force();
+	copyLat(gauge, gaugeOld);
+      }
+      else force();
+      kick(mom, eps);
+    }
+}
+
+#endif
@@ -2,7 +2,11 @@
 #define INVERTERS_H
 
 #include "dOpHelpers.h"
+#include "linAlgHelpers.h"
+#include "lanczos.h"
+#include "multigrid.h"
 #include <chrono>
+#include <limits>
 
 using namespace std::chrono;
 
@@ -18,27 +22,31 @@ using namespace std::chrono;
 
 // Wilson g5Dg5D matrix inverter
 //---------------------------------------------------------------
-int Ainvpsi(Complex x[LX][LY][2], const Complex b[LX][LY][2], Complex x0[LX][LY][2],
-	    const Complex gauge[LX][LY][2], param_t param) {
-  
+int AinvpsiWilson(latField<Complex> &x, const latField<Complex> &b, latField<Complex> &x0,
+		  const latField<Complex> &gauge, param_t param) {
+
   int success = 0;
-  
-  Complex res[LX][LY][2], p[LX][LY][2], Ap[LX][LY][2], tmp[LX][LY][2];
+
+  tmpField<Complex> res;
+  tmpField<Complex> p;
+  tmpField<Complex> Ap;
+  tmpField<Complex> tmp;
+
   double alpha, beta, denom;
   double rsq = 0, rsqNew = 0, bsqrt = 0.0, bnorm = 0.0;
   bool deflating = false;
-  
+
   //Intialize
   zeroField(res);
   zeroField(Ap);
   zeroField(p);
   zeroField(x);
-  
+
   // Find norm of rhs.
   bnorm = norm2(b);
   bsqrt = sqrt(bnorm);
   if(bsqrt == 0 || bsqrt != bsqrt) {
-    printVector(b);
+    //printVector(b);
     cout << "Error in Wilson Ainvpsi: inverting on zero source... or nan!" << endl;
     exit(0);
   }
@@ -56,18 +64,16 @@ int Ainvpsi(Complex x[LX][LY][2], const Complex b[LX][LY][2], Complex x0[LX][LY]
 	 << ", |b| = " << bsqrt
 	 << ", |res| = " << sqrt(norm2(res)) << endl;
   }
-  
+
   copyField(p, res);
   rsq = norm2(res);
-  
+
   // Iterate until convergence
   int k;
   for (k=0; k<param.maxIterCG; k++) {
 
-    // Compute Ap.
-    DdagDpsi(Ap, p, gauge, param);
-    
-    denom = real(dotField(p, Ap));
+    // Compute Ap and <p, Ap> in one pass.
+    DdagDpsi(Ap, p, gauge, param, denom);
     alpha = rsq/denom;
     
     axpy( alpha, p,  x);
@@ -88,7 +94,7 @@ int Ainvpsi(Complex x[LX][LY][2], const Complex b[LX][LY][2], Complex x0[LX][LY]
     axpy(beta, p, res, p);
     
   } // End loop over k
-  
+
   if(k == param.maxIterCG) {
     // Failed convergence 
     printf("CG: Failed to converge iter = %d, rsq = %.16e\n", k+1, rsq); 
@@ -106,92 +112,343 @@ int Ainvpsi(Complex x[LX][LY][2], const Complex b[LX][LY][2], Complex x0[LX][LY]
   }
   DdagDpsi(tmp, x, gauge, param);
   axpy(-1.0, tmp, b, res);
-  
+
   //double truersq = real(dotField(res, res));
   //printf("CG: Converged iter = %d, rsq = %.16e, truersq = %.16e\n", k+1, rsq, truersq/(bsqrt*bsqrt));
   return success;
-  
+
 }
 
-int Ainvpsi(Complex*** x, Complex*** b, Complex*** x0,
-	    Complex*** gauge, param_t param) {
+// Wilson block CG inverter
+//---------------------------------------------------------------
+// Solves DdagD X = B for a block of N Wilson fields (nd = 2N, see
+// insertBlock), all right hand sides in one Krylov space. The search
+// space grows by N directions per application of the blocked operator
+// (wilsonDdagDBlock), so the iteration count falls with N.
+//
+// Plain block CG breaks down as the residuals of the block grow close to
+// linearly dependent. This is the variant of Dubrulle (DR-BCG), which
+// carries an orthonormal basis Q of the residual block, R = Q C, and a
+// search block S with
+//
+//   alpha = (S^dag A S)^-1,  X += S alpha C,
+//   Q zeta = Q - A S alpha   (QR),  S = Q + S zeta^dag,  C = zeta C.
+//
+// The QR is a Cholesky QR, and |R_k|^2 is the norm of column k of C.
+// Field k converges when |R_k|^2 < eps |B_k|^2. The iteration ends once
+// all of them have, or either Cholesky factorisation breaks down as the
+// block grows dependent. The true residuals then decide: the converged
+// fields are deflated and the rest go on from X as a smaller block, or
+// one at a time with AinvpsiWilson once the block no longer shrinks.
+int AinvpsiBlock(latField<Complex> &X, const latField<Complex> &B, latField<Complex> &X0,
+		 const latField<Complex> &gauge, param_t param) {
+
+  const int N = B.nd/2;
+  int success = 0;
 
-  auto start = high_resolution_clock::now();
+  tmpField<Complex> Q(B.nd);
+  tmpField<Complex> S(B.nd);
+  tmpField<Complex> Z(B.nd);
+
+  vector<Complex> G, L, Linv, alpha, C, M;
+  vector<double> bnorm(N, 0.0), rnorm(N, 0.0);
+
+  // Norms of the right hand sides
+  blockDot(G, B, B, N);
+  for(int k=0; k<N; k++) {
+    bnorm[k] = real(G[k*N + k]);
+    if(bnorm[k] == 0 || bnorm[k] != bnorm[k]) {
+      cout << "Error in AinvpsiBlock: inverting on zero source... or nan!" << endl;
+      exit(0);
+    }
+  }
+
+  // R = B - A X0, held in Z
+  copyField(X, X0);
+  copyField(Z, B);
+  if(norm2(X0) != 0.0) {
+    DdagDpsi(Q, X0, gauge, param);
+    axpy(-1.0, Q, Z);
+  }
+
+  // Q C = R, dependent residuals go straight to the true residual check
+  blockDot(G, Z, Z, N);
+  const bool dependent = !cholesky(L, G, N);
+  if(!dependent) {
+    matDag(C, L, N);
+    invertLower(Linv, L, N);
+    matDag(M, Linv, N);
+    blockMul(Q, Z, M, N);
+    copyField(S, Q);
+  }
+
+  bool converged = false;
+  int k;
+  for(k=0; k<param.maxIterCG && !dependent; k++) {
+
+    // alpha = (S^dag A S)^-1
+    DdagDpsi(Z, S, gauge, param);
+    blockDot(G, S, Z, N);
+    if(!cholesky(L, G, N)) break;
+    invertLower(Linv, L, N);
+    matDag(M, Linv, N);
+    matMul(alpha, M, Linv, N);
+
+    // X += S alpha C
+    matMul(M, alpha, C, N);
+    blockMul(X, X, S, M, N);
+
+    // Z = Q - A S alpha, then Q zeta = Z
+    for(auto &a : alpha) a = -a;
+    blockMul(Z, Q, Z, alpha, N);
+    blockDot(G, Z, Z, N);
+
+    // C = zeta C, with zeta = L^dag
+    if(!cholesky(L, G, N)) break;
+    matDag(M, L, N);
+    matMul(C, M, C, N);
+    converged = true;
+    for(int l=0; l<N; l++) {
+      rnorm[l] = 0.0;
+      for(int j=0; j<N; j++) rnorm[l] += norm(C[j*N + l]);
+      if(rnorm[l] >= param.eps*bnorm[l]) converged = false;
+    }
+    if(converged) break;
+
+    // Q = Z zeta^-1, S = Q + S zeta^dag
+    invertLower(Linv, L, N);
+    matDag(M, Linv, N);
+    blockMul(Q, Z, M, N);
+    blockMul(S, Q, S, L, N);
+  }
+
+  // R = B - A X, held in Q
+  DdagDpsi(Z, X, gauge, param);
+  axpy(-1.0, Z, B, Q);
+  blockDot(G, Q, Q, N);
+  vector<int> left;
+  for(int l=0; l<N; l++) {
+    rnorm[l] = real(G[l*N + l]);
+    if(rnorm[l] >= param.eps*bnorm[l]) left.push_back(l);
+  }
+  if(left.empty()) return 1;
+
+  const int n = left.size();
+  if(k == param.maxIterCG) {
+    printf("Block CG: Failed to converge iter = %d, %d of %d fields, rsq = %.16e\n",
+	   k, n, N, rnorm[left[0]]/bnorm[left[0]]);
+    return 0;
+  }
+
+  // Go on with the unconverged fields from X
+  param.maxIterCG -= k;
+  tmpField<Complex> f;
+  if(n < N) {
+    tmpField<Complex> Bs(2*n);
+    tmpField<Complex> Xs(2*n);
+    tmpField<Complex> X0s(2*n);
+    for(int i=0; i<n; i++) {
+      extractBlock(f, B, left[i]);
+      insertBlock(Bs, f, i);
+      extractBlock(f, X, left[i]);
+      insertBlock(X0s, f, i);
+    }
+    success = AinvpsiBlock(Xs, Bs, X0s, gauge, param);
+    for(int i=0; i<n; i++) {
+      extractBlock(f, Xs, i);
+      insertBlock(X, f, left[i]);
+    }
+  } else {
+    tmpField<Complex> x;
+    tmpField<Complex> x0;
+    success = 1;
+    for(int l : left) {
+      extractBlock(f, B, l);
+      extractBlock(x0, X, l);
+      if(!AinvpsiWilson(x, f, x0, gauge, param)) success = 0;
+      insertBlock(X, x, l);
+    }
+  }
+
+  return success;
+}
+
+// Mixed precision even-odd inverter
+//---------------------------------------------------------------
+// Solves A_pp x = b on half fields of parity par, with A_pp the Wilson
+// Dhat^dag Dhat or the staggered parity block (see DdagDpsiEO) and gaugeEO
+// the checkerboarded gauge field. Converges when |b - A x|^2 < tol |b|^2.
+//
+// The CG iterations run in single precision, on the correction e to the
+// current double precision solution x. The iterated float residual drifts
+// from the true one as rounding accumulates, so whenever it has fallen by
+// RELIABLE_DELTA below the largest residual since the last update, e is
+// added into x and the residual r = b - A x is recomputed in double
+// (reliable updates). The search direction is kept across an update, so
+// CG is not restarted. Once the true residual stops falling, double
+// precision is exhausted and the solve ends there, provided that it stalls
+// within CG_FLOOR_FACTOR of the rounding floor of b - A x, eps^2 (|b|^2 +
+// |x|^2). A stall above that is one of the single precision iterations,
+// and AinvpsiEODouble carries on from x in double precision. The solve
+// fails only if that stalls too.
+
+#define RELIABLE_DELTA 0.1
+#ifndef CG_FLOOR_FACTOR
+#define CG_FLOOR_FACTOR 1e3
+#endif
+
+// After a reliable update to the true residual rsqNew, rsqMax the largest
+// iterated residual since the previous one: 1 on convergence, -1 on a
+// stall above the floor, 0 to go on. The CG residual is not monotonic, so
+// the true residual is held against the peak that the iterated one fell
+// from, not against the previous true residual. While the two agree, the
+// update comes at RELIABLE_DELTA^2 rsqMax, far below rsqMax/4.
+inline int reliableExit(double rsqNew, double rsqMax, double bnorm,
+			const latField<Complex> &x, double tol) {
+  const double eps = numeric_limits<double>::epsilon();
+  if(rsqNew < tol*bnorm) return 1;
+  if(rsqNew <= 0.25*rsqMax) return 0;
+  return rsqNew < CG_FLOOR_FACTOR*eps*eps*(bnorm + norm2(x)) ? 1 : -1;
+}
+
+// Double precision CG on A_pp from the current x, with the same reliable
+// updates and stall check. k counts on from the iterations already spent
+// and rsq gets the final true residual.
+int AinvpsiEODouble(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &gaugeEO,
+		    param_t param, int par, double tol, int &k, double &rsq) {
+
+  const int nd = b.nd;
+  tmpField<Complex> res(nd, LX, LY/2);
+  tmpField<Complex> p(nd, LX, LY/2);
+  tmpField<Complex> Ap(nd, LX, LY/2);
+
+  double alpha, beta, denom, rsqNew;
+  const double bnorm = norm2(b);
+  DdagDpsiEO(Ap, x, gaugeEO, param, par, denom);
+  axpy(-1.0, Ap, b, res);
+  copyField(p, res);
+  rsq = norm2(res);
+  double rsqMax = rsq;
+
+  for(; k<param.maxIterCG; k++) {
+
+    DdagDpsiEO(Ap, p, gaugeEO, param, par, denom);
+    alpha = rsq/denom;
+    axpy( alpha, p,  x);
+    axpy(-alpha, Ap, res);
+    rsqNew = norm2(res);
+    if(rsqNew > rsqMax) rsqMax = rsqNew;
+    beta = rsqNew/rsq;
+
+    if(rsqNew < tol*bnorm || rsqNew < RELIABLE_DELTA*RELIABLE_DELTA*rsqMax) {
+      DdagDpsiEO(Ap, x, gaugeEO, param, par, denom);
+      axpy(-1.0, Ap, b, res);
+      rsqNew = norm2(res);
+      const int done = reliableExit(rsqNew, rsqMax, bnorm, x, tol);
+      if(done) {
+	rsq = rsqNew;
+	return done > 0;
+      }
+      rsqMax = rsqNew;
+    }
+    rsq = rsqNew;
+    axpy(beta, p, res, p);
+  }
+  return 0;
+}
+
+int AinvpsiEOReliable(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &x0,
+		      const latField<Complex> &gaugeEO, param_t param, int par, double tol) {
 
   int success = 0;
+  const int nd = b.nd;
 
-  Complex*** res = gst.b09;
-  Complex*** p = gst.b10;
-  Complex*** Ap = gst.b11;
-  Complex*** tmp = gst.b12;
+  tmpField<Complex> res(nd, LX, LY/2);
+  tmpField<Complex> tmp(nd, LX, LY/2);
+  tmpField<ComplexF> resF(nd, LX, LY/2);
+  tmpField<ComplexF> eF(nd, LX, LY/2);
+  tmpField<ComplexF> pF(nd, LX, LY/2);
+  tmpField<ComplexF> ApF(nd, LX, LY/2);
+  tmpField<ComplexF> gaugeEOF;
 
   double alpha, beta, denom;
-  double rsq = 0, rsqNew = 0, bsqrt = 0.0, bnorm = 0.0;
-  bool deflating = false;
-
-  //Intialize
-  zeroField(res);
-  zeroField(Ap);
-  zeroField(p);
-  zeroField(x);
+  double rsq = 0, rsqNew = 0, rsqMax = 0, bnorm = 0.0;
 
   // Find norm of rhs.
   bnorm = norm2(b);
-  bsqrt = sqrt(bnorm);
-  if(bsqrt == 0 || bsqrt != bsqrt) {
-    //printVector(b);
-    cout << "Error in Wilson Ainvpsi: inverting on zero source... or nan!" << endl;
+  if(bnorm == 0 || bnorm != bnorm) {
+    cout << "Error in AinvpsiEOReliable: inverting on zero source... or nan!" << endl;
     exit(0);
   }
-  copyField(res, b);
   
   // res = b - A*x0
-  if (norm2(x0) != 0.0) {
-    
-    //Solve the deflated system.
-    deflating = true;
-    DdagDpsi(tmp, x0, gauge, param);    
+  copyField(x, x0);
+  copyField(res, b);
+  if(norm2(x0) != 0.0) {
+    DdagDpsiEO(tmp, x0, gaugeEO, param, par, denom);
     axpy(-1.0, tmp, res);
-    
-    cout << "using initial guess, |x0| = " << sqrt(norm2(x0))
-	 << ", |b| = " << bsqrt
-	 << ", |res| = " << sqrt(norm2(res)) << endl;
   }
 
-  copyField(p, res);
+  convertField(gaugeEOF, gaugeEO);
+  convertField(resF, res);
+  copyField(pF, resF);
+  zeroField(eF);
   rsq = norm2(res);
+  rsqMax = rsq;
 
   // Iterate until convergence
   int k;
+  bool stalled = false;
   for (k=0; k<param.maxIterCG; k++) {
 
-    // Compute Ap.
-    DdagDpsi(Ap, p, gauge, param);
-    
-    denom = real(dotField(p, Ap));
+    // Compute Ap and <p, Ap> in one pass.
+    DdagDpsiEO(ApF, pF, gaugeEOF, param, par, denom);
     alpha = rsq/denom;
     
-    axpy( alpha, p,  x);
-    axpy(-alpha, Ap, res);
+    axpy( alpha, pF,  eF);
+    axpy(-alpha, ApF, resF);
     
-    // Exit if new residual is small enough
-    rsqNew = norm2(res);
-    //printf("CG iter %d, rsq = %g\n", k+1, rsqNew);
-    if (rsqNew < param.eps*bnorm) {
-      rsq = rsqNew;
-      break;
+    rsqNew = norm2(resF);
+    if(rsqNew > rsqMax) rsqMax = rsqNew;
+    beta = rsqNew/rsq;
+
+    if(rsqNew < tol*bnorm || rsqNew < RELIABLE_DELTA*RELIABLE_DELTA*rsqMax) {
+
+      // Reliable update: x += e, res = b - A*x in double
+      convertField(tmp, eF);
+      axpy(1.0, tmp, x);
+      zeroField(eF);
+      DdagDpsiEO(tmp, x, gaugeEO, param, par, denom);
+      axpy(-1.0, tmp, b, res);
+      rsqNew = norm2(res);
+      //printf("CG iter %d, reliable update rsq = %g\n", k+1, rsqNew);
+      
+      // Exit if the true residual is small enough, or no longer falls
+      const int done = reliableExit(rsqNew, rsqMax, bnorm, x, tol);
+      if(done) {
+	rsq = rsqNew;
+	stalled = done < 0;
+	break;
+      }
+      rsqMax = rsqNew;
+      convertField(resF, res);
     }
     
-    // Update vec using new residual
-    beta = rsqNew/rsq;
+    // Update vec using new residual. beta is taken from the iterated
+    // residual, which is what the search directions are conjugate to.
     rsq = rsqNew;
     
-    axpy(beta, p, res, p);
+    axpy(beta, pF, resF, pF);
     
   } // End loop over k
 
-  if(k == param.maxIterCG) {
-    // Failed convergence 
+  // A stall above the floor goes on in double precision
+  if(stalled) stalled = !AinvpsiEODouble(x, b, gaugeEO, param, par, tol, k, rsq);
+
+  if(k == param.maxIterCG || stalled) {
+    // Failed convergence, keep what the float iterations found
+    convertField(tmp, eF);
+    axpy(1.0, tmp, x);
     printf("CG: Failed to converge iter = %d, rsq = %.16e\n", k+1, rsq); 
     success = 0; 
   } else {
@@ -199,287 +456,1291 @@ int Ainvpsi(Complex*** x, Complex*** b, Complex*** x0,
     success = 1; 
   }
   
-  if(deflating) {
-    // x contains the solution to the deflated system b - A*x0.
-    // We must add back the exact part
-    axpy(1.0, x0, x);
-    // x now contains the solution to the RHS b.
-  }
-  DdagDpsi(tmp, x, gauge, param);
-  axpy(-1.0, tmp, b, res);
-
-  auto stop = high_resolution_clock::now();
-  auto duration = duration_cast<microseconds>(stop - start);
-  gst.inv_time += duration.count();
-
-  //double truersq = real(dotField(res, res));
-  //printf("CG: Converged iter = %d, rsq = %.16e, truersq = %.16e\n", k+1, rsq, truersq/(bsqrt*bsqrt));
   return success;
-  
 }
 
-// let dD \equiv (d/dtheta D)
+// Pipelined variant (Ghysels and Vanroose, Parallel Computing 40 (2014)
+// 224). Plain CG needs <p, A p> before it can update x and res, and |res|^2
+// before the next direction, so each iteration runs a reduction, three
+// axpys and a norm as separate parallel loops, each with its barrier. The
+// pipelined recurrences carry s = A p, z = A s and w = A res alongside,
 //
-// d/dtheta (phi^* (DD^dag)^-1 phi) = -((DD^dag)^1 phi)^dag ([dD]*D^dag + D*[dD^dag]) ((DD^dag)^-1 phi)
+//   z = A w + beta z,  s = w + beta s,  p = res + beta p,
+//   e += alpha p,  res -= alpha s,  w -= alpha z,
+//
+// with alpha and beta from gamma = |res|^2 and delta = <w, res> alone. The
+// updates and both inner products for the next iteration are one fused
+// loop, so an iteration is one application of A and one parallel loop.
+// The extra recurrences drift faster than plain CG's, and every reliable
+// update also recomputes w, s and z from the new residual and the kept p.
+// Even so, in single precision they lose the conjugacy of the directions
+// on the harder systems (Wilson 64^2 at m = -0.05, staggered 64^2 at
+// m = 0.02), where the residual grows again between the updates. Once an
+// update finds the true residual no lower than at an earlier one, or the
+// solve stalls, the rest is left to AinvpsiEOReliable from the current x.
 //
-// *****  Should optimize this to operate only on EVEN sites. ****
+// With CG_PIPE set, AinvpsiEO hands over to this on CG_PIPE_THREADS
+// threads or more, where the barriers cost more than the three extra
+// fields to stream. It is off by default, since on the systems above the
+// hand over costs more iterations than the pipelining saves.
 
-void forceD(double fD[LX][LY][2], Complex gauge[LX][LY][2], Complex phi[LX][LY][2],
-	    Complex guess[LX][LY][2], param_t p){
-  
-  if(p.dynamic == true) {
+#ifndef CG_PIPE
+#define CG_PIPE 0
+#endif
+#ifndef CG_PIPE_THREADS
+#define CG_PIPE_THREADS 8
+#endif
 
-    zeroLat(fD);
-    
-    //phip = (D^dagD)^-1 * phi
-    Complex phip[LX][LY][2];
-    zeroField(phip);
-    
-    //Ainvpsi inverts using the DdagD (g3Dg3D) operator, returns
-    // phip = (D^-1 * Ddag^-1) phi = (D^-1 * g3 * D^-1 g3) phi.
-    Complex guess[LX][LY][2]; //Initial guess to CG
-    zeroField(guess);
-    Ainvpsi(phip, phi, guess, gauge, p);
-    
-    //g3Dphi = g3D * phip
-    Complex g3Dphi[LX][LY][2];
-    zeroField(g3Dphi);
-    g3Dpsi(g3Dphi, phip, gauge, p);
-    
-    int xp1, xm1, yp1, ym1;
-    double r = 1.0;
-    for(int x=0; x<LX; x++)
-      for(int y=0; y<LY; y++) {
+int AinvpsiEOPipe(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &x0,
+		  const latField<Complex> &gaugeEO, param_t param, int par, double tol) {
 
-	xp1 = (x+1)%LX;
-	yp1 = (y+1)%LY;
-	xm1 = (x-1+LX)%LX;
-	ym1 = (y-1+LY)%LY;	
-	
-	//mu = 0
-	//upper
-	// | r  1 | 
-	// | 1  r |
-	//lower
-	// | r -1 |
-	// | 1 -r |					
-	fD[x][y][0] += real(I*((conj(gauge[x][y][0]) *
-			       (conj(phip[xp1][y][0]) * (r*g3Dphi[x][y][0] +   g3Dphi[x][y][1]) -
-				conj(phip[xp1][y][1]) * (  g3Dphi[x][y][0] + r*g3Dphi[x][y][1])))
-			       -
-			       (gauge[x][y][0] *
-			       (conj(phip[x][y][0]) * (r*g3Dphi[xp1][y][0] -   g3Dphi[xp1][y][1]) +
-				conj(phip[x][y][1]) * (  g3Dphi[xp1][y][0] - r*g3Dphi[xp1][y][1])))
-			       )
-			    );	
-	
-	//mu = 1
-	//upper
-	// | r -i | 
-	// | i  r |
-	//lower
-	// | r  i |
-	// | i -r |
-	fD[x][y][1] += real(I*((conj(gauge[x][y][1]) *
-				(conj(phip[x][yp1][0]) * (r*g3Dphi[x][y][0] - I*g3Dphi[x][y][1]) -
-				 conj(phip[x][yp1][1]) * (I*g3Dphi[x][y][0] + r*g3Dphi[x][y][1])))
-			       -			       
-			       (gauge[x][y][1] *
-				(conj(phip[x][y][0]) * (r*g3Dphi[x][yp1][0] + I*g3Dphi[x][yp1][1]) +
-				 conj(phip[x][y][1]) * (I*g3Dphi[x][yp1][0] - r*g3Dphi[x][yp1][1])))
-			       )
-			    );
-      }
+  int success = 0;
+  const int nd = b.nd;
+
+  tmpField<Complex> res(nd, LX, LY/2);
+  tmpField<Complex> tmp(nd, LX, LY/2);
+  tmpField<ComplexF> resF(nd, LX, LY/2);
+  tmpField<ComplexF> eF(nd, LX, LY/2);
+  tmpField<ComplexF> pF(nd, LX, LY/2);
+  tmpField<ComplexF> sF(nd, LX, LY/2);
+  tmpField<ComplexF> zF(nd, LX, LY/2);
+  tmpField<ComplexF> wF(nd, LX, LY/2);
+  tmpField<ComplexF> nF(nd, LX, LY/2);
+  tmpField<ComplexF> gaugeEOF;
+  ComplexF *r = resF.v, *e = eF.v, *pv = pF.v, *s = sF.v, *z = zF.v, *w = wF.v, *n = nF.v;
+  const long len = b.len;
+
+  double alpha = 0.0, alphaOld = 0.0, beta = 0.0, gamma, gammaOld = 0.0, delta, denom;
+  double rsqMax = 0, bnorm = 0.0;
+
+  // Find norm of rhs.
+  bnorm = norm2(b);
+  if(bnorm == 0 || bnorm != bnorm) {
+    cout << "Error in AinvpsiEOPipe: inverting on zero source... or nan!" << endl;
+    exit(0);
   }
-}
 
-void forceD(double*** fD, Complex*** gauge, Complex*** phi,
-	    Complex*** guess, param_t p){
-  
-  if(p.dynamic == true) {
+  // res = b - A*x0
+  copyField(x, x0);
+  copyField(res, b);
+  if(norm2(x0) != 0.0) {
+    DdagDpsiEO(tmp, x0, gaugeEO, param, par, denom);
+    axpy(-1.0, tmp, res);
+  }
 
-    zeroLat(fD);
+  convertField(gaugeEOF, gaugeEO);
+  convertField(resF, res);
+  zeroField(eF);
+  zeroField(pF);
+  zeroField(sF);
+  zeroField(zF);
+  DdagDpsiEO(wF, resF, gaugeEOF, param, par, delta);
+  gamma = norm2(res);
+  rsqMax = gamma;
+  double rsqMin = gamma;
+  bool restart = true, stalled = false;
 
-    Complex*** phip = gst.b13;
-    Complex*** g3Dphi = gst.b14;
+  // Iterate until convergence
+  int k;
+  for (k=0; k<param.maxIterCG; k++) {
 
-    //phip = (D^dagD)^-1 * phi
-    zeroField(phip);
-    
-    //Ainvpsi inverts using the DdagD (g3Dg3D) operator, returns
-    // phip = (D^-1 * Ddag^-1) phi = (D^-1 * g3 * D^-1 g3) phi.
-    //Complex guess[LX][LY][2]; //Initial guess to CG
-    zeroField(guess);
-    Ainvpsi(phip, phi, guess, gauge, p);
+    DdagDpsiEO(nF, wF, gaugeEOF, param, par, denom);
 
-    //g3Dphi = g3D * phip
-    zeroField(g3Dphi);
-    g3Dpsi(g3Dphi, phip, gauge, p);
+    if(restart) {
+      beta = 0.0;
+      alpha = gamma/delta;
+      restart = false;
+    } else {
+      beta = gamma/gammaOld;
+      alpha = gamma/(delta - beta*gamma/alphaOld);
+    }
+    gammaOld = gamma;
+    alphaOld = alpha;
 
-    int xp1, xm1, yp1, ym1;
-    double r = 1.0;
-    for(int x=0; x<LX; x++)
-      for(int y=0; y<LY; y++) {
+    // The recurrences, and gamma and delta of the new res and w, in one pass
+    const float a = alpha, bt = beta;
+    double g = 0.0, dl = 0.0;
+#pragma omp parallel for reduction(+:g,dl)
+    for(long l=0; l<len; l++) {
+      z[l] = n[l] + bt*z[l];
+      s[l] = w[l] + bt*s[l];
+      pv[l] = r[l] + bt*pv[l];
+      e[l] += a*pv[l];
+      r[l] -= a*s[l];
+      w[l] -= a*z[l];
+      g += norm(r[l]);
+      dl += real(conj(w[l])*r[l]);
+    }
+    gamma = g;
+    delta = dl;
+    if(gamma > rsqMax) rsqMax = gamma;
 
-	xp1 = (x+1)%LX;
-	yp1 = (y+1)%LY;
-	xm1 = (x-1+LX)%LX;
-	ym1 = (y-1+LY)%LY;	
-	
-	//mu = 0
-	//upper
-	// | r  1 | 
-	// | 1  r |
-	//lower
-	// | r -1 |
-	// | 1 -r |					
-	fD[x][y][0] += real(I*((conj(gauge[x][y][0]) *
-			       (conj(phip[xp1][y][0]) * (r*g3Dphi[x][y][0] +   g3Dphi[x][y][1]) -
-				conj(phip[xp1][y][1]) * (  g3Dphi[x][y][0] + r*g3Dphi[x][y][1])))
-			       -
-			       (gauge[x][y][0] *
-			       (conj(phip[x][y][0]) * (r*g3Dphi[xp1][y][0] -   g3Dphi[xp1][y][1]) +
-				conj(phip[x][y][1]) * (  g3Dphi[xp1][y][0] - r*g3Dphi[xp1][y][1])))
-			       )
-			    );	
-	
-	//mu = 1
-	//upper
-	// | r -i | 
-	// | i  r |
-	//lower
-	// | r  i |
-	// | i -r |
-	fD[x][y][1] += real(I*((conj(gauge[x][y][1]) *
-				(conj(phip[x][yp1][0]) * (r*g3Dphi[x][y][0] - I*g3Dphi[x][y][1]) -
-				 conj(phip[x][yp1][1]) * (I*g3Dphi[x][y][0] + r*g3Dphi[x][y][1])))
-			       -			       
-			       (gauge[x][y][1] *
-				(conj(phip[x][y][0]) * (r*g3Dphi[x][yp1][0] + I*g3Dphi[x][yp1][1]) +
-				 conj(phip[x][y][1]) * (I*g3Dphi[x][yp1][0] - r*g3Dphi[x][yp1][1])))
-			       )
-			    );
-      }
-  }
-}
+    if(gamma < tol*bnorm || gamma < RELIABLE_DELTA*RELIABLE_DELTA*rsqMax) {
 
-//Staggered
-int Ainvpsi(Complex psi[LX][LY], const Complex b[LX][LY], Complex psi0[LX][LY], const Complex gauge[LX][LY][2], param_t p) {
+      // Reliable update: x += e, res = b - A*x in double
+      convertField(tmp, eF);
+      axpy(1.0, tmp, x);
+      zeroField(eF);
+      DdagDpsiEO(tmp, x, gaugeEO, param, par, denom);
+      axpy(-1.0, tmp, b, res);
+      double rsqNew = norm2(res);
 
-  int success = 0;
-  
-  Complex res[LX][LY] , pvec[LX][LY], Apvec[LX][LY];
-  double alpha, beta, denom ;
-  double rsq = 0, rsqNew = 0, bsqrt = 0.0;
-  
-  //Intialize  
-  zeroField(res);
-  zeroField(Apvec);  
-  zeroField(pvec);
-  
-  // Find norm of rhs.
-  bsqrt = real(dotField(b,b));
-  bsqrt = sqrt(bsqrt);
-  
-  copyField(res, b); // res = b  - A psi0, for now start with phi0 = 0
-  copyField(pvec, res);
+      // Exit if the true residual is small enough, and hand over if it
+      // no longer falls
+      const int done = reliableExit(rsqNew, rsqMax, bnorm, x, tol);
+      if(done) {
+	gamma = rsqNew;
+	stalled = done < 0;
+	break;
+      }
+      if(rsqNew >= rsqMin) {
+	gamma = rsqNew;
+	stalled = true;
+	break;
+      }
+      rsqMax = rsqNew;
+      rsqMin = rsqNew;
+
+      // w = A res, s = A p and z = A s afresh, p kept. gamma and delta
+      // belong to the new res, and the next beta to the old one, so
+      // gammaOld is rescaled with it.
+      convertField(resF, res);
+      DdagDpsiEO(wF, resF, gaugeEOF, param, par, delta);
+      DdagDpsiEO(sF, pF, gaugeEOF, param, par, denom);
+      DdagDpsiEO(zF, sF, gaugeEOF, param, par, denom);
+      gammaOld *= rsqNew/gamma;
+      gamma = rsqNew;
+    }
+  }
 
-  rsq = real(dotField(res,res));
+  // x holds all of the iterations at a stall
+  if(stalled) {
+    param.maxIterCG -= k;
+    return AinvpsiEOReliable(x, b, x, gaugeEO, param, par, tol);
+  }
+
+  if(k == param.maxIterCG) {
+    // Failed convergence, keep what the float iterations found
+    convertField(tmp, eF);
+    axpy(1.0, tmp, x);
+    printf("CG: Failed to converge iter = %d, rsq = %.16e\n", k+1, gamma);
+    success = 0;
+  } else {
+    // Convergence
+    success = 1;
+  }
+
+  return success;
+}
+
+int AinvpsiEO(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &x0,
+	      const latField<Complex> &gaugeEO, param_t param, int par, double tol) {
+
+  if(CG_PIPE && omp_get_max_threads() >= CG_PIPE_THREADS)
+    return AinvpsiEOPipe(x, b, x0, gaugeEO, param, par, tol);
+  return AinvpsiEOReliable(x, b, x0, gaugeEO, param, par, tol);
+}
+
+// Wilson even-odd preconditioned inverter
+//---------------------------------------------------------------
+// Solves Dhat^dag Dhat x = b for the Schur complement Dhat on the EVEN
+// sites (see wilsonDhatEO). All fields are half fields.
+int AinvpsiWilsonEO(latField<Complex> &x, const latField<Complex> &b, latField<Complex> &x0,
+		    const latField<Complex> &gauge, param_t param) {
+
+  tmpField<Complex> gaugeEO;
+  checkerboardGauge(gaugeEO, gauge);
+  return AinvpsiEO(x, b, x0, gaugeEO, param, 0, param.eps);
+}
+
+//Staggered DdagD matrix inverter
+//---------------------------------------------------------------
+// DdagD is block diagonal in parity, so each parity of the source is
+// solved on its own half lattice. Pseudofermions live on the even sites
+// only, and the odd solve is then skipped.
+int AinvpsiStaggered(latField<Complex> &psi, const latField<Complex> &b, latField<Complex> &psi0,
+		     const latField<Complex> &gauge, param_t p) {
+
+  int success = 1;
+
+  tmpField<Complex> bh(1, LX, LY/2);
+  tmpField<Complex> psih(1, LX, LY/2);
+  tmpField<Complex> psih0(1, LX, LY/2);
+  tmpField<Complex> gaugeEO;
+  checkerboardGauge(gaugeEO, gauge);
+
+  // The staggered tolerance is on |res|, not |res|^2
+  for(int par=0; par<2; par++) {
+    extractParity(bh, b, par);
+    extractParity(psih0, psi0, par);
+    if(norm2(bh) == 0.0) zeroField(psih);
+    else success *= AinvpsiEO(psih, bh, psih0, gaugeEO, p, par, p.eps*p.eps);
+    insertParity(psi, psih, par);
+  }
   
-  // Compute Ap.
-  DdagDpsi(Apvec, pvec, gauge, p);
+  return success;
+}
+
+//Dispatch on the fermion layout: staggered fields have one component per site,
+//Wilson fields on one checkerboard (ny = LY/2) use the even-odd solver and
+//blocks of Wilson fields (nd > 2) the block solver.
+//---------------------------------------------------------------
+int Ainvpsi(latField<Complex> &x, const latField<Complex> &b, latField<Complex> &x0,
+	    const latField<Complex> &gauge, param_t param) {
+
+  auto start = high_resolution_clock::now();
+
+  int success;
+  if(b.nd == 1) success = AinvpsiStaggered(x, b, x0, gauge, param);
+  else if(b.ny == LY/2) success = AinvpsiWilsonEO(x, b, x0, gauge, param);
+  else if(b.nd > 2) success = AinvpsiBlock(x, b, x0, gauge, param);
+  else success = AinvpsiWilson(x, b, x0, gauge, param);
+
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.inv_time += duration.count();
+
+  return success;
+}
+
+// Chronological inverter
+//---------------------------------------------------------------
+// The force solves of a trajectory, A x = phi for the same phi, see a
+// gauge field that moves by O(dtau) per step, so their solutions barely
+// differ. chronoGuess keeps the last CHRONO_NSOL of them and starts the
+// next solve from the minimal residual extrapolation over their span
+// (Brower et al., hep-lat/9509012): with Q an orthonormal basis of the
+// span, x0 = Q c with (Q^dag A Q) c = Q^dag phi, which minimises the
+// A-norm of the error x - x0. This costs one A per basis vector. The
+// guess moves x only within the solver tolerance, so the reversibility
+// of the molecular dynamics holds to that precision.
+//
+// The basis also carries HMC_NEV estimates of the lowest eigenvectors of
+// A, so that the Galerkin projection deflates them from the initial
+// residual. They are built at the first solve of a trajectory by trLanczos
+// (lanczos.h) with a space of HMC_NLANCZOS vectors, to the loose tolerance
+// HMC_LANCZOS_TOL. At every solve they are refreshed
+// by Rayleigh-Ritz: the new estimates are the lowest eigenvectors of
+// Q^dag A Q, at the current links and over the old estimates together
+// with the stored solutions, which are rich in the low modes. The links
+// mix the nearly degenerate low modes quickly, and a Rayleigh-Ritz over
+// the old estimates alone does not follow them. Each estimate costs one
+// more A per solve. On 32^2 at m = 0.1 down to -0.06 the stored
+// solutions already carry most of the low mode content, so that 8 modes
+// save only 1-4% of the CG iterations, less than they cost. HMC_NEV is
+// therefore 0 (off) by default.
+//
+// A trajectory starts with an empty history, which is kept from the
+// first action solve to the last.
+
+#ifndef CHRONO_NSOL
+#define CHRONO_NSOL 7
+#endif
+#ifndef HMC_NEV
+#define HMC_NEV 0
+#endif
+#ifndef HMC_NLANCZOS
+#define HMC_NLANCZOS 48
+#endif
+#ifndef HMC_LANCZOS_TOL
+#define HMC_LANCZOS_TOL 1e-2
+#endif
+
+class chronoGuess {
+
+public:
+  vector<latField<Complex> *> sol;   // Oldest first
+  vector<latField<Complex> *> modes; // Low mode estimates, lowest first
+
+  chronoGuess() {}
+  ~chronoGuess() {
+    for(auto s : sol) delete s;
+    for(auto v : modes) delete v;
+  }
+
+  chronoGuess(const chronoGuess &) = delete;
+  chronoGuess &operator=(const chronoGuess &) = delete;
+
+  void add(const latField<Complex> &x) {
+    latField<Complex> *s;
+    if((int)sol.size() == CHRONO_NSOL) {
+      s = sol.front();
+      sol.erase(sol.begin());
+    }
+    else s = new latField<Complex>(x.nd, x.nx, x.ny);
+    copyField(*s, x);
+    sol.push_back(s);
+  }
+
+  void predict(latField<Complex> &x0, const latField<Complex> &b,
+	       const latField<Complex> &gauge, param_t param) {
+
+    zeroField(x0);
+    if(HMC_NEV > 0 && modes.empty()) lowModes(b, gauge, param);
+
+    // Orthonormalise the low modes and then the solutions, newest
+    // first, dropping near dependent vectors
+    vector<latField<Complex> *> basis(modes.begin(), modes.end());
+    basis.insert(basis.end(), sol.rbegin(), sol.rend());
+    vector<tmpField<Complex> *> Q;
+    vector<latField<Complex> *> QL;
+    vector<Complex> h(basis.size());
+    for(auto v : basis) {
+      tmpField<Complex> *q = new tmpField<Complex>(b.nd, b.nx, b.ny);
+      copyField(*q, *v);
+      double snorm = norm2(*q);
+      double qnorm = orthogonalise(h, *q, QL.data(), QL.size(), snorm);
+      if(qnorm*qnorm > 1e-12*snorm) {
+	ax(1.0/qnorm, *q);
+	Q.push_back(q);
+	QL.push_back(q);
+      }
+      else delete q;
+    }
+    const int n = Q.size();
+    if(n == 0) return;
+
+    // Q^dag A Q = Z diag(theta) Z^dag, c = Z diag(1/theta) Z^dag Q^dag b
+    vector<Complex> G(n*n), r(n), Z, c(n, 0.0);
+    vector<double> theta;
+    tmpField<Complex> AQ(b.nd, b.nx, b.ny);
+    tmpField<Complex> gaugeEO;
+    if(b.nd == 2 && b.ny == LY/2) checkerboardGauge(gaugeEO, gauge);
+    for(int j=0; j<n; j++) {
+      Apsi(AQ, *Q[j], gauge, gaugeEO, param);
+      for(int i=0; i<=j; i++) {
+	G[i*n + j] = dotField(*Q[i], AQ);
+	G[j*n + i] = conj(G[i*n + j]);
+      }
+      r[j] = dotField(*Q[j], b);
+    }
+    hermEig(theta, Z, G, n);
+    for(int j=0; j<n; j++) {
+      if(!(theta[j] > 0.0)) continue;
+      Complex zr = 0.0;
+      for(int i=0; i<n; i++) zr += conj(Z[i*n + j])*r[i];
+      for(int i=0; i<n; i++) c[i] += Z[i*n + j]*zr/theta[j];
+    }
+    for(int i=0; i<n; i++) caxpy(c[i], *Q[i], x0);
+
+    // Rayleigh-Ritz refresh of the low modes
+    if(HMC_NEV > 0) {
+      for(int j=modes.size(); j<min(HMC_NEV, n); j++)
+	modes.push_back(new latField<Complex>(b.nd, b.nx, b.ny));
+      combineFields(modes, QL, Z, n);
+    }
+    for(auto q : Q) delete q;
+  }
+
+private:
+
+  // The HMC_NEV lowest eigenvectors of A, to HMC_LANCZOS_TOL
+  void lowModes(const latField<Complex> &b, const latField<Complex> &gauge, param_t param) {
+
+    param.nEv = HMC_NEV;
+    param.nKr = HMC_NLANCZOS;
+    param.arpackTol = HMC_LANCZOS_TOL;
+    param.polyACC = 0;
+    latField<Complex> evecs(b.nd*HMC_NEV, b.nx, b.ny);
+    vector<Complex> evals(HMC_NEV);
+    trLanczos(evecs, evals.data(), gauge, param);
+    for(int i=0; i<HMC_NEV; i++) {
+      modes.push_back(new latField<Complex>(b.nd, b.nx, b.ny));
+      extractBlock(*modes[i], evecs, i);
+    }
+  }
+};
+
+//As Ainvpsi, starting from the chronological guess, which then keeps x
+int Ainvpsi(latField<Complex> &x, const latField<Complex> &b, chronoGuess &chrono,
+	    const latField<Complex> &gauge, param_t param) {
+
+  auto start = high_resolution_clock::now();
+  tmpField<Complex> x0(b.nd, b.nx, b.ny);
+  chrono.predict(x0, b, gauge, param);
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.inv_time += duration.count();
+
+  int success = Ainvpsi(x, b, x0, gauge, param);
+  chrono.add(x);
+  return success;
+}
+
+// EigCG
+//---------------------------------------------------------------
+// The point sources of measVacuumTrace are many right hand sides of
+// A x = b on one gauge field, all slowed down by the same low modes of A.
+// eigCG (Stathopoulos and Orginos, arXiv:0707.0131) finds those modes
+// during the CG runs themselves. The CG coefficients give the Lanczos
+// tridiagonal T of A on the normalised residuals v = r/|r|. These are
+// kept in a search space V of EIGCG_M vectors. When V fills, it is
+// restarted to the 2 EIGCG_NEV lowest Ritz vectors of T and of T without
+// its last row and column. The EIGCG_NEV lowest Ritz vectors at
+// convergence join the deflation space U, until U holds EIGCG_UMAX
+// vectors; U is kept as Ritz vectors of A.
+//
+// Every solve starts from x0 = U (U^dag A U)^-1 U^dag b. The deflation
+// fades as CG converges past the accuracy of U, so a solve is restarted
+// once from the same projection of its residual, when that falls below
+// EIGCG_RESTART |b| (init-CG). On 32^2 at m = -0.05 this brings the
+// vacuum trace solves from 388 CG iterations down to 180 (70 with
+// EIGCG_UMAX 256); at m = 0.1 the gain is small.
+
+#ifndef EIGCG_NEV
+#define EIGCG_NEV 8
+#endif
+#ifndef EIGCG_M
+#define EIGCG_M 24
+#endif
+#ifndef EIGCG_UMAX
+#define EIGCG_UMAX 64
+#endif
+#ifndef EIGCG_RESTART
+#define EIGCG_RESTART 1e-4
+#endif
+
+class eigCG {
+
+public:
+  vector<latField<Complex> *> U; // Deflation space
+  vector<double> lambda;         // Its Ritz values
+
+  eigCG() {}
+  ~eigCG() { for(auto u : U) delete u; }
+
+  eigCG(const eigCG &) = delete;
+  eigCG &operator=(const eigCG &) = delete;
+
+  // x += U (U^dag A U)^-1 U^dag r, in one pass for the dot products and
+  // one for the update
+  void project(latField<Complex> &x, const latField<Complex> &r) {
+
+    const int n = U.size();
+    if(n == 0) return;
+    vector<Complex> c(n);
+    projectFields(c, U.data(), n, r);
+    for(int i=0; i<n; i++) c[i] = -c[i]/lambda[i];
+    subtractFields(x, U.data(), n, c);
+  }
+
+  // Rayleigh-Ritz of A over U and W
+  void extend(vector<latField<Complex> *> &W, const latField<Complex> &gauge, param_t param) {
+
+    vector<latField<Complex> *> X(U.begin(), U.end());
+    const int nu = U.size();
+    vector<Complex> h(nu + W.size());
+    for(auto w : W) {
+      latField<Complex> *q = new latField<Complex>(w->nd, w->nx, w->ny);
+      copyField(*q, *w);
+      double wnorm = norm2(*q);
+      double qnorm = orthogonalise(h, *q, X.data(), X.size(), wnorm);
+      if(qnorm*qnorm > 1e-12*wnorm && (int)X.size() < EIGCG_UMAX) {
+	ax(1.0/qnorm, *q);
+	X.push_back(q);
+      }
+      else delete q;
+    }
+    const int n = X.size();
+    if(n == nu) return;
+
+    vector<Complex> H(n*n, 0.0), Z;
+    for(int i=0; i<nu; i++) H[i*n + i] = lambda[i];
+    tmpField<Complex> AX(X[0]->nd, X[0]->nx, X[0]->ny);
+    for(int j=nu; j<n; j++) {
+      DdagDpsi(AX, *X[j], gauge, param);
+      for(int i=0; i<=j; i++) {
+	H[i*n + j] = dotField(*X[i], AX);
+	H[j*n + i] = conj(H[i*n + j]);
+      }
+    }
+    hermEig(lambda, Z, H, n);
+    combineFields(X, X, Z, n);
+    U = X;
+  }
+
+  int solve(latField<Complex> &x, const latField<Complex> &b,
+	    const latField<Complex> &gauge, param_t param) {
+
+    auto start = high_resolution_clock::now();
+    int success = 0;
+    const int m = EIGCG_M, nev = EIGCG_NEV;
+
+    tmpField<Complex> res, p, Ap, ApOld;
+
+    double bnorm = norm2(b);
+    if(bnorm == 0 || bnorm != bnorm) {
+      cout << "Error in eigCG: inverting on zero source... or nan!" << endl;
+      exit(0);
+    }
+
+    // Deflated guess
+    zeroField(x);
+    copyField(res, b);
+    if(!U.empty()) {
+      project(x, b);
+      DdagDpsi(Ap, x, gauge, param);
+      axpy(-1.0, Ap, res);
+    }
+    copyField(p, res);
+    double rsq = norm2(res);
+
+    // Search space and the Lanczos matrix on it, while U has room
+    bool collect = (int)U.size() + nev <= EIGCG_UMAX && m > 2*nev;
+    bool restarted = U.empty();
+    vector<tmpField<Complex> *> V;
+    vector<Complex> T;
+    if(collect) {
+      for(int i=0; i<m; i++) V.push_back(new tmpField<Complex>(b.nd, b.nx, b.ny));
+      T.assign(m*m, 0.0);
+    }
+    int vs = 0;
+    bool arrow = false;
+    double alpha, beta = 0.0, alphaOld = 1.0, betaOld = 0.0, denom;
+
+    int k;
+    for(k=0; k<param.maxIterCG; k++) {
+
+      DdagDpsi(Ap, p, gauge, param, denom);
+      alpha = rsq/denom;
+
+      if(collect) {
+	if(vs == m) {
+	  thickRestart(V, T, vs);
+	  arrow = true;
+	}
+	const double rnorm = sqrt(rsq);
+	copyField(*V[vs], res);
+	ax(1.0/rnorm, *V[vs]);
+	T[vs*m + vs] = 1.0/alpha + (vs > 0 ? betaOld/alphaOld : 0.0);
+	if(arrow) {
+	  // A v = (Ap - beta_old Ap_old)/|r| couples v to all of V
+	  axpy(-betaOld, ApOld, Ap, ApOld);
+	  ax(1.0/rnorm, ApOld);
+	  for(int i=0; i<vs; i++) {
+	    T[i*m + vs] = dotField(*V[i], ApOld);
+	    T[vs*m + i] = conj(T[i*m + vs]);
+	  }
+	  arrow = false;
+	}
+	else if(vs > 0) T[(vs-1)*m + vs] = T[vs*m + vs-1] = -sqrt(betaOld)/alphaOld;
+	vs++;
+	if(vs == m) copyField(ApOld, Ap);
+      }
+
+      axpy( alpha, p,  x);
+      axpy(-alpha, Ap, res);
+
+      double rsqNew = norm2(res);
+      if(rsqNew < param.eps*bnorm) {
+	rsq = rsqNew;
+	break;
+      }
+
+      beta = rsqNew/rsq;
+      rsq = rsqNew;
+
+      // init-CG restart: deflate the residual once more
+      if(!restarted && rsq < EIGCG_RESTART*EIGCG_RESTART*bnorm) {
+	if(collect) {
+	  addRitz(V, T, vs, gauge, param);
+	  collect = false;
+	}
+	project(x, res);
+	DdagDpsi(Ap, x, gauge, param);
+	axpy(-1.0, Ap, b, res);
+	copyField(p, res);
+	rsq = norm2(res);
+	restarted = true;
+	continue;
+      }
+
+      axpy(beta, p, res, p);
+      alphaOld = alpha;
+      betaOld = beta;
+    }
+
+    if(k == param.maxIterCG) {
+      printf("eigCG: Failed to converge iter = %d, rsq = %.16e\n", k+1, rsq);
+      success = 0;
+    }
+    else success = 1;
+
+    if(collect) addRitz(V, T, vs, gauge, param);
+    for(auto v : V) delete v;
+
+    auto stop = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(stop - start);
+    gst.inv_time += duration.count();
+
+    return success;
+  }
+
+private:
+
+  // Restart V to the 2 nev lowest Ritz vectors of T and of T without
+  // its last row and column, on which T is diagonal.
+  void thickRestart(vector<tmpField<Complex> *> &V, vector<Complex> &T, int &vs) {
+
+    const int m = vs, nev = EIGCG_NEV;
+    vector<Complex> Tm1((m-1)*(m-1)), Y, Y1;
+    vector<double> theta;
+    for(int i=0; i<m-1; i++)
+      for(int j=0; j<m-1; j++) Tm1[i*(m-1) + j] = T[i*m + j];
+    hermEig(theta, Y, T, m);
+    hermEig(theta, Y1, Tm1, m-1);
+
+    // Orthonormal basis of the 2 nev Ritz vectors in C^m, column major
+    vector<vector<Complex>> Q;
+    for(int c=0; c<2*nev; c++) {
+      vector<Complex> q(m, 0.0);
+      for(int i=0; i<m; i++) q[i] = c < nev ? Y[i*m + c] : (i < m-1 ? Y1[i*(m-1) + c-nev] : 0.0);
+      for(int pass=0; pass<2; pass++)
+	for(auto &qj : Q) {
+	  Complex d = 0.0;
+	  for(int i=0; i<m; i++) d += conj(qj[i])*q[i];
+	  for(int i=0; i<m; i++) q[i] -= d*qj[i];
+	}
+      double qnorm = 0.0;
+      for(int i=0; i<m; i++) qnorm += norm(q[i]);
+      if(qnorm < 1e-20) continue;
+      for(int i=0; i<m; i++) q[i] /= sqrt(qnorm);
+      Q.push_back(q);
+    }
+    const int n = Q.size();
+
+    // H = Q^dag T Q = Z diag(theta) Z^dag, V <- V Q Z
+    vector<Complex> TQ(m*n, 0.0), H(n*n, 0.0), Z, C(m*n, 0.0);
+    for(int i=0; i<m; i++)
+      for(int j=0; j<m; j++)
+	for(int c=0; c<n; c++) TQ[i*n + c] += T[i*m + j]*Q[c][j];
+    for(int a=0; a<n; a++)
+      for(int c=0; c<n; c++)
+	for(int i=0; i<m; i++) H[a*n + c] += conj(Q[a][i])*TQ[i*n + c];
+    hermEig(theta, Z, H, n);
+    for(int i=0; i<m; i++)
+      for(int c=0; c<n; c++)
+	for(int a=0; a<n; a++) C[i*n + c] += Q[a][i]*Z[a*n + c];
+
+    vector<latField<Complex> *> X(V.begin(), V.end()), Y0(V.begin(), V.begin() + n);
+    combineFields(Y0, X, C, n);
+    T.assign(T.size(), 0.0);
+    for(int i=0; i<n; i++) T[i*EIGCG_M + i] = theta[i];
+    vs = n;
+  }
+
+  // Add the nev lowest Ritz vectors of T on V to U
+  void addRitz(vector<tmpField<Complex> *> &V, const vector<Complex> &T, int vs,
+	       const latField<Complex> &gauge, param_t param) {
+
+    const int nev = min(EIGCG_NEV, vs);
+    if(nev == 0) return;
+    vector<Complex> Tv(vs*vs), Y;
+    vector<double> theta;
+    for(int i=0; i<vs; i++)
+      for(int j=0; j<vs; j++) Tv[i*vs + j] = T[i*EIGCG_M + j];
+    hermEig(theta, Y, Tv, vs);
+
+    vector<latField<Complex> *> X(V.begin(), V.begin() + vs), W;
+    for(int j=0; j<nev; j++) W.push_back(new latField<Complex>(V[0]->nd, V[0]->nx, V[0]->ny));
+    combineFields(W, X, Y, vs);
+    extend(W, gauge, param);
+    for(auto w : W) delete w;
+  }
+};
+
+// Shadow residual for the BiCGStab solvers. A point source is orthogonal
+// to the first residuals (the Wilson spin projectors cancel), so the
+// shadow residual is random. It has its own generator so that the HMC
+// random stream is not disturbed.
+void randomShadow(latField<Complex> &rt) {
+  unsigned short seed[3] = {1234, 5678, 9012};
+  for(long j=0; j<rt.len; j++) rt.v[j] = Complex(erand48(seed) - 0.5, erand48(seed) - 0.5);
+}
+
+// Multi-shift inverter
+//---------------------------------------------------------------
+// Solves D(m_i) x_i = b for a list of valence masses in one Krylov
+// space. The mass enters the Wilson operator as 2 + m times the identity,
+// so D(m_i) = D(m_0) + sigma_i with sigma_i = m_i - m_0, and the Krylov
+// spaces of all the shifted systems coincide. BiCGStab runs on the
+// lightest mass m_0 and the shifted residuals stay collinear with the
+// base residual, r_i = zeta_i rho_i r, with zeta_i carrying the BiCG
+// polynomial and rho_i the stabilising polynomial (Jegerlehner,
+// hep-lat/9612014). Each extra mass costs two vectors and a few axpys per
+// iteration, no matrix-vector products, and is frozen once its residual
+// |r_i|^2 < eps |b|^2. The shifted recurrences need a common starting
+// residual, so there is no initial guess. The solutions are full Wilson
+// fields.
+int DinvpsiMultiShift(const vector<latField<Complex> *> &x, const latField<Complex> &b, const vector<double> &mass,
+		      const latField<Complex> &gauge, param_t param) {
+
+  auto start = high_resolution_clock::now();
+
+  const int nShift = mass.size();
+  int success = 0;
+
+  tmpField<Complex> res(b.nd, b.nx, b.ny);
+  tmpField<Complex> rt(b.nd, b.nx, b.ny);
+  tmpField<Complex> p(b.nd, b.nx, b.ny);
+  tmpField<Complex> Ap(b.nd, b.nx, b.ny);
+  tmpField<Complex> s(b.nd, b.nx, b.ny);
+  tmpField<Complex> As(b.nd, b.nx, b.ny);
+  vector<tmpField<Complex> *> ps(nShift);
+  for(auto &f : ps) f = new tmpField<Complex>(b.nd, b.nx, b.ny);
+
+  // The base system is the lightest mass
+  double m0 = mass[0];
+  for(int i=1; i<nShift; i++) m0 = min(m0, mass[i]);
+  param.m = m0;
+
+  vector<double> sigma(nShift);
+  vector<Complex> zeta(nShift, 1.0), zetaOld(nShift, 1.0), rho(nShift, 1.0);
+  vector<bool> active(nShift, true);
+
+  double bnorm = norm2(b);
+  if(bnorm == 0 || bnorm != bnorm) {
+    cout << "Error in DinvpsiMultiShift: inverting on zero source... or nan!" << endl;
+    exit(0);
+  }
+
+  randomShadow(rt);
+
+  copyField(res, b);
+  copyField(p, b);
+  for(int i=0; i<nShift; i++) {
+    sigma[i] = mass[i] - m0;
+    zeroField(*x[i]);
+    copyField(*ps[i], b);
+  }
+
+  Complex alpha, alphaOld = 1.0, beta = 0.0, betaOld = 0.0, omega;
+  Complex rtr = dotField(rt, res);
+  double rsq = bnorm;
+  int nActive = nShift;
+
+  vector<Complex> cx(nShift), cxs(nShift), cpp(nShift), cpr(nShift), cps(nShift), cpa(nShift);
+  vector<Complex*> xa(nShift), pa(nShift);
 
-  // iterate till convergence
   int k;
-  for (k=0; k<p.maxIterCG; k++) {
-    
-    denom = real(dotField(pvec,Apvec));
-    alpha = rsq/denom;
+  for(k=0; k<param.maxIterCG && nActive > 0; k++) {
 
-    axpy( alpha, pvec, psi);
-    axpy(-alpha, Apvec, res);
-    
-    // Exit if new residual is small enough
-    rsqNew = real(dotField(res,res));
-    
-    if (sqrt(rsqNew) < p.eps*bsqrt) {
-      //printf("Final rsq = %g\n", rsqNew);
-      break;
+    Dpsi(Ap, p, gauge, param);
+    alpha = rtr/dotField(rt, Ap);
+    caxpby(-alpha, Ap, Complex(1.0), res, s);
+
+    Dpsi(As, s, gauge, param);
+    double re = 0.0, im = 0.0, asq = 0.0;
+#pragma omp parallel for reduction(+:re,im,asq)
+    for(long j=0; j<b.len; j++) {
+      Complex prod = conj(As.v[j])*s.v[j];
+      re += prod.real();
+      im += prod.imag();
+      asq += norm(As.v[j]);
     }
-    
-    // Update vec using new residual
-    beta = rsqNew / rsq;
+    omega = Complex(re, im)/asq;
+
+    // res = s - omega As, with |res|^2 and <rt, res> in the same pass
+    double rsqNew = 0.0;
+    re = 0.0;
+    im = 0.0;
+#pragma omp parallel for reduction(+:re,im,rsqNew)
+    for(long j=0; j<b.len; j++) {
+      res.v[j] = s.v[j] - omega*As.v[j];
+      Complex prod = conj(rt.v[j])*res.v[j];
+      re += prod.real();
+      im += prod.imag();
+      rsqNew += norm(res.v[j]);
+    }
+    if(rsqNew != rsqNew) break;
+
+    Complex rtrNew(re, im);
+    beta = (alpha/omega)*(rtrNew/rtr);
+
+    // Shifted BiCG and stabiliser coefficients. The old residual is
+    // r = s + alpha Ap, so r_i, s_i and the new r_i are all combinations
+    // of res, s and Ap.
+    int nUp = 0;
+    for(int i=0; i<nShift; i++) {
+      if(!active[i]) continue;
+
+      Complex zetaNew = zeta[i]*zetaOld[i]*alphaOld /
+	(zetaOld[i]*alphaOld*(1.0 + alpha*sigma[i]) + alpha*betaOld*(zetaOld[i] - zeta[i]));
+      Complex alphaS = alpha*zetaNew/zeta[i];
+      Complex omegaS = omega/(1.0 + omega*sigma[i]);
+      Complex rhoNew = rho[i]/(1.0 + omega*sigma[i]);
+      Complex betaS = beta*(zetaNew/zeta[i])*(zetaNew/zeta[i]);
+
+      const Complex cr = zeta[i]*rho[i];
+      const Complex cs = zetaNew*rho[i];
+      const Complex crNew = zetaNew*rhoNew;
+      const Complex cp = betaS*omegaS/alphaS;
+
+      // x_i += alpha_i p_i + omega_i s_i
+      // p_i  = r_i,new + beta_i (p_i - omega_i (r_i - s_i)/alpha_i)
+      xa[nUp] = x[i]->v;
+      pa[nUp] = ps[i]->v;
+      cx[nUp] = alphaS;
+      cxs[nUp] = omegaS*cs;
+      cpp[nUp] = betaS;
+      cpr[nUp] = crNew;
+      cps[nUp] = -cp*(cr - cs);
+      cpa[nUp] = -cp*cr*alpha;
+      nUp++;
+
+      zetaOld[i] = zeta[i];
+      zeta[i] = zetaNew;
+      rho[i] = rhoNew;
+
+      if(norm(crNew)*rsqNew < param.eps*bnorm) {
+	active[i] = false;
+	nActive--;
+      }
+    }
+
+    // All shifts and the base direction in one sweep, so that res, s and
+    // Ap are read once per iteration.
+#pragma omp parallel for
+    for(long j=0; j<b.len; j++) {
+      const Complex rj = res.v[j], sj = s.v[j], apj = Ap.v[j];
+      for(int i=0; i<nUp; i++) {
+	const Complex pij = pa[i][j];
+	xa[i][j] += cx[i]*pij + cxs[i]*sj;
+	pa[i][j] = cpr[i]*rj + cpp[i]*pij + cps[i]*sj + cpa[i]*apj;
+      }
+      p.v[j] = rj + beta*(p.v[j] - omega*apj);
+    }
+
+    alphaOld = alpha;
+    betaOld = beta;
+    rtr = rtrNew;
     rsq = rsqNew;
-    
-    axpy(beta, pvec, res, pvec);
-    
-    // Compute the new Ap.
-    DdagDpsi(Apvec, pvec, gauge,p);  
   }
-  //End loop over k
 
-  if(k == p.maxIterCG) {
-    printf("CG: Failed to converge iter = %d, rsq = %e\n", k,rsq); 
-    success = 0; // Failed convergence 
+  if(nActive > 0) {
+    printf("BiCGStab-M: Failed to converge iter = %d, rsq = %.16e\n", k, rsq);
+    success = 0;
+  } else {
+    success = 1;
+  }
+
+  for(auto f : ps) delete f;
+
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.inv_time += duration.count();
+
+  return success;
+}
+
+// Non-hermitian inverters
+//---------------------------------------------------------------
+// Solve D x = b with the Wilson operator itself rather than the normal
+// equations D^dag D x = D^dag b, whose condition number is the square of
+// that of D. For propagators that only need D^-1 (the point sources of
+// the pion and vacuum trace measurements). Both converge when
+// |b - D x|^2 < eps |b|^2 and take full Wilson fields.
+
+// BiCGStab (van der Vorst), two applications of D per iteration.
+int DinvpsiBiCGStab(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &x0,
+		    const latField<Complex> &gauge, param_t param) {
+
+  int success = 0;
+
+  tmpField<Complex> res;
+  tmpField<Complex> rt;
+  tmpField<Complex> p;
+  tmpField<Complex> Ap;
+  tmpField<Complex> s;
+  tmpField<Complex> As;
+
+  double bnorm = norm2(b);
+  if(bnorm == 0 || bnorm != bnorm) {
+    cout << "Error in DinvpsiBiCGStab: inverting on zero source... or nan!" << endl;
+    exit(0);
+  }
+
+  // res = b - D x0
+  copyField(x, x0);
+  copyField(res, b);
+  if(norm2(x0) != 0.0) {
+    Dpsi(Ap, x0, gauge, param);
+    axpy(-1.0, Ap, res);
+  }
+
+  randomShadow(rt);
+  copyField(p, res);
+  Complex rtr = dotField(rt, res);
+  Complex alpha, omega, beta;
+  double rsq = norm2(res);
+
+  int k;
+  for(k=0; k<param.maxIterCG && rsq >= param.eps*bnorm; k++) {
+
+    Dpsi(Ap, p, gauge, param);
+    alpha = rtr/dotField(rt, Ap);
+    caxpby(-alpha, Ap, Complex(1.0), res, s);
+
+    // omega = <As, s>/|As|^2
+    Dpsi(As, s, gauge, param);
+    double re = 0.0, im = 0.0, asq = 0.0;
+#pragma omp parallel for reduction(+:re,im,asq)
+    for(long j=0; j<b.len; j++) {
+      Complex prod = cdagtimes(As.v[j], s.v[j]);
+      re += prod.real();
+      im += prod.imag();
+      asq += norm(As.v[j]);
+    }
+    omega = Complex(re, im)/asq;
+
+    // x += alpha p + omega s, res = s - omega As, with |res|^2 and
+    // <rt, res> in the same pass
+    double rsqNew = 0.0;
+    re = 0.0;
+    im = 0.0;
+#pragma omp parallel for reduction(+:re,im,rsqNew)
+    for(long j=0; j<b.len; j++) {
+      x.v[j] += ctimes(alpha, p.v[j]) + ctimes(omega, s.v[j]);
+      res.v[j] = s.v[j] - ctimes(omega, As.v[j]);
+      Complex prod = cdagtimes(rt.v[j], res.v[j]);
+      re += prod.real();
+      im += prod.imag();
+      rsqNew += norm(res.v[j]);
+    }
+    if(rsqNew != rsqNew) break;
+    rsq = rsqNew;
+
+    // p = res + beta (p - omega Ap)
+    Complex rtrNew(re, im);
+    beta = (alpha/omega)*(rtrNew/rtr);
+    rtr = rtrNew;
+#pragma omp parallel for
+    for(long j=0; j<b.len; j++) p.v[j] = res.v[j] + ctimes(beta, p.v[j] - ctimes(omega, Ap.v[j]));
+  }
+
+  if(!(rsq < param.eps*bnorm)) {
+    printf("BiCGStab: Failed to converge iter = %d, rsq = %.16e\n", k, rsq);
+    success = 0;
+  } else {
+    success = 1;
+  }
+  return success;
+}
+
+// Restarted GCR, one application of D per iteration. Each new direction
+// D p_j is orthogonalised against the previous ones, so x minimises the
+// residual over all of them. The directions are dropped, and the
+// residual recomputed, every GCR_NKRYLOV iterations. The projections are
+// classical Gram-Schmidt, all taken in one pass over the fields. On the
+// 2D Wilson operator a longer basis hardly lowers the iteration count
+// and its projections cost more than D itself, so it is kept short.
+
+#ifndef GCR_NKRYLOV
+#define GCR_NKRYLOV 4
+#endif
+
+int DinvpsiGCR(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &x0,
+	       const latField<Complex> &gauge, param_t param) {
+
+  int success = 0;
+
+  tmpField<Complex> p[GCR_NKRYLOV];
+  tmpField<Complex> Ap[GCR_NKRYLOV];
+  double ApNorm[GCR_NKRYLOV];
+  Complex *pv[GCR_NKRYLOV], *Apv[GCR_NKRYLOV];
+  for(int i=0; i<GCR_NKRYLOV; i++) {
+    pv[i] = p[i].v;
+    Apv[i] = Ap[i].v;
+  }
+  tmpField<Complex> res;
+
+  double bnorm = norm2(b);
+  if(bnorm == 0 || bnorm != bnorm) {
+    cout << "Error in DinvpsiGCR: inverting on zero source... or nan!" << endl;
+    exit(0);
+  }
+
+  copyField(x, x0);
+  copyField(res, b);
+  if(norm2(x0) != 0.0) {
+    Dpsi(Ap[0], x0, gauge, param);
+    axpy(-1.0, Ap[0], res);
+  }
+  double rsq = norm2(res);
+
+  int k;
+  for(k=0; k<param.maxIterCG && rsq >= param.eps*bnorm; k++) {
+
+    const int j = k%GCR_NKRYLOV;
+    if(j == 0 && k > 0) {
+      // Restart on the true residual
+      Dpsi(Ap[0], x, gauge, param);
+      axpy(-1.0, Ap[0], b, res);
+    }
+
+    copyField(p[j], res);
+    Dpsi(Ap[j], p[j], gauge, param);
+
+    // c_i = <D p_i, D p_j>/|D p_i|^2
+    double cre[GCR_NKRYLOV] = {}, cim[GCR_NKRYLOV] = {};
+    if(j > 0) {
+#pragma omp parallel for reduction(+:cre[:GCR_NKRYLOV],cim[:GCR_NKRYLOV])
+      for(long l=0; l<b.len; l++)
+	for(int i=0; i<j; i++) {
+	  Complex prod = cdagtimes(Apv[i][l], Apv[j][l]);
+	  cre[i] += prod.real();
+	  cim[i] += prod.imag();
+	}
+    }
+    Complex c[GCR_NKRYLOV];
+    for(int i=0; i<j; i++) c[i] = Complex(cre[i], cim[i])/ApNorm[i];
+
+    // D p_j -= sum_i c_i D p_i, likewise p_j, with |D p_j|^2 and
+    // <D p_j, res> in the same pass
+    double an = 0.0, are = 0.0, aim = 0.0;
+#pragma omp parallel for reduction(+:an,are,aim)
+    for(long l=0; l<b.len; l++) {
+      Complex apl = Apv[j][l], pl = pv[j][l];
+      for(int i=0; i<j; i++) {
+	apl -= ctimes(c[i], Apv[i][l]);
+	pl -= ctimes(c[i], pv[i][l]);
+      }
+      Apv[j][l] = apl;
+      pv[j][l] = pl;
+      an += norm(apl);
+      Complex prod = cdagtimes(apl, res.v[l]);
+      are += prod.real();
+      aim += prod.imag();
+    }
+    ApNorm[j] = an;
+
+    // x += a p_j, res -= a D p_j
+    Complex a = Complex(are, aim)/an;
+    double rsqNew = 0.0;
+#pragma omp parallel for reduction(+:rsqNew)
+    for(long l=0; l<b.len; l++) {
+      x.v[l] += ctimes(a, pv[j][l]);
+      res.v[l] -= ctimes(a, Apv[j][l]);
+      rsqNew += norm(res.v[l]);
+    }
+    if(rsqNew != rsqNew) break;
+    rsq = rsqNew;
   }
+
+  if(!(rsq < param.eps*bnorm)) {
+    printf("GCR: Failed to converge iter = %d, rsq = %.16e\n", k, rsq);
+    success = 0;
+  } else {
+    success = 1;
+  }
+
+  return success;
+}
+
+//Solves D x = b with the solver picked for a measurement (SOLVER_*).
+//SOLVER_CG goes through the normal equations, D^dag D x = D^dag b, with
+//D^dag = g3 D g3. SOLVER_MG is the multigrid solver, whose setup is kept
+//in mgWilson, and SOLVER_SAP flexible GCR with the Schwarz preconditioner.
+int Dinvpsi(latField<Complex> &x, const latField<Complex> &b, latField<Complex> &x0,
+	    const latField<Complex> &gauge, param_t param, int solver) {
+
+  if(solver == SOLVER_CG) {
+    tmpField<Complex> g3b;
+    tmpField<Complex> Ddagb;
+    g3psi(g3b, b);
+    g3Dpsi(Ddagb, g3b, gauge, param);
+    return Ainvpsi(x, Ddagb, x0, gauge, param);
+  }
+
+  auto start = high_resolution_clock::now();
+
+  int success = 0;
+  if(solver == SOLVER_GCR) success = DinvpsiGCR(x, b, x0, gauge, param);
+  else if(solver == SOLVER_MG) success = mgWilson.solve(x, b, x0, gauge, param);
+  else if(solver == SOLVER_SAP) success = DinvpsiSAP(x, b, x0, gauge, param);
+  else if(solver == SOLVER_BICGSTAB) success = DinvpsiBiCGStab(x, b, x0, gauge, param);
   else {
-    success = 1; // Convergence 
-    k++;
+    cout << "Error in Dinvpsi: unknown solver " << solver << endl;
+    exit(0);
   }
 
-  DdagDpsi(Apvec, psi, gauge,p);
-  axpy(-1.0, Apvec, b, res);
-  
-  //double truersq =  real(dotField(res,res));
-  //printf("CG: Converged iter = %d, rsq = %e, truersq = %e\n",k,rsq,truersq);
+  auto stop = high_resolution_clock::now();
+  auto duration = duration_cast<microseconds>(stop - start);
+  gst.inv_time += duration.count();
+
   return success;
 }
 
-void forceD(double fD[LX][LY][2], Complex gauge[LX][LY][2], Complex phi[LX][LY],
-	    Complex guess[LY][LX], param_t p) {
+//Solves Dhat x = b on the EVEN sites (see wilsonDhatEO) with a full
+//lattice solver for D: D (x, kappa H_oe x) = (m0 + 2) (b, 0).
+int DhatInvpsi(latField<Complex> &x, const latField<Complex> &b,
+	       const latField<Complex> &gauge, param_t param, int solver) {
 
+  tmpField<Complex> bf;
+  tmpField<Complex> xf;
+  tmpField<Complex> x0;
+  zeroField(bf);
+  zeroField(x0);
+  insertParity(bf, b, 0);
+  ax(param.m + 2.0, bf);
+  int success = Dinvpsi(xf, bf, x0, gauge, param, solver);
+  extractParity(x, xf, 0);
+  return success;
+}
+
+// let dD \equiv (d/dtheta D)
+//
+// d/dtheta (phi^* (DD^dag)^-1 phi) = -((DD^dag)^1 phi)^dag ([dD]*D^dag + D*[dD^dag]) ((DD^dag)^-1 phi)
+//
+// The pseudofermion phi lives on the EVEN sites and the action uses the
+// Schur complement Dhat = 1 - kappa^2 H_eo H_oe. With X = (Dhat^dag Dhat)^-1 phi
+// and Y = Dhat X,
+//
+// dS = 2 kappa^2 Re(Y^dag [dH_eo] H_oe X + (g3 H_oe g3 Y)^dag [dH_oe] X),
+//
+// which is the full lattice force below (where dS = Re(Y^dag [dH] X)) with
+// phip = (X, H_oe X) and g3Dphi = 2 kappa^2 (g3 Y, H_oe g3 Y).
+//
+// With p.solverHMC = SOLVER_MG or SOLVER_SAP, X = Dhat^-1 g3 Dhat^-1 g3 phi
+// instead (Dhat^dag = g3 Dhat g3), two solves for D on the full lattice.
+
+void forceDWilson(latField<double> &fD, const latField<Complex> &gauge, const latField<Complex> &phi,
+		  chronoGuess &guess, param_t p){
+  
   if(p.dynamic == true) {
 
     zeroLat(fD);
+
+    tmpField<Complex> phip;
+    tmpField<Complex> g3Dphi;
+    tmpField<Complex> Xe(2, LX, LY/2);
+    tmpField<Complex> Xo(2, LX, LY/2);
+    tmpField<Complex> Ye(2, LX, LY/2);
+    tmpField<Complex> Yo(2, LX, LY/2);
+    tmpField<Complex> gaugeEO;
+
+    //Xe = (Dhat^dag Dhat)^-1 * phi
+    if(p.solverHMC == SOLVER_MG || p.solverHMC == SOLVER_SAP) {
+      g3psi(Ye, phi);
+      DhatInvpsi(Yo, Ye, gauge, p, p.solverHMC);
+      g3psi(Yo);
+      DhatInvpsi(Xe, Yo, gauge, p, p.solverHMC);
+    }
+    else Ainvpsi(Xe, phi, guess, gauge, p);
+
+    //Ye = g3 Dhat Xe, then the ODD sites of both
+    checkerboardGauge(gaugeEO, gauge);
+    g3DpsiEO(Ye, Xe, gaugeEO, p);
+    wilsonHopEO(Xo, Xe, gaugeEO, 1, 1.0);
+    wilsonHopEO(Yo, Ye, gaugeEO, 1, 1.0);
     
-    Complex phip[LX][LY];
-    Complex Dphip[LX][LY];
-    zeroField(phip);
-    zeroField(Dphip);
-    
-    Ainvpsi(phip, phi, phip, gauge, p); // note phip = 0 for ODD
-    Dpsi(Dphip, phip, gauge, p);        // restrict to Dslash, m = 0
+    double kappa = 0.5/(p.m + 2.0);
+    ax(2*kappa*kappa, Ye);
+    ax(2*kappa*kappa, Yo);
     
+    insertParity(phip, Xe, 0);
+    insertParity(phip, Xo, 1);
+    insertParity(g3Dphi, Ye, 0);
+    insertParity(g3Dphi, Yo, 1);
+
+    double r = 1.0;
+#pragma omp parallel for
     for(int x=0; x<LX; x++)
-      for(int y=0; y<LY; y++){
-	if( (x+y)%2 == 1) phip[x][y]  = Complex(0.0,0.0);
-	if( (x+y)%2 == 0) Dphip[x][y] = Complex(0.0,0.0);
+      for(int y=0; y<LY; y++) {
+
+	int xp1 = nbr.xp[x];
+	int yp1 = nbr.yp[y];
+	
+	//mu = 0
+	//upper
+	// | r  1 | 
+	// | 1  r |
+	//lower
+	// | r -1 |
+	// | 1 -r |					
+	fD[x][y][0] += real(I*((conj(gauge[x][y][0]) *
+			       (conj(phip[xp1][y][0]) * (r*g3Dphi[x][y][0] +   g3Dphi[x][y][1]) -
+				conj(phip[xp1][y][1]) * (  g3Dphi[x][y][0] + r*g3Dphi[x][y][1])))
+			       -
+			       (gauge[x][y][0] *
+			       (conj(phip[x][y][0]) * (r*g3Dphi[xp1][y][0] -   g3Dphi[xp1][y][1]) +
+				conj(phip[x][y][1]) * (  g3Dphi[xp1][y][0] - r*g3Dphi[xp1][y][1])))
+			       )
+			    );	
+	
+	//mu = 1
+	//upper
+	// | r -i | 
+	// | i  r |
+	//lower
+	// | r  i |
+	// | i -r |
+	fD[x][y][1] += real(I*((conj(gauge[x][y][1]) *
+				(conj(phip[x][yp1][0]) * (r*g3Dphi[x][y][0] - I*g3Dphi[x][y][1]) -
+				 conj(phip[x][yp1][1]) * (I*g3Dphi[x][y][0] + r*g3Dphi[x][y][1])))
+			       -			       
+			       (gauge[x][y][1] *
+				(conj(phip[x][y][0]) * (r*g3Dphi[x][yp1][0] + I*g3Dphi[x][yp1][1]) +
+				 conj(phip[x][y][1]) * (I*g3Dphi[x][yp1][0] - r*g3Dphi[x][yp1][1])))
+			       )
+			    );
       }
+  }
+}
+
+void forceDStaggered(latField<double> &fD, const latField<Complex> &gauge, const latField<Complex> &phi,
+		     chronoGuess &guess, param_t p) {
+
+  if(p.dynamic == true) {
+
+    zeroLat(fD);
+    
+    tmpField<Complex> phip(1);
+    tmpField<Complex> Dphip(1);
+    tmpField<Complex> phipe(1, LX, LY/2);
+    tmpField<Complex> Dphipo(1, LX, LY/2);
+    tmpField<Complex> gaugeEO;
     
-    double eta1;
-    int yp1, xp1;
+    Ainvpsi(phip, phi, guess, gauge, p); // phi, hence phip, is zero on ODD
+
+    // D phip is only needed on the ODD sites, where it is -H_oe phip_e.
+    extractParity(phipe, phip, 0);
+    checkerboardGauge(gaugeEO, gauge);
+    DhopEO(Dphipo, phipe, gaugeEO, 1);
+    ax(-1.0, Dphipo);
+    zeroField(Dphip);
+    insertParity(Dphip, Dphipo, 1);
+    
+#pragma omp parallel for
     for(int x=0; x<LX; x++)
       for(int y=0; y<LY; y++) {
 	
-	eta1 =(1.0 - 2.0*(x%2));
-	xp1 = (x+1)%LX;
-	yp1 = (y+1)%LY;
+	double eta1 =(1.0 - 2.0*(x%2));
+	int xp1 = nbr.xp[x];
+	int yp1 = nbr.yp[y];
 	
 	if( (x+y+1)%2 == 0){ 
-	  fD[x][y][0] += 2.0*imag(conj(Dphip[x][y]) * gauge[x][y][0] * phip[xp1][y]);
+	  fD[x][y][0] += 2.0*imag(conj(Dphip[x][y][0]) * gauge[x][y][0] * phip[xp1][y][0]);
 	}
 	else {
-	  fD[x][y][0] += 2.0*imag(conj(Dphip[xp1][y]) * conj(gauge[x][y][0]) * phip[x][y]);
+	  fD[x][y][0] += 2.0*imag(conj(Dphip[xp1][y][0]) * conj(gauge[x][y][0]) * phip[x][y][0]);
 	};
 	
 	if( (x+y+1)%2 == 0){    
-	  fD[x][y][1] += 2.0*eta1*imag(conj(Dphip[x][y]) * gauge[x][y][1] * phip[x][yp1]);
+	  fD[x][y][1] += 2.0*eta1*imag(conj(Dphip[x][y][0]) * gauge[x][y][1] * phip[x][yp1][0]);
 	}
 	else {
-	  fD[x][y][1] += 2.0*eta1*imag(conj(Dphip[x][yp1]) * conj(gauge[x][y][1]) * phip[x][y]);
+	  fD[x][y][1] += 2.0*eta1*imag(conj(Dphip[x][yp1][0]) * conj(gauge[x][y][1]) * phip[x][y][0]);
 	}
       }	    
   }
 }
 
+void forceD(latField<double> &fD, const latField<Complex> &gauge, const latField<Complex> &phi,
+	    chronoGuess &guess, param_t p){
+
+  if(phi.nd == 1) forceDStaggered(fD, gauge, phi, guess, p);
+  else forceDWilson(fD, gauge, phi, guess, p);
+}
+
 #endif
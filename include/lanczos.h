@@ -0,0 +1,339 @@
+#ifndef LANCZOS_H
+#define LANCZOS_H
+
+#include <vector>
+#include "utils.h"
+#include "fermionHelpers.h"
+#include "dOpHelpers.h"
+#include "linAlgHelpers.h"
+
+using namespace std;
+
+// Thick restart Lanczos
+//---------------------------------------------------------------------------
+// The p.nEv lowest eigenpairs of the hermitian A that Apsi applies, g3Dg3D
+// on Wilson and D^dag D on staggered fields, from a Krylov space of p.nKr
+// vectors (Wu and Simon, SIAM J. Matrix Anal. Appl. 22 (2000) 602). When
+// the space is full, the lowest LANCZOS_NKEEP(nev, nkr) Ritz vectors are
+// kept with the last Lanczos vector, on which the projection of A is
+// diagonal apart from the row and column of the latter, and the Lanczos
+// steps resume from it. Each new vector, after the three term recurrence,
+// is orthogonalised against the whole basis, so that the basis stays
+// orthonormal to rounding and no spurious copies of converged Ritz values
+// appear.
+//
+// A Ritz pair (theta_i, y_i) has the residual |A y_i - theta_i y_i| =
+// beta |Z(nkr-1,i)|, beta the norm of the last Lanczos vector before its
+// normalisation. The solver stops when the nEv lowest are below
+// p.arpackTol*theta_i, or after p.arpackMaxiter restarts.
+//
+// With p.polyACC set the Lanczos runs on the Chebyshev filter -T_n(x),
+// x = (c - A)/h, of degree n = p.n_poly, c and h the centre and half
+// width of [p.amin, p.amax]. The filter maps the unwanted spectrum in
+// [amin, amax] into [-1, 1] and the modes below amin to -cosh(n acosh(x)),
+// far below it and spread apart, so that they converge in a few restarts
+// of a short space. amin must lie above the nEv-th eigenvalue and amax
+// above the largest. Either one that is not positive is estimated from
+// a first Lanczos cycle on A itself: amax is the largest Ritz value plus
+// its residual, with a margin, and amin the (nEv+1)-th lowest Ritz value,
+// which lies above the (nEv+1)-th eigenvalue. The cycle then restarts on
+// the filter from the sum of the nEv lowest Ritz vectors. The eigenvalues
+// returned are the Rayleigh quotients of A.
+
+#ifndef LANCZOS_NKEEP
+#define LANCZOS_NKEEP(nev, nkr) (nev)
+#endif
+#ifndef LANCZOS_AMAX_MARGIN
+#define LANCZOS_AMAX_MARGIN 1.1
+#endif
+
+// out = -T_n(x) in, x = (c - A)/h, by the Chebyshev three term recurrence
+// T_{k+1} = 2 x T_k - T_{k-1}, one A per degree
+void chebyOp(latField<Complex> &out, const latField<Complex> &in, double amin, double amax,
+	     const latField<Complex> &gauge, const latField<Complex> &gaugeEO, param_t p) {
+
+  const double c = 0.5*(amax + amin), h = 0.5*(amax - amin);
+  tmpField<Complex> t0(in.nd, in.nx, in.ny), t1(in.nd, in.nx, in.ny), Ay(in.nd, in.nx, in.ny);
+  Complex *y0 = t0.v, *y1 = t1.v;
+
+  // T_0 = in, T_1 = x in
+  Apsi(Ay, in, gauge, gaugeEO, p);
+#pragma omp parallel for
+  for(long l=0; l<in.len; l++) {
+    y0[l] = in.v[l];
+    y1[l] = (c*in.v[l] - Ay.v[l])/h;
+  }
+  for(int k=1; k<p.n_poly; k++) {
+    latField<Complex> yk(y1, in.nd, in.nx, in.ny);
+    Apsi(Ay, yk, gauge, gaugeEO, p);
+#pragma omp parallel for
+    for(long l=0; l<in.len; l++) y0[l] = (2.0/h)*(c*y1[l] - Ay.v[l]) - y0[l];
+    swap(y0, y1);
+  }
+#pragma omp parallel for
+  for(long l=0; l<in.len; l++) out.v[l] = -y1[l];
+}
+
+// evals[i] and field i of the block evecs (see insertBlock), i < p.nEv,
+// get the eigenpairs lowest first, the latter in the precision of evecs.
+// evecs.nd/p.nEv sets the components per site.
+template<typename E> void trLanczos(latField<E> &evecs, Complex *evals,
+				    const latField<Complex> &gauge, param_t p) {
+
+  const int nev = p.nEv, m = p.nKr;
+  const int nkeep = min(LANCZOS_NKEEP(nev, m), m-1);
+  if(nev < 1 || m <= nev) {
+    cout << "Error in trLanczos: need 0 < nEv < nKr, have nEv = " << nev
+	 << ", nKr = " << m << endl;
+    exit(0);
+  }
+  if(evecs.nd % nev != 0) {
+    cout << "Error in trLanczos: block of " << evecs.nd << " components for "
+	 << nev << " eigenvectors" << endl;
+    exit(0);
+  }
+  if(p.polyACC && p.n_poly < 1) {
+    cout << "Error in trLanczos: Chebyshev degree n_poly = " << p.n_poly << endl;
+    exit(0);
+  }
+
+  // The filter is on once its bounds are known
+  double amin = p.amin, amax = p.amax;
+  bool cheby = p.polyACC && amin > 0.0 && amax > amin;
+  bool estimate = p.polyACC && !cheby;
+  // The even-odd links of Apsi, once for the whole solve
+  tmpField<Complex> gaugeEO;
+  if(evecs.nd/nev == 2 && evecs.ny == LY/2) checkerboardGauge(gaugeEO, gauge);
+  auto op = [&](latField<Complex> &out, const latField<Complex> &in) {
+    if(cheby) chebyOp(out, in, amin, amax, gauge, gaugeEO, p);
+    else Apsi(out, in, gauge, gaugeEO, p);
+  };
+
+  vector<latField<Complex> *> V(m+1);
+  for(auto &v : V) v = new latField<Complex>(evecs.nd/nev, evecs.nx, evecs.ny);
+  vector<Complex> T(m*m, 0.0), Z, h(m);
+  vector<double> theta;
+  double beta = 0.0;
+
+  // The start vector has its own stream, so the Markov chain is untouched
+  unsigned short seed[3] = {1357, 2468, 3579};
+  randomOrthoVector(*V[0], V.data(), 0, seed);
+
+  int k = 0, nconv = 0, iter;
+  for(iter=0; iter<p.arpackMaxiter; iter++) {
+
+    for(int j=k; j<m; j++) {
+      // The three term recurrence, with the arrow of the restart at j = k,
+      // then the full orthogonalisation. T(i,j) = <V_i, A V_j>.
+      op(*V[j+1], *V[j]);
+      const int i0 = j == k ? 0 : j-1;
+      vector<Complex> c(j+1-i0);
+      for(int i=i0; i<j; i++) c[i-i0] = T[i*m + j];
+      c[j-i0] = dotField(*V[j], *V[j+1]);
+      double wsq = subtractFields(*V[j+1], &V[i0], j+1-i0, c);
+      for(int i=0; i<=j; i++) h[i] = i < i0 ? 0.0 : c[i-i0];
+      beta = orthogonalise(h, *V[j+1], V.data(), j+1, wsq);
+      for(int i=0; i<j; i++) {
+	T[i*m + j] = h[i];
+	T[j*m + i] = conj(h[i]);
+      }
+      T[j*m + j] = real(h[j]);
+      if(beta < 1e-12*fabs(real(h[j]))) {
+	// Invariant subspace: continue from a new direction
+	beta = 0.0;
+	randomOrthoVector(*V[j+1], V.data(), j+1, seed);
+      }
+      else ax(1.0/beta, *V[j+1]);
+      if(j+1 < m) T[j*m + j+1] = T[(j+1)*m + j] = beta;
+    }
+
+    hermEig(theta, Z, T, m);
+
+    if(estimate) {
+      if(p.amax <= 0.0) amax = LANCZOS_AMAX_MARGIN*(theta[m-1] + beta*abs(Z[(m-1)*m + m-1]));
+      if(p.amin <= 0.0) amin = theta[nev];
+      if(!(amin > 0.0 && amax > amin)) {
+	cout << "Error in trLanczos: Chebyshev bounds [" << amin << ", " << amax << "]" << endl;
+	exit(0);
+      }
+      estimate = false;
+      cheby = true;
+
+      // Start again from the sum of the lowest Ritz vectors
+      vector<Complex> z(m, 0.0);
+      for(int i=0; i<m; i++)
+	for(int j=0; j<nev; j++) z[i] += Z[i*m + j];
+      vector<latField<Complex> *> V0(1, V[m]);
+      combineFields(V0, vector<latField<Complex> *>(V.begin(), V.begin() + m), z, 1);
+      swap(V[0], V[m]);
+      ax(1.0/sqrt(norm2(*V[0])), *V[0]);
+      k = 0;
+      T.assign(m*m, 0.0);
+      continue;
+    }
+
+    for(nconv=0; nconv<nev; nconv++)
+      if(beta*abs(Z[(m-1)*m + nconv]) >= p.arpackTol*fabs(theta[nconv])) break;
+    const bool last = iter == p.arpackMaxiter-1;
+    if(!cheby && (nconv == nev || last)) break;
+
+    // Restart on the lowest Ritz vectors and the last Lanczos vector
+    k = nkeep;
+    vector<latField<Complex> *> Vk(V.begin(), V.begin() + k);
+    combineFields(Vk, vector<latField<Complex> *>(V.begin(), V.begin() + m), Z, m);
+    swap(V[k], V[m]);
+
+    // The residuals of the filter bound those of A only loosely, so the
+    // Ritz vectors are accepted on the latter
+    if(cheby && (nconv == nev || last)) {
+      tmpField<Complex> w(V[0]->nd, V[0]->nx, V[0]->ny);
+      nconv = -1;
+      for(int i=0; i<nev; i++) {
+	Apsi(w, *V[i], gauge, gaugeEO, p);
+	evals[i] = real(dotField(*V[i], w));
+	axpy(-real(evals[i]), *V[i], w);
+	if(nconv < 0 && sqrt(norm2(w)) >= p.arpackTol*real(evals[i])) nconv = i;
+      }
+      if(nconv < 0) nconv = nev;
+      if(nconv == nev || last) break;
+    }
+
+    T.assign(m*m, 0.0);
+    for(int i=0; i<k; i++) {
+      T[i*m + i] = theta[i];
+      T[i*m + k] = beta*conj(Z[(m-1)*m + i]);
+      T[k*m + i] = conj(T[i*m + k]);
+    }
+  }
+
+  if(!cheby) {
+    vector<latField<Complex> *> Y(V.begin(), V.begin() + nev);
+    combineFields(Y, vector<latField<Complex> *>(V.begin(), V.begin() + m), Z, m);
+    for(int i=0; i<nev; i++) evals[i] = theta[i];
+  }
+  for(int i=0; i<nev; i++) insertBlock(evecs, *V[i], i);
+  for(auto v : V) delete v;
+
+  if(nconv < nev)
+    cout << "Lanczos: " << nconv << " of " << nev << " eigenpairs converged after "
+	 << iter << " restarts" << endl;
+}
+
+
+// Deflation space cache
+//---------------------------------------------------------------------------
+// The low modes depend on the gauge field only through A, so that all the
+// measurements on a configuration can share one eigensolve. deflSpace
+// keeps the modes of the last configuration with a key: the lattice, the
+// mass, nEv and a weighted sum of the links, which a gauge transformation
+// changes too. A configuration that was checkpointed has its modes looked
+// up in a file next to the gauge field before they are computed, and with
+// DEFL_SAVE set they are written there, so that a re-measurement on the
+// saved configurations (a run from checkpointStart with iterHMC = 0)
+// skips the eigensolve. The checkpoint keeps 12 digits of the links, so
+// the sums of a file compare to DEFL_KEY_TOL, and those of the modes in
+// memory, from this very run, exactly.
+//
+// The modes are one block field of 2*p.nEv components per site, which
+// deflate sweeps once for all of them. With DEFL_FLOAT set the block is
+// kept in single precision, half the memory and bandwidth; the deflated
+// guess only starts the solves, so its precision does not matter.
+
+#ifndef DEFL_SAVE
+#define DEFL_SAVE 0
+#endif
+#ifndef DEFL_KEY_TOL
+#define DEFL_KEY_TOL 1e-9
+#endif
+#ifndef DEFL_FLOAT
+#define DEFL_FLOAT 0
+#endif
+
+#if DEFL_FLOAT
+typedef ComplexF deflComplex;
+#else
+typedef Complex deflComplex;
+#endif
+
+class deflationSpace {
+
+  struct key_t {
+    int nx, ny, nev, esize;
+    double m;
+    Complex usum; // sum_l (1 + l%7) U_l
+  };
+
+  key_t key;
+
+  key_t makeKey(const latField<Complex> &gauge, param_t p) {
+    double re = 0.0, im = 0.0;
+#pragma omp parallel for reduction(+:re,im)
+    for(long l=0; l<gauge.len; l++) {
+      re += (1 + l%7)*gauge.v[l].real();
+      im += (1 + l%7)*gauge.v[l].imag();
+    }
+    return key_t{gauge.nx, gauge.ny, p.nEv, (int)sizeof(deflComplex), p.m, Complex(re, im)};
+  }
+
+  bool match(const key_t &a, const key_t &b, double tol) {
+    return a.nx == b.nx && a.ny == b.ny && a.nev == b.nev && a.esize == b.esize && a.m == b.m &&
+      abs(a.usum - b.usum) <= tol;
+  }
+
+  bool read(const string &name, const key_t &k, long len) {
+    FILE *fp = fopen(name.c_str(), "rb");
+    if(!fp) return false;
+    key_t kf;
+    bool ok = fread(&kf, sizeof(key_t), 1, fp) == 1 && match(kf, k, DEFL_KEY_TOL*4.0*len);
+    if(ok) ok = fread(evals.data(), sizeof(Complex), k.nev, fp) == (size_t)k.nev;
+    if(ok) ok = fread(evecs->v, sizeof(deflComplex), evecs->len, fp) == (size_t)evecs->len;
+    fclose(fp);
+    if(!ok) cout << "Deflation space in " << name << " does not match, recomputing" << endl;
+    return ok;
+  }
+
+  void write(const string &name, const key_t &k) {
+    FILE *fp = fopen(name.c_str(), "wb");
+    if(!fp) {
+      cout << "Error in deflationSpace: cannot open " << name << endl;
+      exit(0);
+    }
+    fwrite(&k, sizeof(key_t), 1, fp);
+    fwrite(evals.data(), sizeof(Complex), k.nev, fp);
+    fwrite(evecs->v, sizeof(deflComplex), evecs->len, fp);
+    fclose(fp);
+  }
+
+public:
+  latField<deflComplex> *evecs = nullptr;
+  vector<Complex> evals;
+
+  deflationSpace() {}
+  ~deflationSpace() { delete evecs; }
+
+  deflationSpace(const deflationSpace &) = delete;
+  deflationSpace &operator=(const deflationSpace &) = delete;
+
+  // The low modes of A on gauge: kept, read from file (if not empty) or
+  // computed
+  void prepare(const latField<Complex> &gauge, const string &file, param_t p) {
+    key_t k = makeKey(gauge, p);
+    if(evecs && match(k, key, 0.0)) return;
+    if(evecs && evecs->nd != 2*p.nEv) {
+      delete evecs;
+      evecs = nullptr;
+    }
+    if(!evecs) evecs = new latField<deflComplex>(2*p.nEv);
+    evals.resize(p.nEv);
+    if(file.empty() || !read(file, k, gauge.len)) {
+      trLanczos(*evecs, evals.data(), gauge, p);
+      if(DEFL_SAVE && !file.empty()) write(file, k);
+    }
+    key = k;
+  }
+};
+
+//One deflation space for the measurements of the whole run
+deflationSpace deflSpace;
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef LATFIELD_H
+#define LATFIELD_H
+
+#include <iostream>
+#include <cstdlib>
+#include <complex>
+#include <vector>
+
+using namespace std;
+
+//Lattice field container
+//---------------------------------------------------------------------------
+// Every site of a field lives in one aligned allocation, site major with the
+// nd internal components (spin, or link direction) innermost:
+//
+//   f(x,y,s) = f.v[(x*ny + y)*nd + s]
+//
+// f[x][y][s] is kept so that stencils read the same as for the old
+// T*** buffers. A field constructed on an existing pointer is a view:
+// it indexes the memory but does not own (or free) it.
+//
+// 2+1D fields carry a z extent between the site and the components,
+//
+//   f(x,y,z,s) = f.v[((x*ny + y)*nz + z)*nd + s]
+//
+// and are declared as latField3D so that the 3D routines overload on them.
+
+#define FIELD_ALIGN 64
+
+//Lattice extents, set once at startup from the command line.
+extern int LX, LY, LZ;
+
+template<typename T> class latField {
+
+public:
+  T *v;
+  int nx, ny, nz, nd;
+  long vol; // Number of sites
+  long len; // Number of elements, vol*nd
+  bool owner;
+
+  latField(int nd_ = 2, int nx_ = LX, int ny_ = LY, int nz_ = 1) :
+    v(nullptr), nx(nx_), ny(ny_), nz(nz_), nd(nd_), vol((long)nx_*ny_*nz_), len(vol*nd_), owner(true) {
+
+    if(posix_memalign((void**)&v, FIELD_ALIGN, len*sizeof(T)) != 0) {
+      cout << "Error in latField: failed to allocate " << len*sizeof(T) << " bytes" << endl;
+      exit(0);
+    }
+    //First touch in parallel so pages land near the threads that use them.
+#pragma omp parallel for
+    for(long i=0; i<len; i++) v[i] = 0.0;
+  }
+
+  latField(T *ptr, int nd_ = 2, int nx_ = LX, int ny_ = LY, int nz_ = 1) :
+    v(ptr), nx(nx_), ny(ny_), nz(nz_), nd(nd_), vol((long)nx_*ny_*nz_), len(vol*nd_), owner(false) {}
+
+  ~latField() { if(owner) free(v); }
+
+  //Fields are large; copies must be explicit (copyField/copyLat).
+  latField(const latField &) = delete;
+  latField &operator=(const latField &) = delete;
+
+  //Site/spin indexing
+  inline T &operator()(int x, int y, int s) const { return v[((long)x*ny + y)*nd + s]; }
+  inline T *site(int x, int y) const { return v + ((long)x*ny + y)*nd; }
+  inline long idx(int x, int y) const { return (long)x*ny + y; }
+
+  //Site/direction indexing for 2+1D fields
+  inline T &operator()(int x, int y, int z, int s) const { return v[(((long)x*ny + y)*nz + z)*nd + s]; }
+
+  //f[x][y][s] access
+  struct row {
+    T *p;
+    int nd;
+    inline T *operator[](int y) const { return p + (long)y*nd; }
+  };
+  inline row operator[](int x) const { return row{v + (long)x*ny*nd, nd}; }
+
+  inline size_t bytes() const { return len*sizeof(T); }
+};
+
+template<typename T> class latField3D : public latField<T> {
+
+public:
+  latField3D(int nd_ = 3) : latField<T>(nd_, LX, LY, LZ) {}
+  latField3D(T *ptr, int nd_ = 3) : latField<T>(ptr, nd_, LX, LY, LZ) {}
+};
+
+//Periodic neighbours
+//---------------------------------------------------------------------------
+// The wraparound is tabulated once per direction, nbr.xp[x] = (x+1)%LX,
+// nbr.xm[x] = (x-1+LX)%LX and likewise in y and z, so stencils look up
+// their neighbours instead of dividing at every site. initNeighbours()
+// is called once the extents are known.
+
+struct neighbours {
+  vector<int> xp, xm, yp, ym, zp, zm;
+};
+
+neighbours nbr;
+
+void buildNeighbours(vector<int> &up, vector<int> &dn, int L) {
+  up.resize(L);
+  dn.resize(L);
+  for(int i=0; i<L; i++) {
+    up[i] = (i+1)%L;
+    dn[i] = (i-1+L)%L;
+  }
+}
+
+void initNeighbours() {
+  buildNeighbours(nbr.xp, nbr.xm, LX);
+  buildNeighbours(nbr.yp, nbr.ym, LY);
+  buildNeighbours(nbr.zp, nbr.zm, LZ);
+}
+
+#endif
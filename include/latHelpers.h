@@ -7,49 +7,23 @@
 #include <string.h>
 #include <cmath>
 #include <complex>
+#include "latField.h"
 
 using namespace std;
 
 //Lattice utilities
 //---------------------------------------------------------------------------
 
-// Zero lattice 2D
-template<typename T> inline void zeroLat(T v) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int mu=0; mu<2; mu++)
-	v[x][y][mu] = 0.0;
+// Zero lattice
+template<typename T> inline void zeroLat(latField<T> &v) {
+#pragma omp parallel for
+  for(long i=0; i<v.len; i++) v.v[i] = 0.0;
 }
 
-// Zero lattice 2D
-template<typename T> inline void zeroLat(T v[LX][LY][2]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int mu=0; mu<2; mu++)
-	v[x][y][mu] = 0.0;
-}
-
-// Copy lattice 2D
-template<typename T> inline void copyLat(T v2, T v1) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int mu=0; mu<2; mu++)
-	v2[x][y][mu] = v1[x][y][mu];
-}
-
-// Copy lattice 2D
-template<typename T> inline void copyLat(T v2[LX][LY][2], const T v1[LX][LY][2]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int mu=0; mu<2; mu++)
-	v2[x][y][mu] = v1[x][y][mu];
-}
-
-// Zero Wilson Loop field 2D.
-template<typename T> inline void zeroWL(T psi[LX/2][LY/2]) {
-  for(int x=0; x<LX/2; x++)
-    for(int y=0; y<LY/2; y++)
-      psi[x][y] = 0.0;
+// Copy lattice
+template<typename T> inline void copyLat(latField<T> &v2, const latField<T> &v1) {
+#pragma omp parallel for
+  for(long i=0; i<v2.len; i++) v2.v[i] = v1.v[i];
 }
 
 #endif
@@ -12,54 +12,31 @@ using namespace std;
 
 //Lattice utilities
 //---------------------------------------------------------------------------
-
-// Zero lattice
-template<typename T> inline void zeroLat(T v[LX][LY][LZ][3]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int z=0; z<LZ; z++)
-	for(int mu=0; mu<3; mu++)
-	  v[x][y][z][mu] = 0.0;
-}
-
-// Copy lattice
-template<typename T> inline void copyLat(T v2[LX][LY][LZ][3], const T v1[LX][LY][LZ][3]) {
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int z=0; z<LZ; z++)
-	for(int mu=0; mu<3; mu++)
-	  v2[x][y][z][mu] = v1[x][y][z][mu];
-}
+// zeroLat and copyLat run over the flat field and take 3D fields as they are.
 
 // Extract 2D lattice slice
-template<typename T> inline void extractLatSlice(const T gauge[LX][LY][LZ][3],
-						 T gauge2D[LX][LY][2],
+template<typename T> inline void extractLatSlice(const latField3D<T> &gauge,
+						 latField<T> &gauge2D,
 						 const int slice) {
+#pragma omp parallel for
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++)
       for(int mu=0; mu<2; mu++)
-	gauge2D[x][y][mu] = gauge[x][y][slice][mu];
+	gauge2D[x][y][mu] = gauge(x,y,slice,mu);
 }
 
 // Insert 2D slice
-template<typename T> inline void insertLatSlice(T gauge[LX][LY][LZ][3],
-						const T gauge2D[LX][LY][2],
+template<typename T> inline void insertLatSlice(latField3D<T> &gauge,
+						const latField<T> &gauge2D,
 						const int slice) {
+#pragma omp parallel for
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++)
       for(int mu=0; mu<2; mu++)
-	gauge[x][y][slice][mu] = gauge2D[x][y][mu];
-}
-
-// Zero Wilson Loop field.
-template<typename T> inline void zeroWL(T v[LX/2][LY/2][LZ]) {
-  for(int x=0; x<LX/2; x++)
-    for(int y=0; y<LY/2; y++)
-      for(int z=0; z<LZ; z++)
-	v[x][y][z] = 0.0;  
+	gauge(x,y,slice,mu) = gauge2D[x][y][mu];
 }
 
-void checkGauge(const Complex gauge[LX][LY][LZ][3], const Complex gaugeAlt[LX][LY][LZ][3], int callID) {
+void checkGauge(const latField3D<Complex> &gauge, const latField3D<Complex> &gaugeAlt, int callID) {
 
   bool fail = false;
   
@@ -67,7 +44,7 @@ void checkGauge(const Complex gauge[LX][LY][LZ][3], const Complex gaugeAlt[LX][L
     for(int y=0; y<LY; y++)
       for(int z=0; z<LZ; z++)
 	for(int mu=0; mu<3; mu++)
-	  if(gauge[x][y][z][mu] != gaugeAlt[x][y][z][mu]) {
+	  if(gauge(x,y,z,mu) != gaugeAlt(x,y,z,mu)) {
 	    cout << "Gauge Check fail at " << x << " " << y << " " << z << " " << mu << " from call " << callID << endl;
 	    fail = true;
 	  }
@@ -77,8 +54,8 @@ void checkGauge(const Complex gauge[LX][LY][LZ][3], const Complex gaugeAlt[LX][L
       for(int y=0; y<LY; y++)
 	for(int z=0; z<LZ; z++)
 	  for(int mu=0; mu<3; mu++) {
-	    if(gauge[x][y][z][mu] != gaugeAlt[x][y][z][mu]) {
-	      cout << "Gauge compare " << x << " " << y << " " << z << " " << mu << gauge[x][y][z][mu] << " " <<  gaugeAlt[x][y][z][mu] << endl;
+	    if(gauge(x,y,z,mu) != gaugeAlt(x,y,z,mu)) {
+	      cout << "Gauge compare " << x << " " << y << " " << z << " " << mu << gauge(x,y,z,mu) << " " <<  gaugeAlt(x,y,z,mu) << endl;
 	    }
 	  }
     exit(0);
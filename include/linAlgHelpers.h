@@ -0,0 +1,345 @@
+#ifndef LINALGHELPERS_H
+#define LINALGHELPERS_H
+
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "fermionHelpers.h"
+
+using namespace std;
+
+//Small dense matrices
+//---------------------------------------------------------------------------
+// The block and subspace solvers reduce to n x n complex matrices with n
+// the number of fields in the block (a handful). They are stored row major,
+// A(i,j) = A[i*n + j], in a vector<Complex>.
+
+// C = A B
+void matMul(vector<Complex> &C, const vector<Complex> &A, const vector<Complex> &B, int n) {
+  vector<Complex> tmp(n*n, 0.0);
+  for(int i=0; i<n; i++)
+    for(int k=0; k<n; k++)
+      for(int j=0; j<n; j++) tmp[i*n + j] += A[i*n + k]*B[k*n + j];
+  C = tmp;
+}
+
+// B = A^dag
+void matDag(vector<Complex> &B, const vector<Complex> &A, int n) {
+  vector<Complex> tmp(n*n);
+  for(int i=0; i<n; i++)
+    for(int j=0; j<n; j++) tmp[j*n + i] = conj(A[i*n + j]);
+  B = tmp;
+}
+
+// A = L L^dag for Hermitian positive definite A, L lower triangular.
+// Returns false if A is not positive definite.
+bool cholesky(vector<Complex> &L, const vector<Complex> &A, int n) {
+  L.assign(n*n, 0.0);
+  for(int j=0; j<n; j++) {
+    double d = real(A[j*n + j]);
+    for(int k=0; k<j; k++) d -= norm(L[j*n + k]);
+    if(!(d > 0.0)) return false;
+    L[j*n + j] = sqrt(d);
+    for(int i=j+1; i<n; i++) {
+      Complex s = A[i*n + j];
+      for(int k=0; k<j; k++) s -= L[i*n + k]*conj(L[j*n + k]);
+      L[i*n + j] = s/real(L[j*n + j]);
+    }
+  }
+  return true;
+}
+
+// Inverse of a lower triangular matrix, by forward substitution.
+void invertLower(vector<Complex> &Linv, const vector<Complex> &L, int n) {
+  Linv.assign(n*n, 0.0);
+  for(int j=0; j<n; j++) {
+    Linv[j*n + j] = 1.0/L[j*n + j];
+    for(int i=j+1; i<n; i++) {
+      Complex s = 0.0;
+      for(int k=j; k<i; k++) s -= L[i*n + k]*Linv[k*n + j];
+      Linv[i*n + j] = s/L[i*n + i];
+    }
+  }
+}
+
+// Inverse of a general matrix, by Gauss-Jordan elimination with partial
+// pivoting. Returns false if A is singular.
+bool invertMatrix(vector<Complex> &Ainv, const vector<Complex> &A0, int n) {
+  vector<Complex> A = A0;
+  Ainv.assign(n*n, 0.0);
+  for(int i=0; i<n; i++) Ainv[i*n + i] = 1.0;
+  for(int j=0; j<n; j++) {
+    int piv = j;
+    for(int i=j+1; i<n; i++) if(abs(A[i*n + j]) > abs(A[piv*n + j])) piv = i;
+    if(abs(A[piv*n + j]) == 0.0) return false;
+    if(piv != j)
+      for(int k=0; k<n; k++) {
+	swap(A[j*n + k], A[piv*n + k]);
+	swap(Ainv[j*n + k], Ainv[piv*n + k]);
+      }
+    Complex d = 1.0/A[j*n + j];
+    for(int k=0; k<n; k++) {
+      A[j*n + k] *= d;
+      Ainv[j*n + k] *= d;
+    }
+    for(int i=0; i<n; i++) {
+      if(i == j) continue;
+      Complex f = A[i*n + j];
+      if(f == 0.0) continue;
+      for(int k=0; k<n; k++) {
+	A[i*n + k] -= f*A[j*n + k];
+	Ainv[i*n + k] -= f*Ainv[j*n + k];
+      }
+    }
+  }
+  return true;
+}
+
+// Eigenvalues (ascending) and eigenvectors of a Hermitian matrix. A
+// Householder reduction brings A to a tridiagonal form, which diagonal
+// phases make real, and the implicit QL algorithm diagonalises that.
+// Z(i,j) is component i of the eigenvector of eval[j].
+void hermEig(vector<double> &eval, vector<Complex> &Z, const vector<Complex> &A0, int n) {
+
+  vector<Complex> A = A0, v(n), p(n);
+  Z.assign(n*n, 0.0);
+  for(int i=0; i<n; i++) Z[i*n + i] = 1.0;
+
+  const double eps = numeric_limits<double>::epsilon();
+  double anorm = 0.0;
+  for(int i=0; i<n*n; i++) anorm += norm(A[i]);
+  anorm = sqrt(anorm);
+
+  // A = Z T Z^dag, with H = 1 - 2 v v^dag/|v|^2 zeroing column k below k+1
+  for(int k=0; k<n-2; k++) {
+    double xnorm = 0.0;
+    for(int i=k+1; i<n; i++) xnorm += norm(A[i*n + k]);
+    xnorm = sqrt(xnorm);
+    if(xnorm <= eps*eps*anorm) continue;
+    Complex x0 = A[(k+1)*n + k];
+    Complex alpha = -(abs(x0) > 0.0 ? x0/abs(x0) : 1.0)*xnorm;
+    for(int i=0; i<n; i++) v[i] = i > k ? A[i*n + k] : 0.0;
+    v[k+1] -= alpha;
+    double vnorm = 0.0;
+    for(int i=k+1; i<n; i++) vnorm += norm(v[i]);
+
+    // H A H = A - v q^dag - q v^dag, p = 2 A v/|v|^2, q = p - (v^dag p/|v|^2) v.
+    // Rows and columns before k are already reduced and untouched.
+    Complex K = 0.0;
+    for(int i=k; i<n; i++) {
+      p[i] = 0.0;
+      for(int j=k+1; j<n; j++) p[i] += ctimes(A[i*n + j], v[j]);
+      p[i] *= 2.0/vnorm;
+      K += cdagtimes(v[i], p[i]);
+    }
+    K /= vnorm;
+    for(int i=k; i<n; i++) p[i] -= ctimes(K, v[i]);
+    for(int i=k; i<n; i++)
+      for(int j=k; j<n; j++) A[i*n + j] -= cdagtimes(p[j], v[i]) + cdagtimes(v[j], p[i]);
+
+    // Z = Z H
+    for(int i=0; i<n; i++) {
+      Complex zv = 0.0;
+      for(int j=k+1; j<n; j++) zv += ctimes(Z[i*n + j], v[j]);
+      zv *= 2.0/vnorm;
+      for(int j=k+1; j<n; j++) Z[i*n + j] -= cdagtimes(v[j], zv);
+    }
+  }
+
+  // Real tridiagonal d, e (e[k] couples k and k+1) by the phases of Z's columns
+  vector<double> d(n), e(n, 0.0);
+  Complex ph = 1.0;
+  for(int k=0; k<n; k++) {
+    d[k] = real(A[k*n + k]);
+    for(int i=0; i<n; i++) Z[i*n + k] *= ph;
+    if(k+1 < n) {
+      Complex t = A[(k+1)*n + k];
+      e[k] = abs(t);
+      if(e[k] > 0.0) ph *= t/e[k];
+    }
+  }
+
+  // Implicit QL with shifts, the rotations applied to Z. An e is
+  // negligible on the scale of its neighbours in d, or of all of T
+  // where those vanish.
+  double tnorm = 0.0;
+  for(int k=0; k<n; k++) tnorm = max(tnorm, fabs(d[k]) + fabs(e[k]));
+  for(int l=0; l<n; l++) {
+    int iter = 0, m;
+    do {
+      for(m=l; m<n-1; m++) {
+	double dd = fabs(d[m]) + fabs(d[m+1]);
+	if(fabs(e[m]) <= eps*(dd + eps*tnorm)) break;
+      }
+      if(m != l) {
+	if(iter++ == 60) break;
+	double g = (d[l+1] - d[l])/(2.0*e[l]);
+	double r = hypot(g, 1.0);
+	g = d[m] - d[l] + e[l]/(g + copysign(r, g));
+	double s = 1.0, c = 1.0, pp = 0.0;
+	int i;
+	for(i=m-1; i>=l; i--) {
+	  double f = s*e[i], b = c*e[i];
+	  e[i+1] = (r = hypot(f, g));
+	  if(r == 0.0) {
+	    d[i+1] -= pp;
+	    e[m] = 0.0;
+	    break;
+	  }
+	  s = f/r;
+	  c = g/r;
+	  g = d[i+1] - pp;
+	  r = (d[i] - g)*s + 2.0*c*b;
+	  d[i+1] = g + (pp = s*r);
+	  g = c*r - b;
+	  for(int k=0; k<n; k++) {
+	    Complex z1 = Z[k*n + i+1], z0 = Z[k*n + i];
+	    Z[k*n + i+1] = s*z0 + c*z1;
+	    Z[k*n + i] = c*z0 - s*z1;
+	  }
+	}
+	if(r == 0.0 && i >= l) continue;
+	d[l] -= pp;
+	e[l] = g;
+	e[m] = 0.0;
+      }
+    } while(m != l);
+  }
+
+  // Sort ascending
+  vector<int> idx(n);
+  for(int i=0; i<n; i++) idx[i] = i;
+  sort(idx.begin(), idx.end(), [&](int i, int j) { return d[i] < d[j]; });
+  vector<Complex> Zs(n*n);
+  eval.resize(n);
+  for(int j=0; j<n; j++) {
+    eval[j] = d[idx[j]];
+    for(int i=0; i<n; i++) Zs[i*n + j] = Z[i*n + idx[j]];
+  }
+  Z = Zs;
+}
+
+//Blocks of fields
+//---------------------------------------------------------------------------
+// The subspace methods (Lanczos, eigCG, the chronological guess) work on
+// lists of fields, which these helpers sweep once for all of them.
+
+//Y_j = sum_i X_i Z(i,j) for j < Y.size(), Z with ldz columns. Y may be
+//(a leading part of) X. The sums run over chunks of the fields, so that
+//the X_i stream once past the chunks of Y held in cache.
+#ifndef COMBINE_CHUNK
+#define COMBINE_CHUNK 64
+#endif
+
+void combineFields(vector<latField<Complex> *> &Y, const vector<latField<Complex> *> &X,
+		   const vector<Complex> &Z, int ldz) {
+
+  const int nx = X.size(), ny = Y.size();
+  const long len = X[0]->len;
+#pragma omp parallel
+  {
+    vector<Complex> y(ny*COMBINE_CHUNK);
+#pragma omp for
+    for(long l0=0; l0<len; l0+=COMBINE_CHUNK) {
+      const long nl = min((long)COMBINE_CHUNK, len - l0);
+      for(int j=0; j<ny; j++) {
+	Complex *yj = y.data() + j*COMBINE_CHUNK;
+	for(long l=0; l<nl; l++) yj[l] = 0.0;
+	for(int i=0; i<nx; i++) {
+	  const Complex z = Z[i*ldz + j];
+	  const Complex *xi = X[i]->v + l0;
+#pragma omp simd
+	  for(long l=0; l<nl; l++) yj[l] += ctimes(z, xi[l]);
+	}
+      }
+      for(int j=0; j<ny; j++)
+	for(long l=0; l<nl; l++) Y[j]->v[l0 + l] = y[j*COMBINE_CHUNK + l];
+    }
+  }
+}
+
+// projectFields and subtractFields run over chunks of LANCZOS_CHUNK
+// elements of w, which stay in cache while the V_i stream past them.
+#ifndef LANCZOS_CHUNK
+#define LANCZOS_CHUNK 512
+#endif
+
+// c_i = <V_i, w>, i < n, in one sweep
+void projectFields(vector<Complex> &c, latField<Complex> *const *V, int n,
+		   const latField<Complex> &w) {
+
+  vector<double> re(n, 0.0), im(n, 0.0);
+  double *cre = re.data(), *cim = im.data();
+  const Complex *wv = w.v;
+#pragma omp parallel for reduction(+:cre[:n],cim[:n])
+  for(long l0=0; l0<w.len; l0+=LANCZOS_CHUNK) {
+    const long l1 = min(l0 + LANCZOS_CHUNK, w.len);
+    for(int i=0; i<n; i++) {
+      const Complex *vi = V[i]->v;
+      double sre = 0.0, sim = 0.0;
+#pragma omp simd reduction(+:sre,sim)
+      for(long l=l0; l<l1; l++) {
+	Complex prod = cdagtimes(vi[l], wv[l]);
+	sre += prod.real();
+	sim += prod.imag();
+      }
+      cre[i] += sre;
+      cim[i] += sim;
+    }
+  }
+  for(int i=0; i<n; i++) c[i] = Complex(cre[i], cim[i]);
+}
+
+// w -= sum_{i<n} c_i V_i in one sweep, returns |w|^2
+double subtractFields(latField<Complex> &w, latField<Complex> *const *V, int n,
+		      const vector<Complex> &c) {
+
+  double wsq = 0.0;
+  Complex *wv = w.v;
+#pragma omp parallel for reduction(+:wsq)
+  for(long l0=0; l0<w.len; l0+=LANCZOS_CHUNK) {
+    const long l1 = min(l0 + LANCZOS_CHUNK, w.len);
+    for(int i=0; i<n; i++) {
+      const Complex *vi = V[i]->v;
+      const Complex ci = c[i];
+#pragma omp simd
+      for(long l=l0; l<l1; l++) wv[l] -= ctimes(ci, vi[l]);
+    }
+    double s = 0.0;
+#pragma omp simd reduction(+:s)
+    for(long l=l0; l<l1; l++) s += norm(wv[l]);
+    wsq += s;
+  }
+  return wsq;
+}
+
+// Classical Gram-Schmidt of w, |w|^2 = wsq, against V_i, i < n, repeated
+// while a pass loses more than half of |w|^2 (Daniel et al., Math. Comp.
+// 30 (1976) 772). h accumulates the projections and the return value is
+// the final |w|.
+double orthogonalise(vector<Complex> &h, latField<Complex> &w, latField<Complex> *const *V,
+		     int n, double wsq) {
+
+  if(n == 0) return sqrt(wsq);
+  vector<Complex> c(n);
+  for(int pass=0; pass<3; pass++) {
+    projectFields(c, V, n, w);
+    double wsqNew = subtractFields(w, V, n, c);
+    for(int i=0; i<n; i++) h[i] += c[i];
+    const bool done = wsqNew > 0.5*wsq;
+    wsq = wsqNew;
+    if(done) break;
+  }
+  return sqrt(wsq);
+}
+
+// Random unit vector orthogonal to V_i, i < n
+void randomOrthoVector(latField<Complex> &w, latField<Complex> *const *V, int n,
+		       unsigned short seed[3]) {
+  vector<Complex> h(n);
+  for(long l=0; l<w.len; l++) w.v[l] = Complex(erand48(seed) - 0.5, erand48(seed) - 0.5);
+  ax(1.0/orthogonalise(h, w, V, n, norm2(w)), w);
+}
+
+#endif
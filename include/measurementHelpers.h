@@ -7,14 +7,12 @@
 #include <string.h>
 #include <cmath>
 #include <complex>
+#include <vector>
 #include "utils.h"
 #include "fermionHelpers.h"
 #include "dOpHelpers.h"
 #include "inverters.h"
-
-#ifdef USE_ARPACK
-#include "arpack_interface_wilson.h"
-#endif
+#include "lanczos.h"
 
 
 using namespace std;
@@ -26,7 +24,7 @@ using namespace std;
 //   Creutz     exp[ -sigma L^2] exp[ -sigma(L-1)(L-1)]
 //   ratio:    ---------------------------------------  = exp[ -sigma]
 //              exp[ -sigma (L-1)L] exp[-sigma L(L-1)]
-void measWilsonLoops(const Complex gauge[LX][LY][2], int iter, param_t p){
+void measWilsonLoops(const latField<Complex> &gauge, int iter, param_t p){
     
   Complex w;
   int p1, p2, dx, dy, x, y;
@@ -42,17 +40,14 @@ void measWilsonLoops(const Complex gauge[LX][LY][2], int iter, param_t p){
     p.smearIter = hits;
     
     //Smear the gauge field
-    Complex smeared[LX][LY][2];
+    tmpField<Complex> smeared;
     smearLink(smeared, gauge, p);    
     
     // CREUTZ RATIOS
     //----------------------------------------------------------------------------
     if(p.measWL) {
   
-      Complex wLoops[LX/2][LY/2];
-      zeroWL(wLoops);
-      double sigma[LX/2];  
-      for(int i=0; i<LX/2; i++) sigma[i] = 0.0;
+      vector<vector<Complex>> wLoops(loopMax, vector<Complex>(loopMax, 0.0));
       
       //Loop over all X side sizes of rectangle 
       for(int Xrect=1; Xrect<loopMax; Xrect++) {
@@ -105,11 +100,9 @@ void measWilsonLoops(const Complex gauge[LX][LY][2], int iter, param_t p){
     // POLYAKOV LOOPS
     //----------------------------------------------------------------------------
     if(p.measPL) {
-      Complex pLoops[LX/2];
-      Complex loops[LX];
-
-      for(int x=0; x<LX/2; x++) pLoops[x] = 0.0;
-      for(int x=0; x<LX; x++) loops[x] = Complex(1.0,0.0);
+      //dx runs over [-LX/2, LX/2), so |dx| reaches LX/2
+      vector<Complex> pLoops(LX/2+1, 0.0);
+      vector<Complex> loops(LX, Complex(1.0,0.0));
       
       //Eack polyakov loop correlation is defined by its delta x value.
       //We start at x0, separate to x0 + (x0+L/2-1), and loop over all
@@ -173,64 +166,16 @@ void measWilsonLoops(const Complex gauge[LX][LY][2], int iter, param_t p){
 // if H = Hdag, Tr(H * Hdag) = Sum_{n,m} (H_{n,m}) * (H_{n,m})^*,
 // i.e., the sum of the modulus squared of each element
 
-void measPionCorrelation(const Complex gauge[LX][LY][2], int top, int iter, param_t p){
+//Vacuum trace estimate and folded pion correlator from the up and down
+//point source propagators. suffix is appended to the file names.
+void writePionCorrelation(const latField<Complex> &propUp, const latField<Complex> &propDn,
+			  int top, int iter, param_t p, string suffix = "") {
 
-  //Up type fermion prop
-  Complex propUp[LX][LY][2];
-  //Down type fermion prop
-  Complex propDn[LX][LY][2];
-  //fermion prop CG guess
-  Complex propGuess[LX][LY][2];
-  //Deflation eigenvectors
-  Complex defl_evecs[NEV][LX][LY][2];
-  //Deflation eigenvalues
-  Complex defl_evals[NEV];
-      
-  double pion_corr[LY];
-            
-  Complex source[LX][LY][2];
-  Complex Dsource[LX][LY][2];
+  vector<double> pion_corr(LY, 0.0);
 
   char fname[256];
   string name;
   FILE *fp;
-  
-  //Deflate if requested
-#ifdef USE_ARPACK
-  arpack_solve(gauge, defl_evecs, defl_evals, 0, 0, p);
-#endif
-  
-  //Up type source
-  zeroField(source);
-  zeroField(Dsource);
-  zeroField(propUp);
-  zeroField(propGuess);
-  source[0][0][0] = cUnit;
-  
-  // up -> (g3Dg3) * up *****
-  // (g3Dg3D)^-1 * (g3Dg3) up = D^-1 * up *****
-
-  g3psi(source);
-  g3Dpsi(Dsource, source, gauge, p);  
-
-  if (p.deflate) deflate(propGuess, Dsource, defl_evecs, defl_evals, p);
-  Ainvpsi(propUp, Dsource, propGuess, gauge, p);
-
-  //Down type source
-  zeroField(source);
-  zeroField(Dsource);
-  zeroField(propDn);
-  zeroField(propGuess);
-  source[0][0][1] = cUnit;	    
-      
-  // dn -> (g3Dg3) * dn *****
-  // (g3Dg3D)^-1 * (g3Dg3) dn = D^-1 * dn ***** 
-
-  g3psi(source);
-  g3Dpsi(Dsource, source, gauge, p);
-
-  if (p.deflate) deflate(propGuess, Dsource, defl_evecs, defl_evals, p);
-  Ainvpsi(propDn, Dsource, propGuess, gauge, p);
 
   //Get estimate of vacuum trace
   Complex q[2] = {0.0,0.0};
@@ -241,7 +186,7 @@ void measPionCorrelation(const Complex gauge[LX][LY][2], int top, int iter, para
   
   name = "data/vacuum/estimate_vacuum_Q" + std::to_string(abs(top));
   constructName(name, p);
-  name += ".dat";
+  name += suffix + ".dat";
   sprintf(fname, "%s", name.c_str());
   fp = fopen(fname, "a");
   fprintf(fp, "%d ", iter+1);
@@ -275,7 +220,7 @@ void measPionCorrelation(const Complex gauge[LX][LY][2], int top, int iter, para
   //topological sector pion correlation
   name = "data/pion/pion_Q" + std::to_string(abs(top));
   constructName(name, p);
-  name += ".dat";  
+  name += suffix + ".dat";  
   sprintf(fname, "%s", name.c_str());
   fp = fopen(fname, "a");
   fprintf(fp, "%d ", iter+1);
@@ -287,7 +232,7 @@ void measPionCorrelation(const Complex gauge[LX][LY][2], int top, int iter, para
   //Full pion correlation
   name = "data/pion/pion";
   constructName(name, p);
-  name += ".dat";  
+  name += suffix + ".dat";  
   sprintf(fname, "%s", name.c_str());
   fp = fopen(fname, "a");
   fprintf(fp, "%d ", iter+1);
@@ -295,146 +240,141 @@ void measPionCorrelation(const Complex gauge[LX][LY][2], int top, int iter, para
     fprintf(fp, "%.16e ", pion_corr[t]);
   fprintf(fp, "\n");
   fclose(fp);
-
 }
 
+//Pion correlators for every valence mass in mValence from one
+//multi-shift solve per source, D(m_i) prop_i = source. The files carry the
+//valence mass as _Mval<m> after the usual name. The valence masses are
+//always solved by BiCGStab-M from a zero guess, whatever p.solverPC and
+//p.deflate say, since the shifted systems share one Krylov space.
+void measPionCorrelationMulti(const latField<Complex> &gauge, const vector<double> &mValence,
+			      int top, int iter, param_t p){
+
+  const int nMass = mValence.size();
+  vector<tmpField<Complex> *> propUp(nMass), propDn(nMass);
+  for(int i=0; i<nMass; i++) {
+    propUp[i] = new tmpField<Complex>;
+    propDn[i] = new tmpField<Complex>;
+  }
+  tmpField<Complex> source;
 
+  zeroField(source);
+  source[0][0][0] = cUnit;
+  int success = DinvpsiMultiShift(vector<latField<Complex> *>(propUp.begin(), propUp.end()),
+				  source, mValence, gauge, p);
 
+  zeroField(source);
+  source[0][0][1] = cUnit;
+  success &= DinvpsiMultiShift(vector<latField<Complex> *>(propDn.begin(), propDn.end()),
+			       source, mValence, gauge, p);
 
+  if(!success)
+    cout << "measPionCorrelationMulti: valence propagators not converged at iter "
+	 << iter+1 << ", correlators written anyway" << endl;
 
+  for(int i=0; i<nMass; i++)
+    writePionCorrelation(*propUp[i], *propDn[i], top, iter, p, "_Mval" + to_string(mValence[i]));
 
+  for(int i=0; i<nMass; i++) {
+    delete propUp[i];
+    delete propDn[i];
+  }
+}
 
+//Sources solved together by the block CG in measVacuumTrace
+#ifndef BLOCK_SRC
+#define BLOCK_SRC 4
+#endif
 
-
-
-
-
-
-
-void measPionCorrelation(Complex*** gauge, int top, int iter, param_t p){
-
-  //Up type fermion prop
-  Complex*** propUp = gst.b15;
-  //Down type fermion prop
-  Complex*** propDn = gst.b16;
+//Propagators D^-1 e_k for the point sources e_k = element src[k] of a
+//Wilson field, f.v[src[k]] = 1, returned as one block of N = src.size()
+//fields. With SOLVER_CG they are solved together by the block CG,
+// e_k -> (g3Dg3) * e_k
+// (g3Dg3D)^-1 * (g3Dg3) e_k = D^-1 * e_k
+//With SOLVER_EIGCG they are solved one at a time on the normal equations
+//by ecg, which grows its deflation space on the way, and otherwise one at
+//a time on D itself (see Dinvpsi).
+void blockPointProps(latField<Complex> &props, const vector<long> &src, int solver,
+		     const latField<Complex> &gauge, const latField<deflComplex> *defl_evecs,
+		     const Complex *defl_evals, param_t p, eigCG *ecg = nullptr){
+
+  const int N = src.size();
+  tmpField<Complex> source(2*N);
+  tmpField<Complex> g3source(2*N);
+  tmpField<Complex> Dsource(2*N);
   //fermion prop CG guess
-  Complex*** propGuess = gst.b17;
-
-  //Deflation eigenvectors
-  Complex defl_evecs[NEV][LX][LY][2];
-  //Deflation eigenvalues
-  Complex defl_evals[NEV];
-      
-  double pion_corr[LY];
-
-  Complex*** source = gst.b18;
-  Complex*** Dsource = gst.b19;
+  tmpField<Complex> propGuess(2*N);
 
-  char fname[256];
-  string name;
-  FILE *fp;
-  
-  //Deflate if requested
-#ifdef USE_ARPACK
-  arpack_solve(gauge, defl_evecs, defl_evals, 0, 0, p);
-#endif
-  
-  //Up type source
   zeroField(source);
-  zeroField(Dsource);
-  zeroField(propUp);
   zeroField(propGuess);
-  source[0][0][0] = cUnit;
-  
-  // up -> (g3Dg3) * up *****
-  // (g3Dg3D)^-1 * (g3Dg3) up = D^-1 * up *****
-
-  g3psi(source);
-  g3Dpsi(Dsource, source, gauge, p);  
+  for(int k=0; k<N; k++) source.v[(src[k]/2)*2*N + (src[k]%2)*N + k] = cUnit;
 
-  if (p.deflate) deflate(propGuess, Dsource, defl_evecs, defl_evals, p);
-  Ainvpsi(propUp, Dsource, propGuess, gauge, p);
+  const bool normal = solver == SOLVER_CG || solver == SOLVER_EIGCG;
+  if(normal || defl_evecs) {
+    g3psi(g3source, source);
+    g3Dpsi(Dsource, g3source, gauge, p);
+  }
 
-  //Down type source
-  zeroField(source);
-  zeroField(Dsource);
-  zeroField(propDn);
-  zeroField(propGuess);
-  source[0][0][1] = cUnit;	    
-      
-  // dn -> (g3Dg3) * dn *****
-  // (g3Dg3D)^-1 * (g3Dg3) dn = D^-1 * dn ***** 
+  //The deflated guess of the normal equations is one for D too
+  if (defl_evecs && solver != SOLVER_EIGCG)
+    deflate(propGuess, Dsource, *defl_evecs, defl_evals, p);
+
+  if(solver == SOLVER_CG) Ainvpsi(props, Dsource, propGuess, gauge, p);
+  else if(solver == SOLVER_EIGCG) {
+    tmpField<Complex> Dk;
+    tmpField<Complex> prop;
+    for(int k=0; k<N; k++) {
+      extractBlock(Dk, Dsource, k);
+      ecg->solve(prop, Dk, gauge, p);
+      insertBlock(props, prop, k);
+    }
+  }
+  else {
+    tmpField<Complex> e;
+    tmpField<Complex> guess;
+    tmpField<Complex> prop;
+    for(int k=0; k<N; k++) {
+      extractBlock(e, source, k);
+      extractBlock(guess, propGuess, k);
+      Dinvpsi(prop, e, guess, gauge, p, solver);
+      insertBlock(props, prop, k);
+    }
+  }
+}
 
-  g3psi(source);
-  g3Dpsi(Dsource, source, gauge, p);
+//The deflation space of a checkpointed 2D gauge field is kept next to it
+//(see deflationSpace)
+string deflationFile(int iter, param_t p) {
+  if(LZ != 1 || (iter+1)%p.chkpt != 0) return "";
+  string name = "gauge/evecs";
+  constructName(name, p);
+  name += "_traj" + to_string(iter+1) + ".dat";
+  return name;
+}
 
-  if (p.deflate) deflate(propGuess, Dsource, defl_evecs, defl_evals, p);
-  Ainvpsi(propDn, Dsource, propGuess, gauge, p);
+void measPionCorrelation(const latField<Complex> &gauge, int top, int iter, param_t p){
 
-  //Get estimate of vacuum trace
-  Complex q[2] = {0.0,0.0};
-  q[0] = propUp[0][0][0];
-  q[1] = propDn[0][0][1];
+  //Up and down type fermion props
+  tmpField<Complex> propUp;
+  tmpField<Complex> propDn;
+  tmpField<Complex> props(4);
 
-  double vacuum_trace = (q[0] - q[1]).real();
-  
-  name = "data/vacuum/estimate_vacuum_Q" + std::to_string(abs(top));
-  constructName(name, p);
-  name += ".dat";
-  sprintf(fname, "%s", name.c_str());
-  fp = fopen(fname, "a");
-  fprintf(fp, "%d ", iter+1);
-  fprintf(fp, "%.16e\n", vacuum_trace);
-  fclose(fp);
-  
-  //Let y be the 'time' dimension
-  double corr = 0.0, tmp = 0.0;
-  for(int y=0; y<LY; y++) {
-    //initialise
-    pion_corr[y] = 0.0;
-    //Loop over space and spin, fold propagator
-    corr = 0.0;
-    for(int x=0; x<LX; x++) {
-      tmp = abs((conj(propDn[x][y][0]) * propDn[x][y][0] +
-      		 conj(propDn[x][y][1]) * propDn[x][y][1] +
-      		 conj(propUp[x][y][0]) * propUp[x][y][0] +
-      		 conj(propUp[x][y][1]) * propUp[x][y][1]));
-      
-      corr += tmp;
-    }
-    
-    //Compute folded propagator
-    if ( y < ((LY/2)+1) ) pion_corr[y] += corr;
-    else {
-      pion_corr[LY-y] += corr;
-      pion_corr[LY-y] /= 2.0;
-    }
+  //Deflation eigenpairs, shared by the measurements on this gauge field
+  latField<deflComplex> *defl_evecs = nullptr;
+  Complex *defl_evals = nullptr;
+  if(p.deflate && p.solverPC != SOLVER_EIGCG) {
+    deflSpace.prepare(gauge, deflationFile(iter, p), p);
+    defl_evecs = deflSpace.evecs;
+    defl_evals = deflSpace.evals.data();
   }
-  
-  //topological sector pion correlation
-  name = "data/pion/pion_Q" + std::to_string(abs(top));
-  constructName(name, p);
-  name += ".dat";  
-  sprintf(fname, "%s", name.c_str());
-  fp = fopen(fname, "a");
-  fprintf(fp, "%d ", iter+1);
-  for(int t=0; t<LY/2+1; t++)
-    fprintf(fp, "%.16e ", pion_corr[t]);
-  fprintf(fp, "\n");
-  fclose(fp);
 
-  //Full pion correlation
-  name = "data/pion/pion";
-  constructName(name, p);
-  name += ".dat";  
-  sprintf(fname, "%s", name.c_str());
-  fp = fopen(fname, "a");
-  fprintf(fp, "%d ", iter+1);
-  for(int t=0; t<LY/2+1; t++)
-    fprintf(fp, "%.16e ", pion_corr[t]);
-  fprintf(fp, "\n");
-  fclose(fp);
+  //Up and down type sources at the origin
+  eigCG ecg;
+  blockPointProps(props, {0, 1}, p.solverPC, gauge, defl_evecs, defl_evals, p, &ecg);
+  extractBlock(propUp, props, 0);
+  extractBlock(propDn, props, 1);
 
+  writePionCorrelation(propUp, propDn, top, iter, p);
 }
 
 
@@ -453,64 +393,41 @@ void measPionCorrelation(Complex*** gauge, int top, int iter, param_t p){
 
 
 
-void measVacuumTrace(const Complex gauge[LX][LY][2], int top, int iter, param_t p) {
+void measVacuumTrace(const latField<Complex> &gauge, int top, int iter, param_t p) {
   
-  //Up type fermion prop
-  Complex propUp[LX][LY][2];
-  //Down type fermion prop
-  Complex propDn[LX][LY][2];
-  //fermion prop CG guess
-  Complex propGuess[LX][LY][2];
-  //Deflation eigenvectors
-  Complex defl_evecs[NEV][LX][LY][2];
-  //Deflation eigenvalues
-  Complex defl_evals[NEV];
+  //Deflation eigenpairs, shared by the measurements on this gauge field
+  latField<deflComplex> *defl_evecs = nullptr;
+  Complex *defl_evals = nullptr;
+  if(p.deflate && p.solverVT != SOLVER_EIGCG) {
+    deflSpace.prepare(gauge, deflationFile(iter, p), p);
+    defl_evecs = deflSpace.evecs;
+    defl_evals = deflSpace.evals.data();
+  }
   
   double vacuum_trace[2] = {0.0, 0.0};
   
-  Complex source[LX][LY][2];
-  Complex Dsource[LX][LY][2];
-  
   //Disconnected
-  //Loop over time slices
-  for(int y=0; y<LY; y++) {
-    
-    //Sum over spatial sites
-    for(int x=0; x<LX; x++) {
-      
-      //Up type source
-      zeroField(source);
-      zeroField(Dsource);
-      zeroField(propUp);
-      source[x][y][0] = cUnit;
-      
-      g3psi(source);
-      g3Dpsi(Dsource, source, gauge, p);
-      if (p.deflate) deflate(propGuess, Dsource, defl_evecs, defl_evals, p);
-      Ainvpsi(propUp, Dsource, propGuess, gauge, p);
-      
-      //Down type source
-      zeroField(source);
-      zeroField(Dsource);
-      zeroField(propDn);
-      source[x][y][1] = cUnit;
-      
-      g3psi(source);
-      g3Dpsi(Dsource, source, gauge, p);
-      if (p.deflate) deflate(propGuess, Dsource, defl_evecs, defl_evals, p);
-      Ainvpsi(propDn, Dsource, propGuess, gauge, p);
-      
-      vacuum_trace[0] += (conj(propDn[x][y][0]) * propDn[x][y][0] +
-			  conj(propDn[x][y][1]) * propDn[x][y][1] +
-			  conj(propUp[x][y][0]) * propUp[x][y][0] +
-			  conj(propUp[x][y][1]) * propUp[x][y][1]).real();
-      
-      vacuum_trace[1] += (conj(propDn[x][y][0]) * propDn[x][y][0] +
-			  conj(propDn[x][y][1]) * propDn[x][y][1] +
-			  conj(propUp[x][y][0]) * propUp[x][y][0] +
-			  conj(propUp[x][y][1]) * propUp[x][y][1]).imag();
-      
-    }    
+  //Up and down type sources on every site, BLOCK_SRC at a time. The eigCG
+  //deflation space grows over the sources.
+  eigCG ecg;
+  const long nSrc = 2L*LX*LY;
+  for(long s0=0; s0<nSrc; s0+=BLOCK_SRC) {
+
+    vector<long> src;
+    for(long s=s0; s<min(s0 + BLOCK_SRC, nSrc); s++) src.push_back(s);
+    const int N = src.size();
+
+    tmpField<Complex> props(2*N);
+    blockPointProps(props, src, p.solverVT, gauge, defl_evecs, defl_evals, p, &ecg);
+
+    //|prop_k|^2 at the source site of prop_k
+    for(int k=0; k<N; k++) {
+      const long i = src[k]/2;
+      Complex tr = (conj(props.v[2*N*i + k]) * props.v[2*N*i + k] +
+		    conj(props.v[2*N*i + N + k]) * props.v[2*N*i + N + k]);
+      vacuum_trace[0] += tr.real();
+      vacuum_trace[1] += tr.imag();
+    }
   }
 
   string name = "data/vacuum/vacuum_Q" + std::to_string(abs(top));
@@ -523,30 +440,12 @@ void measVacuumTrace(const Complex gauge[LX][LY][2], int top, int iter, param_t
   fprintf(fp, "%d ", iter+1);
   fprintf(fp, "%.16e %.16e\n", vacuum_trace[0], vacuum_trace[1]);
   fclose(fp);
-  
-}
 
-double measTopCharge(const Complex gauge[LX][LY][2], param_t p){
-  
-  Complex w;
-  double top = 0.0;  
-  Complex smeared[LX][LY][2];
-  smearLink(smeared, gauge, p);
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      w = (smeared[x][y][0] * smeared[ (x+1)%LX ][y][1] *
-	   conj(smeared[x][ (y+1)%LY ][0])*conj(smeared[x][y][1]));
-      top += arg(w);  // -pi < arg(w) < pi  Geometric value is an integer.
-      //print local def here for topology dynamics
-      //printf("arg(w) = [ arg(link1) + arg(link2) + c_arg(link3) + c_arg(link4)]
-    }
-  return top/TWO_PI;
 }
 
-double measTopCharge(Complex ***gauge, param_t p){
+double measTopCharge(const latField<Complex> &gauge, param_t p){
 
-  Complex*** smeared = gst.b07;
+  tmpField<Complex> smeared;
 
   Complex w;
   double top = 0.0;  
@@ -554,8 +453,8 @@ double measTopCharge(Complex ***gauge, param_t p){
   
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++){
-      w = (smeared[x][y][0] * smeared[ (x+1)%LX ][y][1] *
-	   conj(smeared[x][ (y+1)%LY ][0])*conj(smeared[x][y][1]));
+      w = (smeared[x][y][0] * smeared[nbr.xp[x]][y][1] *
+	   conj(smeared[x][nbr.yp[y]][0])*conj(smeared[x][y][1]));
       top += arg(w);  // -pi < arg(w) < pi  Geometric value is an integer.
       //print local def here for topology dynamics
       //printf("arg(w) = [ arg(link1) + arg(link2) + c_arg(link3) + c_arg(link4)]
@@ -563,170 +462,87 @@ double measTopCharge(Complex ***gauge, param_t p){
   return top/TWO_PI;
 }
 
-double measGaugeAction(const Complex gauge[LX][LY][2], param_t p) {
-
-  double beta  = p.beta;
-  double Hgauge = 0.0;
-  Complex plaq = 0.0;
-  
-  for(int x=0; x<LX;x++)
-    for(int y=0; y<LY; y++){      
-      plaq = gauge[x][y][0]*gauge[ (x+1)%LX ][y][1]*conj(gauge[x][ (y+1)%LY ][0])*conj(gauge[x][y][1]);
-      Hgauge += beta*real(1.0 - plaq);
-    }
-  return Hgauge;
-}
-
-double measGaugeAction(Complex*** gauge, param_t p) {
+double measGaugeAction(const latField<Complex> &gauge, param_t p) {
 
   double beta  = p.beta;
   double Hgauge = 0.0;
-  Complex plaq = 0.0;
   
+#pragma omp parallel for reduction(+:Hgauge)
   for(int x=0; x<LX;x++)
     for(int y=0; y<LY; y++){      
-      plaq = gauge[x][y][0]*gauge[ (x+1)%LX ][y][1]*conj(gauge[x][ (y+1)%LY ][0])*conj(gauge[x][y][1]);
+      Complex plaq = gauge[x][y][0]*gauge[nbr.xp[x]][y][1]*conj(gauge[x][nbr.yp[y]][0])*conj(gauge[x][y][1]);
       Hgauge += beta*real(1.0 - plaq);
     }
   return Hgauge;
 }
 
-double measMomAction(const double mom[LX][LY][2], param_t p) {
+double measMomAction(const latField<double> &mom, param_t p) {
 
   double Hmom = 0.0;
-  Complex plaq;
   
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      for(int mu=0; mu<2; mu++){
-	Hmom += 0.5*mom[x][y][mu] * mom[x][y][mu];
-      }
-    }
-  
-  return Hmom;
-}
-
-double measMomAction(double*** mom, param_t p) {
-
-  double Hmom = 0.0;
-  Complex plaq;
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      for(int mu=0; mu<2; mu++){
-	Hmom += 0.5*mom[x][y][mu] * mom[x][y][mu];
-      }
-    }
+#pragma omp parallel for reduction(+:Hmom)
+  for(long i=0; i<mom.len; i++)
+    Hmom += 0.5*mom.v[i] * mom.v[i];
   
   return Hmom;
 }
 
 //Staggered fermion
-double measFermAction(const Complex gauge[LX][LY][2], const Complex phi[LX][LY],
-		      param_t p, bool postStep) {
+double measFermActionStaggered(const latField<Complex> &gauge, const latField<Complex> &phi,
+			       param_t p, bool postStep, chronoGuess *guess = nullptr) {
   
   double Hferm = 0.0;
-  Complex phitmp[LX][LY];
+  tmpField<Complex> phitmp(1);
   
   // cout << "Before Fermion force H = " << H << endl;
-  Complex scalar = Complex(0.0,0.0);
   zeroField(phitmp);
-  Ainvpsi(phitmp, phi, phitmp, gauge, p);
+  if(guess) Ainvpsi(phitmp, phi, *guess, gauge, p);
+  else Ainvpsi(phitmp, phi, phitmp, gauge, p);
+#pragma omp parallel for reduction(+:Hferm)
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++){
       if((x+y)%2 == 0)
-	scalar += conj(phi[x][y])*phitmp[x][y];
+	Hferm += real(conj(phi[x][y][0])*phitmp[x][y][0]);
     }
   
-  Hferm += real(scalar);
   //cout << "After Fermion Force H  = " << H << endl;
   
   return Hferm;
 }
 
+//Wilson fermion, phi on the EVEN sites. Staggered fields are passed on to
+//the even site action above. With a guess the solve shares the force
+//solves' chronological history and low modes.
+double measFermAction(const latField<Complex> &gauge, const latField<Complex> &phi,
+		      param_t p, bool postStep, chronoGuess *guess = nullptr) {
 
-//Staggered Action
-double measAction(const double mom[LX][LY][2], const Complex gauge[LX][LY][2],
-		  const Complex phi[LX][LY], param_t p, bool postStep) {
-  
-  double H = 0.0;
-  H += measMomAction(mom, p);
-  H += measGaugeAction(gauge, p);
-  if (p.dynamic) H += measFermAction(gauge, phi, p, postStep);
-  
-  return H;
-}
+  if(phi.nd == 1) return measFermActionStaggered(gauge, phi, p, postStep, guess);
 
-//Wilson fermion
-double measFermAction(const Complex gauge[LX][LY][2], const Complex phi[LX][LY][2],
-		      param_t p, bool postStep) {
-  
   double Hferm = 0.0;
-  Complex phitmp[LX][LY][2];
-  
-  //cout << "Before Fermion force H = " << H << endl;
-  Complex scalar = Complex(0.0,0.0);
-  zeroField(phitmp);
-  if(postStep) Ainvpsi(phitmp, phi, phitmp, gauge, p);
-  else copyField(phitmp, phi);
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      for(int s=0; s<2; s++){
-	scalar += conj(phi[x][y][s])*phitmp[x][y][s];
-      }
-    }    
-  
-  Hferm += real(scalar);
-  
-  return Hferm;
-}
-
-double measFermAction(Complex*** gauge, Complex*** phi,
-		      param_t p, bool postStep) {
 
-  double Hferm = 0.0;
-  //Complex phitmp[LX][LY][2];
-
-  Complex*** phitmp = gst.b08;
+  tmpField<Complex> phitmp(2, LX, LY/2);
 
   //cout << "Before Fermion force H = " << H << endl;
-  Complex scalar = Complex(0.0,0.0);
   zeroField(phitmp);
-  if(postStep) Ainvpsi(phitmp, phi, phitmp, gauge, p);
+  if(postStep) {
+    if(guess) Ainvpsi(phitmp, phi, *guess, gauge, p);
+    else Ainvpsi(phitmp, phi, phitmp, gauge, p);
+  }
   else copyField(phitmp, phi);
   
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      for(int s=0; s<2; s++){
-	scalar += conj(phi[x][y][s])*phitmp[x][y][s];
-      }
-    }    
-  
-  Hferm += real(scalar);
+  Hferm += real(dotField(phi, phitmp));
 
   return Hferm;
 }
 
-//Wilson Action
-double measAction(const double mom[LX][LY][2], const Complex gauge[LX][LY][2],
-		  const Complex phi[LX][LY][2], param_t p, bool postStep) {
-  
-  double H = 0.0;
-  H += measMomAction(mom, p);
-  H += measGaugeAction(gauge, p);
-  if (p.dynamic) H += measFermAction(gauge, phi, p, postStep);
-  
-  return H;
-}
-
-double measAction(double*** mom, Complex*** gauge,
-		  Complex*** phi, param_t p, bool postStep) {
+double measAction(const latField<double> &mom, const latField<Complex> &gauge,
+		  const latField<Complex> &phi, param_t p, bool postStep,
+		  chronoGuess *guess = nullptr) {
   
   double H = 0.0;
   H += measMomAction(mom, p);
   H += measGaugeAction(gauge, p);
-  if (p.dynamic) H += measFermAction(gauge, phi, p, postStep);
+  if (p.dynamic) H += measFermAction(gauge, phi, p, postStep, guess);
   
   return H;
 }
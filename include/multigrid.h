@@ -0,0 +1,531 @@
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include <cstring>
+#include "dOpHelpers.h"
+#include "linAlgHelpers.h"
+#include "sap.h"
+
+//Aggregation based multigrid for the Wilson operator
+//---------------------------------------------------------------------------
+// Near m0 = 0 the low modes of D slow every Krylov solver down, and the
+// CG iterations on the normal equations grow with the volume. Adaptive
+// aggregation multigrid (Brannick et al., arXiv:0707.4018; Frommer et
+// al., arXiv:1303.1377) takes them out with a coarse lattice operator
+// built from those very modes. Two levels:
+//
+// Setup: MG_NVEC random fields are brought towards the near null space of
+//   D by MG_SETUP_ITER minimal residual steps on D v = 0, and then improved
+//   MG_SETUP_CYCLES times by v <- K v, with K the cycle below.
+//
+// Aggregation: the lattice is cut into MG_BLOCK x MG_BLOCK blocks and on
+//   every block each test vector is split into its two spin components,
+//   which are orthonormalised separately. These pieces are the columns of
+//   the prolongator P, so P commutes with g3 and Dc = P^dag D P, with
+//   nc = 2 MG_NVEC components per coarse site, is g3 hermitian like D.
+//   D only couples nearest neighbours, so Dc does too, and it is built
+//   directly from the Wilson stencil and the links.
+//
+// Cycle: K r = P Dc^-1 P^dag r followed by MG_SAP_NCY Schwarz cycles
+//   on the residual (see sap.h), or MG_NSMOOTH minimal residual steps on D
+//   where the lattice does not split into SAP blocks. Dc^-1 is itself a
+//   GCR solve to a relative residual MG_COARSE_TOL (a K-cycle). K is not
+//   a fixed linear map, so the outer solver is flexible GCR on D
+//   (DinvpsiFGCR).
+//
+// The setup depends on the gauge field only through D, and nearby gauge
+// fields have nearly the same near null space. A new gauge field only
+// rebuilds Dc from the current P, and every MG_REFRESH gauge fields the
+// test vectors take one more v <- K v step first, so one setup serves the
+// HMC force solves of many trajectories and the propagators measured on
+// the way.
+
+#ifndef MG_BLOCK
+#define MG_BLOCK 8
+#endif
+#ifndef MG_NVEC
+#define MG_NVEC 8
+#endif
+#ifndef MG_SETUP_ITER
+#define MG_SETUP_ITER 20
+#endif
+#ifndef MG_SETUP_CYCLES
+#define MG_SETUP_CYCLES 2
+#endif
+#ifndef MG_REFRESH
+#define MG_REFRESH 10
+#endif
+#ifndef MG_NSMOOTH
+#define MG_NSMOOTH 4
+#endif
+#ifndef MG_SAP_NCY
+#define MG_SAP_NCY 1
+#endif
+#ifndef MG_NKRYLOV
+#define MG_NKRYLOV 10
+#endif
+#ifndef MG_COARSE_TOL
+#define MG_COARSE_TOL 0.1
+#endif
+#ifndef MG_COARSE_NKRYLOV
+#define MG_COARSE_NKRYLOV 16
+#endif
+#ifndef MG_COARSE_MAXITER
+#define MG_COARSE_MAXITER 200
+#endif
+
+class wilsonMG {
+
+public:
+  int lx = 0, ly = 0;             // Coarse lattice extents
+  int nc = 2*MG_NVEC;             // Coarse components per site, spin major
+  double m0 = 0.0;                // Mass of the setup
+  bool ready = false;
+  int nGauge = 0;                 // Gauge fields seen since the setup
+  latField<Complex> *U = nullptr; // Gauge field of Dc
+  vector<latField<Complex> *> V;  // Test vectors
+  latField<Complex> *P = nullptr; // Their block orthonormalised pieces, as
+                                  // one block of MG_NVEC fields (see insertBlock)
+  // Dc on coarse site c in direction d = 0 (the site itself), 1 (+x),
+  // 2 (-x), 3 (+y), 4 (-y) is the nc x nc matrix at Dc[(c*5 + d)*nc*nc]
+  vector<Complex> Dc;
+  // Dc = A (1 + Dh) with A the site blocks of Dc: Ainv[c*nc*nc] is the
+  // inverse of A on site c, and Dh(c, d) = A^-1 Dc(c, d) is stored column
+  // by column from Dh[(c*4 + d-1)*nc*nc], the nc real parts of a column
+  // followed by its nc imaginary parts (see coarseHop)
+  vector<Complex> Ainv, Dh;
+  bool eo = false;                // Even coarse extents, see coarseSolve
+  vector<vector<Complex>> cp, cAp;  // Coarse GCR directions
+  unsigned short seed[3] = {4321, 8765, 2109};
+
+  wilsonMG() {}
+  ~wilsonMG() { clear(); }
+
+  wilsonMG(const wilsonMG &) = delete;
+  wilsonMG &operator=(const wilsonMG &) = delete;
+
+  void clear() {
+    for(auto v : V) delete v;
+    V.clear();
+    delete P;
+    delete U;
+    P = nullptr;
+    U = nullptr;
+    ready = false;
+  }
+
+  inline int coarseSite(int x, int y) const { return (x/MG_BLOCK)*ly + y/MG_BLOCK; }
+
+  // rc = P^dag r
+  void restrictField(vector<Complex> &rc, const latField<Complex> &r) {
+
+    const int nv = MG_NVEC, B = MG_BLOCK;
+#pragma omp parallel for
+    for(int c=0; c<lx*ly; c++) {
+      const int X = c/ly, Y = c%ly;
+      Complex *out = rc.data() + (long)c*nc;
+      for(int a=0; a<nc; a++) out[a] = 0.0;
+      for(int x=X*B; x<(X+1)*B; x++)
+	for(int y=Y*B; y<(Y+1)*B; y++) {
+	  const Complex *rs = r.site(x, y);
+	  const Complex *ps = P->site(x, y);
+	  for(int s=0; s<2; s++)
+	    for(int k=0; k<nv; k++) out[s*nv + k] += cdagtimes(ps[s*nv + k], rs[s]);
+	}
+    }
+  }
+
+  // x = P xc
+  void prolong(latField<Complex> &x, const vector<Complex> &xc) {
+
+    const int nv = MG_NVEC;
+#pragma omp parallel for
+    for(int i=0; i<LX; i++)
+      for(int j=0; j<LY; j++) {
+	const Complex *in = xc.data() + (long)coarseSite(i, j)*nc;
+	const Complex *ps = P->site(i, j);
+	Complex *out = x.site(i, j);
+	for(int s=0; s<2; s++) {
+	  Complex sum = 0.0;
+	  for(int k=0; k<nv; k++) sum += ctimes(ps[s*nv + k], in[s*nv + k]);
+	  out[s] = sum;
+	}
+      }
+  }
+
+  // out = Dc in
+  void coarseOp(vector<Complex> &out, const vector<Complex> &in) {
+
+    const long n2 = nc*nc;
+#pragma omp parallel for
+    for(int c=0; c<lx*ly; c++) {
+      const int X = c/ly, Y = c%ly;
+      const int nb[5] = {c, ((X+1)%lx)*ly + Y, ((X-1+lx)%lx)*ly + Y,
+			 X*ly + (Y+1)%ly, X*ly + (Y-1+ly)%ly};
+      Complex *o = out.data() + (long)c*nc;
+      for(int a=0; a<nc; a++) o[a] = 0.0;
+      for(int d=0; d<5; d++) {
+	const Complex *M = Dc.data() + ((long)c*5 + d)*n2;
+	const Complex *v = in.data() + (long)nb[d]*nc;
+	for(int a=0; a<nc; a++) {
+	  Complex sum = 0.0;
+	  for(int b=0; b<nc; b++) sum += ctimes(M[a*nc + b], v[b]);
+	  o[a] += sum;
+	}
+      }
+    }
+  }
+
+  // Dc = P^dag D P, term by term from the Wilson stencil (see wilsonRow):
+  // the mass term, and the hops -1/2 (1 - sigma_mu) U_{n,mu} to n + mu and
+  // -1/2 (1 + sigma_mu) U^dag_{n-mu,mu} to n - mu. A hop leaving the block
+  // lands in the direction of the coarse neighbour it reaches.
+  void buildCoarse(param_t param) {
+
+    const int nv = MG_NVEC, B = MG_BLOCK;
+    const long n2 = nc*nc;
+    const Complex S[5][2][2] = {{{1.0, 0.0}, {0.0, 1.0}},
+				{{1.0, -1.0}, {-1.0, 1.0}},
+				{{1.0, 1.0}, {1.0, 1.0}},
+				{{1.0, I}, {-I, 1.0}},
+				{{1.0, -I}, {I, 1.0}}};
+    Dc.assign((long)lx*ly*5*n2, 0.0);
+
+#pragma omp parallel for
+    for(int c=0; c<lx*ly; c++) {
+      const int X = c/ly, Y = c%ly;
+      Complex *Dcs = Dc.data() + (long)c*5*n2;
+      for(int x=X*B; x<(X+1)*B; x++)
+	for(int y=Y*B; y<(Y+1)*B; y++) {
+	  const int xn[5] = {x, nbr.xp[x], nbr.xm[x], x, x};
+	  const int yn[5] = {y, y, y, nbr.yp[y], nbr.ym[y]};
+	  const int dir[5] = {0, (x+1)%B == 0 ? 1 : 0, x%B == 0 ? 2 : 0,
+			      (y+1)%B == 0 ? 3 : 0, y%B == 0 ? 4 : 0};
+	  const Complex link[5] = {param.m + 2.0,
+				   -0.5*(*U)(x, y, 0), -0.5*conj((*U)(nbr.xm[x], y, 0)),
+				   -0.5*(*U)(x, y, 1), -0.5*conj((*U)(x, nbr.ym[y], 1))};
+	  for(int t=0; t<5; t++) {
+	    Complex *M = Dcs + dir[t]*n2;
+	    for(int s=0; s<2; s++)
+	      for(int s2=0; s2<2; s2++) {
+		if(S[t][s][s2] == 0.0) continue;
+		const Complex w = link[t]*S[t][s][s2];
+		const Complex *pn = P->site(xn[t], yn[t]) + s2*nv;
+		for(int k=0; k<nv; k++) {
+		  const Complex pw = conj(P->site(x, y)[s*nv + k])*w;
+		  Complex *row = M + (s*nv + k)*nc + s2*nv;
+		  for(int k2=0; k2<nv; k2++) row[k2] += pw*pn[k2];
+		}
+	      }
+	  }
+	}
+    }
+
+    Ainv.resize((long)lx*ly*n2);
+    Dh.resize((long)lx*ly*4*n2);
+#pragma omp parallel for
+    for(int c=0; c<lx*ly; c++) {
+      vector<Complex> A(Dc.begin() + (long)c*5*n2, Dc.begin() + (long)c*5*n2 + n2), Ai, H(n2);
+      if(!invertMatrix(Ai, A, nc)) {
+	cout << "Error in wilsonMG: singular coarse site block" << endl;
+	exit(0);
+      }
+      copy(Ai.begin(), Ai.end(), Ainv.begin() + (long)c*n2);
+      for(int d=1; d<5; d++) {
+	vector<Complex> M(Dc.begin() + ((long)c*5 + d)*n2, Dc.begin() + ((long)c*5 + d + 1)*n2);
+	matMul(H, Ai, M, nc);
+	double *h = (double *)(Dh.data() + ((long)c*4 + d-1)*n2);
+	for(int b=0; b<nc; b++)
+	  for(int a=0; a<nc; a++) {
+	    h[2*b*nc + a] = H[a*nc + b].real();
+	    h[(2*b + 1)*nc + a] = H[a*nc + b].imag();
+	  }
+      }
+    }
+  }
+
+  // out = Dh in on the coarse sites of parity par, or on all of them for
+  // par < 0. The other sites of out are left alone.
+  void coarseHop(vector<Complex> &out, const vector<Complex> &in, int par) {
+
+    const long n2 = nc*nc;
+#pragma omp parallel for
+    for(int c=0; c<lx*ly; c++) {
+      const int X = c/ly, Y = c%ly;
+      if(par >= 0 && (X+Y)%2 != par) continue;
+      const int nb[4] = {((X+1)%lx)*ly + Y, ((X-1+lx)%lx)*ly + Y,
+			 X*ly + (Y+1)%ly, X*ly + (Y-1+ly)%ly};
+      // Column by column, so that the site vector accumulates in
+      // vector registers
+      const int N = 2*MG_NVEC;
+      double re[N] = {}, im[N] = {};
+      for(int d=0; d<4; d++) {
+	const double *m = (const double *)(Dh.data() + ((long)c*4 + d)*n2);
+	const Complex *v = in.data() + (long)nb[d]*N;
+	for(int b=0; b<N; b++, m+=2*N) {
+	  const double vr = v[b].real(), vi = v[b].imag();
+#pragma omp simd
+	  for(int a=0; a<N; a++) {
+	    re[a] += m[a]*vr - m[N + a]*vi;
+	    im[a] += m[a]*vi + m[N + a]*vr;
+	  }
+	}
+      }
+      for(int a=0; a<N; a++) out[(long)c*N + a] = Complex(re[a], im[a]);
+    }
+  }
+
+  // out = (1 + Dh) in, or with eo the Schur complement 1 - Dh_eo Dh_oe on
+  // the even sites, for in and out zero on the odd ones
+  void coarseSchur(vector<Complex> &out, const vector<Complex> &in, vector<Complex> &tmp) {
+
+    if(eo) {
+      coarseHop(tmp, in, 1);
+      coarseHop(out, tmp, 0);
+#pragma omp parallel for
+      for(int c=0; c<lx*ly; c++) {
+	const bool even = (c/ly + c%ly)%2 == 0;
+	for(int a=0; a<nc; a++) {
+	  const long l = (long)c*nc + a;
+	  out[l] = even ? in[l] - out[l] : 0.0;
+	}
+      }
+    }
+    else {
+      coarseHop(out, in, -1);
+      for(long l=0; l<(long)out.size(); l++) out[l] += in[l];
+    }
+  }
+
+  // P from V: Gram-Schmidt (twice) on every block and spin
+  void buildP() {
+
+    const int nv = MG_NVEC, B = MG_BLOCK;
+    for(int k=0; k<nv; k++) insertBlock(*P, *V[k], k);
+#pragma omp parallel for
+    for(int c=0; c<lx*ly; c++) {
+      const int X = c/ly, Y = c%ly;
+      for(int s=0; s<2; s++)
+	for(int k=s*nv; k<(s+1)*nv; k++) {
+	  for(int pass=0; pass<2; pass++)
+	    for(int j=s*nv; j<k; j++) {
+	      Complex d = 0.0;
+	      for(int x=X*B; x<(X+1)*B; x++)
+		for(int y=Y*B; y<(Y+1)*B; y++) d += cdagtimes(P->site(x, y)[j], P->site(x, y)[k]);
+	      for(int x=X*B; x<(X+1)*B; x++)
+		for(int y=Y*B; y<(Y+1)*B; y++) P->site(x, y)[k] -= ctimes(d, P->site(x, y)[j]);
+	    }
+	  double nrm = 0.0;
+	  for(int x=X*B; x<(X+1)*B; x++)
+	    for(int y=Y*B; y<(Y+1)*B; y++) nrm += norm(P->site(x, y)[k]);
+	  nrm = 1.0/sqrt(nrm);
+	  for(int x=X*B; x<(X+1)*B; x++)
+	    for(int y=Y*B; y<(Y+1)*B; y++) P->site(x, y)[k] *= nrm;
+	}
+    }
+  }
+
+  // Dc xc = rc from xc = 0, as (1 + Dh) xc = A^-1 rc. With even coarse
+  // extents Dh only links opposite parities, and the odd sites are
+  // eliminated as for D (see wilsonDhatEO), which about halves the
+  // iterations. Restarted GCR then solves the Schur complement to a
+  // residual MG_COARSE_TOL times that of its right hand side. Returns the
+  // number of iterations.
+  int coarseSolve(vector<Complex> &xc, const vector<Complex> &rc) {
+
+    const long n = rc.size(), n2 = nc*nc;
+    vector<vector<Complex>> &p = cp, &Ap = cAp;
+    double ApNorm[MG_COARSE_NKRYLOV];
+    vector<Complex> bh(n), res(n), tmp(n);
+    xc.assign(n, 0.0);
+
+    // bh = A^-1 rc, then res = bh_e - Dh_eo bh_o on the even sites
+#pragma omp parallel for
+    for(int c=0; c<lx*ly; c++) {
+      const Complex *Ai = Ainv.data() + (long)c*n2;
+      for(int a=0; a<nc; a++) {
+	Complex sum = 0.0;
+	for(int b=0; b<nc; b++) sum += ctimes(Ai[a*nc + b], rc[(long)c*nc + b]);
+	bh[(long)c*nc + a] = sum;
+      }
+    }
+    if(eo) {
+      coarseHop(tmp, bh, 0);
+      for(int c=0; c<lx*ly; c++) {
+	const bool even = (c/ly + c%ly)%2 == 0;
+	for(int a=0; a<nc; a++) {
+	  const long l = (long)c*nc + a;
+	  res[l] = even ? bh[l] - tmp[l] : 0.0;
+	}
+      }
+    }
+    else res = bh;
+
+    double rsq = 0.0;
+    for(long l=0; l<n; l++) rsq += norm(res[l]);
+    const double tol = MG_COARSE_TOL*MG_COARSE_TOL*rsq;
+
+    int k;
+    for(k=0; k<MG_COARSE_MAXITER && rsq > tol; k++) {
+      const int j = k%MG_COARSE_NKRYLOV;
+      p[j] = res;
+      coarseSchur(Ap[j], p[j], tmp);
+      for(int i=0; i<j; i++) {
+	Complex c = 0.0;
+	for(long l=0; l<n; l++) c += cdagtimes(Ap[i][l], Ap[j][l]);
+	c /= ApNorm[i];
+	for(long l=0; l<n; l++) {
+	  Ap[j][l] -= ctimes(c, Ap[i][l]);
+	  p[j][l] -= ctimes(c, p[i][l]);
+	}
+      }
+      double an = 0.0;
+      Complex a = 0.0;
+      for(long l=0; l<n; l++) {
+	an += norm(Ap[j][l]);
+	a += cdagtimes(Ap[j][l], res[l]);
+      }
+      ApNorm[j] = an;
+      a /= an;
+      rsq = 0.0;
+      for(long l=0; l<n; l++) {
+	xc[l] += ctimes(a, p[j][l]);
+	res[l] -= ctimes(a, Ap[j][l]);
+	rsq += norm(res[l]);
+      }
+    }
+
+    // x_o = bh_o - Dh_oe x_e
+    if(eo) {
+      coarseHop(tmp, xc, 1);
+      for(int c=0; c<lx*ly; c++)
+	if((c/ly + c%ly)%2 == 1)
+	  for(int a=0; a<nc; a++) xc[(long)c*nc + a] = bh[(long)c*nc + a] - tmp[(long)c*nc + a];
+    }
+    return k;
+  }
+
+  // n minimal residual steps on D z = r, with res = r - D z on entry and
+  // kept up to date
+  void smooth(latField<Complex> &z, latField<Complex> &res, int n,
+	      const latField<Complex> &gauge, param_t param) {
+
+    tmpField<Complex> Dr;
+    for(int i=0; i<n; i++) {
+      Dpsi(Dr, res, gauge, param);
+      double re = 0.0, im = 0.0, dn = 0.0;
+#pragma omp parallel for reduction(+:re,im,dn)
+      for(long l=0; l<res.len; l++) {
+	Complex prod = cdagtimes(Dr.v[l], res.v[l]);
+	re += prod.real();
+	im += prod.imag();
+	dn += norm(Dr.v[l]);
+      }
+      const Complex alpha = Complex(re, im)/dn;
+#pragma omp parallel for
+      for(long l=0; l<res.len; l++) {
+	z.v[l] += ctimes(alpha, res.v[l]);
+	res.v[l] -= ctimes(alpha, Dr.v[l]);
+      }
+    }
+  }
+
+  // z = K r
+  void cycle(latField<Complex> &z, const latField<Complex> &r,
+	     const latField<Complex> &gauge, param_t param) {
+
+    vector<Complex> rc((long)lx*ly*nc), xc;
+    restrictField(rc, r);
+    coarseSolve(xc, rc);
+    prolong(z, xc);
+
+    tmpField<Complex> res;
+    Dpsi(res, z, gauge, param);
+    axpy(-1.0, res, r, res);
+    if(sapFits()) {
+      tmpField<Complex> e;
+      sapPrec(e, res, gauge, param, MG_SAP_NCY);
+      axpy(1.0, e, z);
+    }
+    else smooth(z, res, MG_NSMOOTH, gauge, param);
+  }
+
+  // n rounds of v <- K v on the test vectors, each followed by a new P and Dc
+  void improve(const latField<Complex> &gauge, param_t param, int n) {
+
+    tmpField<Complex> Kv;
+    for(int i=0; i<n; i++) {
+      for(auto v : V) {
+	cycle(Kv, *v, gauge, param);
+	copyField(*v, Kv);
+	ax(1.0/sqrt(norm2(*v)), *v);
+      }
+      buildP();
+      buildCoarse(param);
+    }
+  }
+
+  void setup(const latField<Complex> &gauge, param_t param) {
+
+    if(LX%MG_BLOCK != 0 || LY%MG_BLOCK != 0) {
+      cout << "Error in wilsonMG: LX and LY must be multiples of MG_BLOCK = " << MG_BLOCK << endl;
+      exit(0);
+    }
+    clear();
+    lx = LX/MG_BLOCK;
+    ly = LY/MG_BLOCK;
+    eo = lx%2 == 0 && ly%2 == 0;
+    cp.assign(MG_COARSE_NKRYLOV, vector<Complex>((long)lx*ly*nc));
+    cAp.assign(MG_COARSE_NKRYLOV, vector<Complex>((long)lx*ly*nc));
+    m0 = param.m;
+    U = new latField<Complex>(2);
+    P = new latField<Complex>(nc);
+    copyField(*U, gauge);
+
+    // Random vectors relaxed on D v = 0
+    tmpField<Complex> res;
+    for(int k=0; k<MG_NVEC; k++) {
+      latField<Complex> *v = new latField<Complex>(2);
+      for(long l=0; l<v->len; l++) v->v[l] = Complex(erand48(seed) - 0.5, erand48(seed) - 0.5);
+      Dpsi(res, *v, gauge, param);
+      ax(-1.0, res);
+      smooth(*v, res, MG_SETUP_ITER, gauge, param);
+      ax(1.0/sqrt(norm2(*v)), *v);
+      V.push_back(v);
+    }
+    buildP();
+    buildCoarse(param);
+    improve(gauge, param, MG_SETUP_CYCLES);
+    nGauge = 0;
+    ready = true;
+  }
+
+  // Brings the setup to the current gauge field and mass
+  void prepare(const latField<Complex> &gauge, param_t param) {
+
+    if(!ready || param.m != m0) {
+      setup(gauge, param);
+      return;
+    }
+    if(memcmp(U->v, gauge.v, gauge.bytes()) == 0) return;
+    copyField(*U, gauge);
+    buildCoarse(param);
+    if(++nGauge%MG_REFRESH == 0) improve(gauge, param, 1);
+  }
+
+  // Flexible GCR on D x = b preconditioned by K (see DinvpsiFGCR)
+  int solve(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &x0,
+	    const latField<Complex> &gauge, param_t param) {
+
+    prepare(gauge, param);
+    return DinvpsiFGCR<MG_NKRYLOV>(x, b, x0, gauge, param,
+				   [&](latField<Complex> &z, const latField<Complex> &r) {
+				     cycle(z, r, gauge, param);
+				   }, "MG");
+  }
+};
+
+//One setup for the whole run, carried across gauge fields (see prepare)
+wilsonMG mgWilson;
+
+#endif
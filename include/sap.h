@@ -0,0 +1,359 @@
+#ifndef SAP_H
+#define SAP_H
+
+#include "dOpHelpers.h"
+
+//Schwarz alternating procedure
+//---------------------------------------------------------------------------
+// Domain decomposition preconditioner for the Wilson operator (Luscher,
+// hep-lat/0310048). The lattice is cut into SAP_BLOCK x SAP_BLOCK blocks,
+// coloured red and black like the sites of a checkerboard, and D_B is D
+// restricted to one block with the hops leaving it dropped. One cycle
+// solves D_B dz = res approximately on all red blocks, and then on all
+// black ones with the residual the red updates left behind. Blocks of one
+// colour do not touch, so they are independent: each is a task for its own
+// thread, and its local solve, SAP_NMR minimal residual steps on D_B, runs
+// on a few kilobytes that stay in cache and needs no global reduction.
+//
+// Only the residual on the blocks of the colour about to be solved is
+// needed, and after a half cycle it differs from the one the other colour
+// left on them just by the hops from the new updates across the block
+// faces. Those are added as each block is loaded, so the residual is
+// never recomputed on the whole lattice. LX and LY must be multiples of
+// 2 SAP_BLOCK, so that the colours also alternate across the boundary.
+//
+// K r, SAP_NCY cycles from z = 0, is not a fixed linear map of r (the MR
+// coefficients depend on it), so it preconditions flexible GCR.
+
+#ifndef SAP_BLOCK
+#define SAP_BLOCK 8
+#endif
+#ifndef SAP_NCY
+#define SAP_NCY 4
+#endif
+#ifndef SAP_NMR
+#define SAP_NMR 16
+#endif
+#ifndef SAP_NKRYLOV
+#define SAP_NKRYLOV 10
+#endif
+
+// out += the hop of D from psi in direction d = 0 (+x), 1 (-x), 2 (+y),
+// 3 (-y): -1/2 (1 - sigma_mu) U psi forwards and -1/2 (1 + sigma_mu) U psi
+// backwards, with u the link already conjugated for the backward hops
+template<int d>
+inline void sapHop(Complex *out, const Complex u, const Complex *psi) {
+
+  if(d == 0) {
+    const Complex t = ctimes(-0.5*u, psi[0] - psi[1]);
+    out[0] += t;
+    out[1] -= t;
+  }
+  else if(d == 1) {
+    const Complex t = ctimes(-0.5*u, psi[0] + psi[1]);
+    out[0] += t;
+    out[1] += t;
+  }
+  else if(d == 2) {
+    const Complex t = ctimes(-0.5*u, Complex(psi[0].real() - psi[1].imag(), psi[0].imag() + psi[1].real()));
+    out[0] += t;
+    out[1] += Complex(t.imag(), -t.real());
+  }
+  else {
+    const Complex t = ctimes(-0.5*u, Complex(psi[0].real() + psi[1].imag(), psi[0].imag() - psi[1].real()));
+    out[0] += t;
+    out[1] += Complex(-t.imag(), t.real());
+  }
+}
+
+// The local solves work on the block copied out in split layout: real
+// and imaginary parts of the two spin components (of the x and y links)
+// as four arrays of SAP_LEN doubles, site (i, j) of the block at
+// SAP_BLOCK*(i + 1) + j. The SAP_BLOCK zeros on either side, and the links
+// zeroed where the hops leave the block, make D_B one branch free loop
+// over the block that the compiler vectorises. Like the block kernels of
+// fermionHelpers.h it is built for AVX2 and AVX-512 and picked at run time.
+#define SAP_LEN (SAP_BLOCK*(SAP_BLOCK + 2))
+
+// SAP_NMR minimal residual steps on D_B d = rho, d = 0 on entry
+inline __attribute__((always_inline)) void sapBlockMRBody(double *d, double *rho, double *q,
+							  const double *u, double m0) {
+
+  const int B = SAP_BLOCK, n = B*B, S = SAP_LEN;
+  double *r0r = rho + B, *r0i = rho + S + B, *r1r = rho + 2*S + B, *r1i = rho + 3*S + B;
+  double *q0r = q + B, *q0i = q + S + B, *q1r = q + 2*S + B, *q1i = q + 3*S + B;
+  double *d0r = d + B, *d0i = d + S + B, *d1r = d + 2*S + B, *d1i = d + 3*S + B;
+  const double *uxr = u + B, *uxi = u + S + B, *uyr = u + 2*S + B, *uyi = u + 3*S + B;
+  const double c = m0 + 2.0;
+
+  for(int k=0; k<SAP_NMR; k++) {
+
+    // q = D_B rho
+#pragma omp simd
+    for(int l=0; l<n; l++) {
+      double o0r = c*r0r[l], o0i = c*r0i[l], o1r = c*r1r[l], o1i = c*r1i[l];
+      double vr, vi, tr, ti;
+
+      vr = r0r[l+B] - r1r[l+B];
+      vi = r0i[l+B] - r1i[l+B];
+      tr = -0.5*(uxr[l]*vr - uxi[l]*vi);
+      ti = -0.5*(uxr[l]*vi + uxi[l]*vr);
+      o0r += tr; o0i += ti; o1r -= tr; o1i -= ti;
+
+      vr = r0r[l-B] + r1r[l-B];
+      vi = r0i[l-B] + r1i[l-B];
+      tr = -0.5*(uxr[l-B]*vr + uxi[l-B]*vi);
+      ti = -0.5*(uxr[l-B]*vi - uxi[l-B]*vr);
+      o0r += tr; o0i += ti; o1r += tr; o1i += ti;
+
+      vr = r0r[l+1] - r1i[l+1];
+      vi = r0i[l+1] + r1r[l+1];
+      tr = -0.5*(uyr[l]*vr - uyi[l]*vi);
+      ti = -0.5*(uyr[l]*vi + uyi[l]*vr);
+      o0r += tr; o0i += ti; o1r += ti; o1i -= tr;
+
+      vr = r0r[l-1] + r1i[l-1];
+      vi = r0i[l-1] - r1r[l-1];
+      tr = -0.5*(uyr[l-1]*vr + uyi[l-1]*vi);
+      ti = -0.5*(uyr[l-1]*vi - uyi[l-1]*vr);
+      o0r += tr; o0i += ti; o1r -= ti; o1i += tr;
+
+      q0r[l] = o0r; q0i[l] = o0i; q1r[l] = o1r; q1i[l] = o1i;
+    }
+
+    // a = <q, rho>/|q|^2
+    double qrr = 0.0, qri = 0.0, qq = 0.0;
+#pragma omp simd reduction(+:qrr,qri,qq)
+    for(int l=0; l<n; l++) {
+      qrr += q0r[l]*r0r[l] + q0i[l]*r0i[l] + q1r[l]*r1r[l] + q1i[l]*r1i[l];
+      qri += q0r[l]*r0i[l] - q0i[l]*r0r[l] + q1r[l]*r1i[l] - q1i[l]*r1r[l];
+      qq += q0r[l]*q0r[l] + q0i[l]*q0i[l] + q1r[l]*q1r[l] + q1i[l]*q1i[l];
+    }
+    if(qq == 0.0) break;
+    const double ar = qrr/qq, ai = qri/qq;
+
+    // d += a rho, rho -= a q
+#pragma omp simd
+    for(int l=0; l<n; l++) {
+      d0r[l] += ar*r0r[l] - ai*r0i[l];
+      d0i[l] += ar*r0i[l] + ai*r0r[l];
+      d1r[l] += ar*r1r[l] - ai*r1i[l];
+      d1i[l] += ar*r1i[l] + ai*r1r[l];
+      r0r[l] -= ar*q0r[l] - ai*q0i[l];
+      r0i[l] -= ar*q0i[l] + ai*q0r[l];
+      r1r[l] -= ar*q1r[l] - ai*q1i[l];
+      r1i[l] -= ar*q1i[l] + ai*q1r[l];
+    }
+  }
+}
+
+void sapBlockMRScalar(double *d, double *rho, double *q, const double *u, double m0) {
+  sapBlockMRBody(d, rho, q, u, m0);
+}
+
+#ifdef BLOCK_SIMD
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+void sapBlockMRAVX2(double *d, double *rho, double *q, const double *u, double m0) {
+  sapBlockMRBody(d, rho, q, u, m0);
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+void sapBlockMRAVX512(double *d, double *rho, double *q, const double *u, double m0) {
+  sapBlockMRBody(d, rho, q, u, m0);
+}
+#pragma GCC pop_options
+#endif
+
+// The blocks of each colour must not touch across the boundary either
+inline bool sapFits() { return LX%(2*SAP_BLOCK) == 0 && LY%(2*SAP_BLOCK) == 0; }
+
+// z = K r, with ncy cycles
+void sapPrec(latField<Complex> &z, const latField<Complex> &r,
+	     const latField<Complex> &gauge, param_t param, int ncy = SAP_NCY) {
+
+  const int B = SAP_BLOCK, nbx = LX/B, nby = LY/B, S = SAP_LEN;
+  if(!sapFits()) {
+    cout << "Error in sapPrec: LX and LY must be multiples of 2*SAP_BLOCK = " << 2*B << endl;
+    exit(0);
+  }
+
+  void (*kernel)(double *, double *, double *, const double *, double) = sapBlockMRScalar;
+#ifdef BLOCK_SIMD
+  if(blockISA() == 2) kernel = sapBlockMRAVX512;
+  else if(blockISA() == 1) kernel = sapBlockMRAVX2;
+#endif
+
+  // res: the residual, up to date on the blocks last solved. dz: the
+  // update of the last half cycle on each block
+  tmpField<Complex> res;
+  tmpField<Complex> dz;
+  copyField(res, r);
+  zeroField(z);
+  zeroField(dz);
+
+  for(int cy=0; cy<ncy; cy++)
+    for(int col=0; col<2; col++) {
+#pragma omp parallel for
+      for(int b=0; b<nbx*nby/2; b++) {
+	const int X = (2*b)/nby, Y = (2*b)%nby + (X + col)%2;
+	const int x0 = X*B, y0 = Y*B;
+	alignas(64) double rho[4*S] = {}, d[4*S] = {}, q[4*S], u[4*S] = {};
+
+	// rho = res - the hops into the block from the other colour's dz
+	for(int i=0; i<B; i++)
+	  for(int j=0; j<B; j++) {
+	    const int x = x0 + i, y = y0 + j, l = B*(i + 1) + j;
+	    Complex o[2] = {0.0, 0.0};
+	    if(cy > 0 || col > 0) {
+	      if(i == B-1) sapHop<0>(o, gauge(x, y, 0), dz.site(nbr.xp[x], y));
+	      if(i == 0) sapHop<1>(o, conj(gauge(nbr.xm[x], y, 0)), dz.site(nbr.xm[x], y));
+	      if(j == B-1) sapHop<2>(o, gauge(x, y, 1), dz.site(x, nbr.yp[y]));
+	      if(j == 0) sapHop<3>(o, conj(gauge(x, nbr.ym[y], 1)), dz.site(x, nbr.ym[y]));
+	    }
+	    for(int s=0; s<2; s++) {
+	      const Complex v = res(x, y, s) - o[s];
+	      rho[2*s*S + l] = v.real();
+	      rho[(2*s + 1)*S + l] = v.imag();
+	    }
+	    if(i < B-1) {
+	      u[l] = gauge(x, y, 0).real();
+	      u[S + l] = gauge(x, y, 0).imag();
+	    }
+	    if(j < B-1) {
+	      u[2*S + l] = gauge(x, y, 1).real();
+	      u[3*S + l] = gauge(x, y, 1).imag();
+	    }
+	  }
+
+	kernel(d, rho, q, u, param.m);
+
+	for(int i=0; i<B; i++)
+	  for(int j=0; j<B; j++) {
+	    const int x = x0 + i, y = y0 + j, l = B*(i + 1) + j;
+	    for(int s=0; s<2; s++) {
+	      const Complex ds(d[2*s*S + l], d[(2*s + 1)*S + l]);
+	      z(x, y, s) += ds;
+	      dz(x, y, s) = ds;
+	      res(x, y, s) = Complex(rho[2*s*S + l], rho[(2*s + 1)*S + l]);
+	    }
+	  }
+      }
+    }
+}
+
+// Flexible GCR on D x = b, z_j = K res with K any preconditioner, and
+// otherwise as DinvpsiGCR: restarted every nkrylov iterations, converged
+// when |b - D x|^2 < eps |b|^2. K gets the residual and returns z_j.
+template<int nkrylov, typename Prec>
+int DinvpsiFGCR(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &x0,
+		const latField<Complex> &gauge, param_t param, Prec K, const char *name) {
+
+  int success = 0;
+
+  tmpField<Complex> z[nkrylov];
+  tmpField<Complex> Az[nkrylov];
+  double AzNorm[nkrylov];
+  Complex *zv[nkrylov], *Azv[nkrylov];
+  for(int i=0; i<nkrylov; i++) {
+    zv[i] = z[i].v;
+    Azv[i] = Az[i].v;
+  }
+  tmpField<Complex> res;
+
+  double bnorm = norm2(b);
+  if(bnorm == 0 || bnorm != bnorm) {
+    cout << "Error in " << name << ": inverting on zero source... or nan!" << endl;
+    exit(0);
+  }
+
+  copyField(x, x0);
+  copyField(res, b);
+  if(norm2(x0) != 0.0) {
+    Dpsi(Az[0], x0, gauge, param);
+    axpy(-1.0, Az[0], res);
+  }
+  double rsq = norm2(res);
+
+  int k;
+  for(k=0; k<param.maxIterCG && rsq >= param.eps*bnorm; k++) {
+
+    const int j = k%nkrylov;
+    if(j == 0 && k > 0) {
+      // Restart on the true residual
+      Dpsi(Az[0], x, gauge, param);
+      axpy(-1.0, Az[0], b, res);
+    }
+
+    K(z[j], res);
+    Dpsi(Az[j], z[j], gauge, param);
+
+    // c_i = <D z_i, D z_j>/|D z_i|^2
+    double cre[nkrylov] = {}, cim[nkrylov] = {};
+    if(j > 0) {
+#pragma omp parallel for reduction(+:cre[:nkrylov],cim[:nkrylov])
+      for(long l=0; l<b.len; l++)
+	for(int i=0; i<j; i++) {
+	  Complex prod = cdagtimes(Azv[i][l], Azv[j][l]);
+	  cre[i] += prod.real();
+	  cim[i] += prod.imag();
+	}
+    }
+    Complex c[nkrylov];
+    for(int i=0; i<j; i++) c[i] = Complex(cre[i], cim[i])/AzNorm[i];
+
+    // D z_j -= sum_i c_i D z_i, likewise z_j, with |D z_j|^2 and
+    // <D z_j, res> in the same pass
+    double an = 0.0, are = 0.0, aim = 0.0;
+#pragma omp parallel for reduction(+:an,are,aim)
+    for(long l=0; l<b.len; l++) {
+      Complex azl = Azv[j][l], zl = zv[j][l];
+      for(int i=0; i<j; i++) {
+	azl -= ctimes(c[i], Azv[i][l]);
+	zl -= ctimes(c[i], zv[i][l]);
+      }
+      Azv[j][l] = azl;
+      zv[j][l] = zl;
+      an += norm(azl);
+      Complex prod = cdagtimes(azl, res.v[l]);
+      are += prod.real();
+      aim += prod.imag();
+    }
+    AzNorm[j] = an;
+
+    // x += a z_j, res -= a D z_j
+    Complex a = Complex(are, aim)/an;
+    double rsqNew = 0.0;
+#pragma omp parallel for reduction(+:rsqNew)
+    for(long l=0; l<b.len; l++) {
+      x.v[l] += ctimes(a, zv[j][l]);
+      res.v[l] -= ctimes(a, Azv[j][l]);
+      rsqNew += norm(res.v[l]);
+    }
+    if(rsqNew != rsqNew) break;
+    rsq = rsqNew;
+  }
+
+  if(!(rsq < param.eps*bnorm)) {
+    printf("%s: Failed to converge iter = %d, rsq = %.16e\n", name, k, rsq);
+    success = 0;
+  } else {
+    success = 1;
+  }
+
+  return success;
+}
+
+// Flexible GCR preconditioned by SAP
+int DinvpsiSAP(latField<Complex> &x, const latField<Complex> &b, const latField<Complex> &x0,
+	       const latField<Complex> &gauge, param_t param) {
+
+  return DinvpsiFGCR<SAP_NKRYLOV>(x, b, x0, gauge, param,
+				  [&](latField<Complex> &z, const latField<Complex> &r) {
+				    sapPrec(z, r, gauge, param);
+				  }, "SAP");
+}
+
+#endif
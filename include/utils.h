@@ -9,14 +9,43 @@
 #include <complex>
 #include "latHelpers.h"
 #include "fermionHelpers.h"
+#include "workspace.h"
 
 using namespace std;
 
+//Propagator solvers for the measurements, picked by the solverPC and
+//solverVT arguments: CG on the normal equations, BiCGStab or GCR on D,
+//eigCG on the normal equations, multigrid on D, or GCR on D with the
+//Schwarz preconditioner. The Wilson HMC force solves take SOLVER_CG,
+//SOLVER_MG or SOLVER_SAP from the solverHMC argument, the staggered ones
+//SOLVER_CG only. The mains reject any other id (see checkSolver).
+#define SOLVER_CG       1
+#define SOLVER_BICGSTAB 2
+#define SOLVER_GCR      3
+#define SOLVER_EIGCG    4
+#define SOLVER_MG       5
+#define SOLVER_SAP      6
+
+//HMC integrators (integrators.h)
+#define INTEGRATOR_LEAPFROG 0
+#define INTEGRATOR_2MN      1
+#define INTEGRATOR_4MN      2
+#define INTEGRATOR_FG       3
+
+//With p.deflate set the measurement solves, bar eigCG, start from the
+//guess deflated by the p.nEv lowest modes of g3Dg3D (lanczos.h). The
+//eigensolve only pays when it serves many solves, as for the vacuum trace
+//on larger lattices, so it is off by default.
+#ifndef DEFLATE_MEAS
+#define DEFLATE_MEAS 0
+#endif
+
 typedef struct{
   
   //HMC
   int nstep = 25;
   double tau = 1.0;
+  int integrator = INTEGRATOR_LEAPFROG;
   int iterHMC = 1000;
   int therm = 50;
   int skip = 25;
@@ -32,22 +61,23 @@ typedef struct{
   double betaz = 0.5;
   double m = 0.1;
   bool dynamic = true;
+  int solverHMC = SOLVER_CG; //Wilson force solver
   bool lockedZ = false;
-  bool deflate = true;
+  bool deflate = DEFLATE_MEAS;
   
   //Smearing
   double alpha = 0.5;
   int smearIter = 1;
   
-  //Arpack params
+  //Eigensolver params
   int nEv = NEV;
   int nKr = NKR;
   double arpackTol = 1e-6;
   int arpackMaxiter = 10000;
-  int polyACC = 0;
-  double amax = 10.0;
-  double amin = 0.1;
-  int n_poly = 100;
+  int polyACC = 1;
+  double amax = 0.0; //Chebyshev bounds, estimated when <= 0
+  double amin = 0.0;
+  int n_poly = 50;
   bool ARPACK_verbose = false;
 
   //Measurements
@@ -55,6 +85,8 @@ typedef struct{
   bool measWL = false; //Wilson loop and Creutz ratios
   bool measPC = false; //Pion
   bool measVT = false; //Vacuum trace
+  int solverPC = SOLVER_CG; //Propagator solvers
+  int solverVT = SOLVER_CG;
 
   //Wilson loop and Polyakov loop max size.
   int loopMax = LX/2;
@@ -65,29 +97,6 @@ typedef struct{
 typedef struct{
 
   double tot_time, inv_time, matmul_time;
-  Complex*** b01;
-  Complex*** b02;
-  Complex*** b03;
-  Complex*** b04;
-  Complex*** b05;
-  Complex*** b06;
-  Complex*** b07;
-  Complex*** b08;
-  Complex*** b09;
-  Complex*** b10;
-  Complex*** b11;
-  Complex*** b12;
-  Complex*** b13;
-  Complex*** b14;
-  Complex*** b15;
-  Complex*** b16;
-  Complex*** b17;
-  Complex*** b18;
-  Complex*** b19;
-  Complex*** b0X;
-  double*** c01;
-  double*** c02;
-  double*** c03;
 } global_struct;
 extern global_struct gst;
 
@@ -98,7 +107,7 @@ void printParams(param_t p) {
   cout << "          Beta = "<< p.beta << endl;
   cout << "          Dynamic = " << (p.dynamic == true ? "True" : "False") << endl;
   if (p.dynamic == true) cout << "          Mass = " << p.m << endl;
-#ifdef LZ
+#if D == 3
   cout << "          ZSize = "<< LZ << endl;
   if (LZ != 1)   cout << "          BetaZ = "<< p.betaz << endl;
   if (p.lockedZ) cout << "          Z locked = True " << endl;
@@ -108,14 +117,18 @@ void printParams(param_t p) {
   cout << "          Time Step = " << p.tau/p.nstep << endl;
   cout << "          Trajectory Steps " << p.nstep << endl;
   cout << "          Trajectory Length = " << p.tau << endl;
+  const char *integrators[] = {"Leapfrog", "Omelyan 2MN", "Omelyan 4MN", "Force gradient"};
+  if(p.integrator >= 0 && p.integrator < 4)
+    cout << "          Integrator = " << integrators[p.integrator] << endl;
   cout << "Smearing: APE iter = " << p.smearIter << endl;
   cout << "          APE alpha = " << p.alpha << endl;
-#ifdef USE_ARPACK
-  cout << "ARPACK:   nkv = " << p.nKr << endl;
-  cout << "          nev = " << p.nEv << endl;
-  cout << "          tol = " << p.arpackTol << endl;
-  cout << "          maxiter = " << p.arpackMaxiter << endl;
-#endif  
+  if(p.deflate) {
+    cout << "Lanczos:  nkv = " << p.nKr << endl;
+    cout << "          nev = " << p.nEv << endl;
+    cout << "          tol = " << p.arpackTol << endl;
+    cout << "          maxiter = " << p.arpackMaxiter << endl;
+    if(p.polyACC) cout << "          Chebyshev degree = " << p.n_poly << endl;
+  }
 }
 
 void constructName(string &name, param_t p) {
@@ -124,7 +137,37 @@ void constructName(string &name, param_t p) {
   name += "_tau" + to_string(p.tau) + "_nHMCstep" + to_string(p.nstep);
 }
 
-void printLattice(Complex gauge[LX][LY][2]){
+//Comma separated list of masses, e.g. -0.04,0.0,0.04
+void parseMassList(vector<double> &mass, const char *list) {
+  mass.clear();
+  string str(list);
+  size_t pos = 0;
+  while(pos <= str.size()) {
+    size_t end = str.find(',', pos);
+    if(end == string::npos) end = str.size();
+    if(end > pos) mass.push_back(stod(str.substr(pos, end - pos)));
+    pos = end + 1;
+  }
+}
+
+//Exits unless solver is one of the SOLVER_* in allowed
+void checkSolver(const char *arg, int solver, const vector<int> &allowed) {
+  for(int s : allowed) if(solver == s) return;
+  cout << "Error in main: " << arg << " = " << solver << " is not one of";
+  for(int s : allowed) cout << " " << s;
+  cout << endl;
+  exit(0);
+}
+
+//The masses after label, nothing for an empty list
+void printMassList(const char *label, const vector<double> &mass) {
+  if(mass.empty()) return;
+  cout << label;
+  for(double m : mass) cout << " " << m;
+  cout << endl;
+}
+
+void printLattice(const latField<Complex> &gauge){
   
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++) {
@@ -134,47 +177,18 @@ void printLattice(Complex gauge[LX][LY][2]){
   return;
 }
 
-double measPlaq(Complex*** gauge){
+double measPlaq(const latField<Complex> &gauge){
   
   double plaq = 0.0;  
+#pragma omp parallel for reduction(+:plaq)
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++){
-      plaq += real(gauge[x][y][0]*gauge[ (x+1)%LX ][y][1]*conj(gauge[x][ (y+1)%LY ][0])*conj(gauge[x][y][1]));
+      plaq += real(gauge[x][y][0]*gauge[nbr.xp[x]][y][1]*conj(gauge[x][nbr.yp[y]][0])*conj(gauge[x][y][1]));
     }
   return plaq/(LX*LY);
 }
 
-double measPlaq(Complex gauge[LX][LY][2]){
-  
-  double plaq = 0.0;  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      plaq += real(gauge[x][y][0]*gauge[ (x+1)%LX ][y][1]*conj(gauge[x][ (y+1)%LY ][0])*conj(gauge[x][y][1]));
-    }
-  return plaq/(LX*LY);
-}
-
-
-void writeGaugeLattice(Complex gauge[LX][LY][2], string name){
-
-  fstream outPutFile;
-  outPutFile.open(name,ios::in|ios::out|ios::trunc);  
-  outPutFile.setf(ios_base::fixed,ios_base::floatfield); 
-
-  //Plaquette action header
-  outPutFile << setprecision(20) <<  setw(20) << measPlaq(gauge) << endl;
-  
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++)
-      for(int mu=0; mu<2; mu++)
-	outPutFile << setprecision(12) <<  setw(20) << arg(gauge[x][y][mu]) << endl;
-  
-  outPutFile.close();
-  return;
-  
-}
-
-void writeGaugeLattice(Complex*** gauge, string name){
+void writeGaugeLattice(const latField<Complex> &gauge, string name){
 
   fstream outPutFile;
   outPutFile.open(name,ios::in|ios::out|ios::trunc);  
@@ -193,7 +207,7 @@ void writeGaugeLattice(Complex*** gauge, string name){
   
 }
 
-void readGaugeLattice(Complex*** gauge, string name){
+void readGaugeLattice(latField<Complex> &gauge, string name){
 
   fstream inPutFile;
   inPutFile.open(name);
@@ -228,7 +242,7 @@ void readGaugeLattice(Complex*** gauge, string name){
   <Gaussian^2> = 1/beta  
   Perimeter Law:  Wilson Loop = exp[ - 4 sigma L ]   sigma = - Log[ <cos(theta)> ]
   ================================================================================*/ 
-void gaussStart(Complex*** gauge,param_t p){
+void gaussStart(latField<Complex> &gauge,param_t p){
 
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++){
@@ -238,17 +252,7 @@ void gaussStart(Complex*** gauge,param_t p){
   return;
 }
 
-void gaussStart(Complex gauge[LX][LY][2],param_t p){
-
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      gauge[x][y][0] = polar(1.0,sqrt(1.0/p.beta)*drand48());
-      gauge[x][y][1] = polar(1.0,sqrt(1.0/p.beta)*drand48());
-    }
-  return;
-}  
-
-void coldStart(Complex gauge[LX][LY][2],param_t p){
+void coldStart(latField<Complex> &gauge,param_t p){
 
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++)
@@ -257,182 +261,55 @@ void coldStart(Complex gauge[LX][LY][2],param_t p){
   return;
 }  
 
-void gaussReal_F(double field[LX][LY][2]) {
+void gaussReal_F(latField<double> &field) {
   //normalized gaussian exp[ - phi*phi/2]  <phi|phi> = 1
-  double r, theta, sum;
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      r = sqrt(-2.0*log(drand48()));
-      theta = TWO_PI*drand48();
-      field[x][y][0] = r*cos(theta);
-      
-      r = sqrt(-2.0*log(drand48()));
-      theta = TWO_PI*drand48();
-      field[x][y][1] = r*cos(theta);
-      //sum += field[x][y][0]*field[x][y][0] + field[x][y][1]*field[x][y][1];
-    }
-  
-  //cout << "mom check: " << sum/(L*L) << endl;
-  
-  return;
-}
-
-void gaussReal_F(double*** field) {
-  //normalized gaussian exp[ - phi*phi/2]  <phi|phi> = 1
-  double r, theta, sum;
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      r = sqrt(-2.0*log(drand48()));
-      theta = TWO_PI*drand48();
-      field[x][y][0] = r*cos(theta);
-      
-      r = sqrt(-2.0*log(drand48()));
-      theta = TWO_PI*drand48();
-      field[x][y][1] = r*cos(theta);
-      //sum += field[x][y][0]*field[x][y][0] + field[x][y][1]*field[x][y][1];
-    }
-  
-  //cout << "mom check: " << sum/(L*L) << endl;
-  
-  return;
-}
-
-void gaussReal_F(double field[LX][LY]) {
-  //normalized gaussian exp[ - phi*phi/2]  <phi|phi> = 1
-  double r, theta, sum;
-  for(int x=0; x<LX; x++)
-    for(int y=0; y<LY; y++){
-      r = sqrt(-2.0*log(drand48()));
-      theta = TWO_PI*drand48();
-      field[x][y] = r*cos(theta);
-
-      //sum += field[x][y]*field[x][y];
-    }
-  
-  //cout << "mom check: " << sum/(L*L) << endl;
-  
-  return;
-}
-
-
-void gaussComplex_F(Complex*** eta, param_t p) {
-  
-  //normalized gaussian exp[ - eta*eta/2]  <eta|eta> = 1;
-  double r1, theta1, r2, theta2, sum;
-  double inv_sqrt2 = 1.0/sqrt(2);
-  
-  for(int x=0; x<LX; x++) {
-    for(int y=0; y<LY; y++) {
-      for(int s=0; s<2; s++) {
-	r1 = sqrt(-2.0*log(drand48()));
-	theta1 = TWO_PI*(drand48());
-	r2 = sqrt(-2.0*log(drand48()));
-	theta2 = TWO_PI*(drand48());
-	
-	eta[x][y][s] = Complex(r1*cos(theta1),r2*sin(theta2))*inv_sqrt2;
-      }
-    }
+  double r, theta;
+  for(long i=0; i<field.len; i++) {
+    r = sqrt(-2.0*log(drand48()));
+    theta = TWO_PI*drand48();
+    field.v[i] = r*cos(theta);
   }
-  //cout << "GaussComplex_F: norm(eta) = " << norm2(eta)/(LX*LY*2) << endl;
   return;
 }
 
-void gaussComplex_F(Complex eta[LX][LY][2], param_t p) {
-  
-  //normalized gaussian exp[ - eta*eta/2]  <eta|eta> = 1;
-  double r1, theta1, r2, theta2, sum;
-  double inv_sqrt2 = 1.0/sqrt(2);
-  
-  for(int x=0; x<LX; x++) {
-    for(int y=0; y<LY; y++) {
-      for(int s=0; s<2; s++) {
-	r1 = sqrt(-2.0*log(drand48()));
-	theta1 = TWO_PI*(drand48());
-	r2 = sqrt(-2.0*log(drand48()));
-	theta2 = TWO_PI*(drand48());
-	
-	eta[x][y][s] = Complex(r1*cos(theta1),r2*sin(theta2))*inv_sqrt2;
-      }
-    }
-  }
-  //cout << "GaussComplex_F: norm(eta) = " << norm2(eta)/(LX*LY*2) << endl;
-  return;
-}
-
-void gaussComplex_F(Complex eta[LX][LY], param_t p) {
+void gaussComplex_F(latField<Complex> &eta, param_t p) {
   
   //normalized gaussian exp[ - eta*eta/2]  <eta|eta> = 1;
   double r1, theta1, r2, theta2;
   double inv_sqrt2 = 1.0/sqrt(2);
   
-  for(int x=0; x<LX; x++) {
-    for(int y=0; y<LY; y++) {
-      r1 = sqrt(-2.0*log(drand48()));
-      theta1 = TWO_PI*(drand48());
-      r2 = sqrt(-2.0*log(drand48()));
-      theta2 = TWO_PI*(drand48());
-      
-      eta[x][y] = Complex(r1*cos(theta1),r2*sin(theta2))*inv_sqrt2;
-    }
+  for(long i=0; i<eta.len; i++) {
+    r1 = sqrt(-2.0*log(drand48()));
+    theta1 = TWO_PI*(drand48());
+    r2 = sqrt(-2.0*log(drand48()));
+    theta2 = TWO_PI*(drand48());
+    
+    eta.v[i] = Complex(r1*cos(theta1),r2*sin(theta2))*inv_sqrt2;
   }
-  //cout << "GaussComplex_F: norm(eta) = " << norm2(eta)/(LX*LY) << endl;
+  //cout << "GaussComplex_F: norm(eta) = " << norm2(eta)/eta.len << endl;
   return;
-  
 }
 
 //staple x is 0th, y is 1st.
 //APE smearing: project back on U(1)       
-void smearLink(Complex Smeared[LX][LY][2], const Complex gauge[LX][LY][2], param_t p){
-
-  double alpha = p.alpha;
-  int iter = p.smearIter;
-  int xp1, xm1, yp1, ym1;
-  
-  Complex SmearedTmp[LX][LY][2];
-  copyLat(Smeared, gauge);
-  copyLat(SmearedTmp, Smeared);
-  
-  for(int i=0; i<iter; i++) {    
-    for(int x=0; x<LX; x++) {
-      xp1 = (x+1)%LX;
-      xm1 = (x-1+LX)%LX;
-      for(int y=0; y<LY; y++) {
-	yp1 = (y+1)%LY;
-	ym1 = (y-1+LY)%LY;
-	
-	SmearedTmp[x][y][0] += alpha * Smeared[x][y][1] * Smeared[x][yp1][0] * conj(Smeared[x][y][1]);
-	SmearedTmp[x][y][0] += alpha * conj(Smeared[x][ym1][1]) * Smeared[x][ym1][0] * Smeared[xp1][ym1][1];
-	SmearedTmp[x][y][1] += alpha * Smeared[x][y][0] * Smeared[xp1][y][1] * conj(Smeared[xp1][yp1][0]);
-	SmearedTmp[x][y][1] += alpha * conj(Smeared[xm1][y][0]) * Smeared[xm1][y][1] * Smeared[xm1][yp1][0];
-      }
-    }
-    
-    //Project back to U(1)
-    for(int x=0; x<LX; x++)
-      for(int y=0; y<LY; y++)
-	for(int mu=0; mu<2; mu++)
-	  Smeared[x][y][mu] = polar(1.0,arg(SmearedTmp[x][y][mu]));
-  }
-}
-
-void smearLink(Complex*** Smeared, Complex*** gauge, param_t p){
+void smearLink(latField<Complex> &Smeared, const latField<Complex> &gauge, param_t p){
 
   double alpha = p.alpha;
   int iter = p.smearIter;
-  int xp1, xm1, yp1, ym1;
 
-  Complex*** SmearedTmp = gst.b06;
+  tmpField<Complex> SmearedTmp;
 
   copyLat(Smeared, gauge);
   copyLat(SmearedTmp, Smeared);
   
   for(int i=0; i<iter; i++) {    
+#pragma omp parallel for
     for(int x=0; x<LX; x++) {
-      xp1 = (x+1)%LX;
-      xm1 = (x-1+LX)%LX;
+      int xp1 = nbr.xp[x];
+      int xm1 = nbr.xm[x];
       for(int y=0; y<LY; y++) {
-	yp1 = (y+1)%LY;
-	ym1 = (y-1+LY)%LY;
+	int yp1 = nbr.yp[y];
+	int ym1 = nbr.ym[y];
 	
 	SmearedTmp[x][y][0] += alpha * Smeared[x][y][1] * Smeared[x][yp1][0] * conj(Smeared[x][y][1]);
 	SmearedTmp[x][y][0] += alpha * conj(Smeared[x][ym1][1]) * Smeared[x][ym1][0] * Smeared[xp1][ym1][1];
@@ -442,97 +319,10 @@ void smearLink(Complex*** Smeared, Complex*** gauge, param_t p){
     }
     
     //Project back to U(1)
-    for(int x=0; x<LX; x++)
-      for(int y=0; y<LY; y++)
-	for(int mu=0; mu<2; mu++)
-	  Smeared[x][y][mu] = polar(1.0,arg(SmearedTmp[x][y][mu]));
+#pragma omp parallel for
+    for(long n=0; n<Smeared.len; n++)
+      Smeared.v[n] = polar(1.0,arg(SmearedTmp.v[n]));
   }
 }
 
-template<typename T> void buff_alloc(T**** b){
-
-  T*** arr;
-  arr = (T***) malloc(LX*sizeof(T**));
-  for(int i=0; i < LX; i++){
-    arr[i] = (T**) malloc(LY*sizeof(T*));
-    for(int j=0; j < LY; j++){
-      arr[i][j] = (T*) malloc(2*sizeof(T));
-    }
-  }
-  
-  b[0] = arr;
-}
-
-template<typename T> void buff_free(T**** b){
-
-  for(int i=0; i < LX; i++){
-    for(int j=0; j < LY; j++){
-      free(b[0][i][j]);
-    }
-  }
-
-  for(int i=0; i < LX; i++){
-    free(b[0][i]);
-  }
-
-  free(b[0]);
-}
-
-void buff_allocs(){
-
-  buff_alloc(&(gst.b01));
-  buff_alloc(&(gst.b02));
-  buff_alloc(&(gst.b03));
-  buff_alloc(&(gst.b04));
-  buff_alloc(&(gst.b05));
-  buff_alloc(&(gst.b06));
-  buff_alloc(&(gst.b07));
-  buff_alloc(&(gst.b08));
-  buff_alloc(&(gst.b09));
-  buff_alloc(&(gst.b10));
-  buff_alloc(&(gst.b11));
-  buff_alloc(&(gst.b12));
-  buff_alloc(&(gst.b13));
-  buff_alloc(&(gst.b14));
-  buff_alloc(&(gst.b15));
-  buff_alloc(&(gst.b16));
-  buff_alloc(&(gst.b17));
-  buff_alloc(&(gst.b18));
-  buff_alloc(&(gst.b19));
-  buff_alloc(&(gst.b0X));
-
-  buff_alloc(&(gst.c01));
-  buff_alloc(&(gst.c02));
-  buff_alloc(&(gst.c03));
-}
-
-void buff_frees(){
-
-  buff_free(&(gst.b01));
-  buff_free(&(gst.b02));
-  buff_free(&(gst.b03));
-  buff_free(&(gst.b04));
-  buff_free(&(gst.b05));
-  buff_free(&(gst.b06));
-  buff_free(&(gst.b07));
-  buff_free(&(gst.b08));
-  buff_free(&(gst.b09));
-  buff_free(&(gst.b10));
-  buff_free(&(gst.b11));
-  buff_free(&(gst.b12));
-  buff_free(&(gst.b13));
-  buff_free(&(gst.b14));
-  buff_free(&(gst.b15));
-  buff_free(&(gst.b16));
-  buff_free(&(gst.b17));
-  buff_free(&(gst.b18));
-  buff_free(&(gst.b19));
-
-  buff_free(&(gst.b0X));
-
-  buff_free(&(gst.c01));
-  buff_free(&(gst.c02));
-  buff_free(&(gst.c03));
-}
-
 #endif
@@ -7,22 +7,23 @@
 #include <string.h>
 #include <cmath>
 #include <complex>
+#include <vector>
 
 using namespace std;
 
-double measPlaq(const Complex gauge[LX][LY][LZ][3], int z){
+double measPlaq(const latField3D<Complex> &gauge, int z){
   
   double plaq = 0.0;
   
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++)
-      plaq += real(gauge[x][y][z][0]*gauge[ (x+1)%LX ][y][z][1]*conj(gauge[x][ (y+1)%LY ][z][0])*conj(gauge[x][y][z][1]));
+      plaq += real(gauge(x,y,z,0)*gauge(nbr.xp[x],y,z,1)*conj(gauge(x,nbr.yp[y],z,0))*conj(gauge(x,y,z,1)));
   
   return plaq/(LX*LY);
 }
 
 
-void writeGaugeLattice(const Complex gauge[LX][LY][LZ][3], string name){
+void writeGaugeLattice(const latField3D<Complex> &gauge, string name){
 
   fstream outPutFile;
   outPutFile.open(name,ios::in|ios::out|ios::trunc);  
@@ -35,20 +36,20 @@ void writeGaugeLattice(const Complex gauge[LX][LY][LZ][3], string name){
     for(int y=0; y<LY; y++)
       for(int z=0; z<LZ; z++)
 	for(int mu=0; mu<3; mu++)
-	  outPutFile << setprecision(20) <<  setw(20) <<  arg(gauge[x][y][z][mu]) << endl;
+	  outPutFile << setprecision(20) <<  setw(20) <<  arg(gauge(x,y,z,mu)) << endl;
   
   outPutFile.close();
   return;
 }
 
-void readGaugeLattice(Complex gauge[LX][LY][LZ][3], string name){
+void readGaugeLattice(latField3D<Complex> &gauge, string name){
 
   fstream inPutFile;
   inPutFile.open(name);
   string val;
   
   //Header check
-  double plaq[LZ];
+  vector<double> plaq(LZ);
   for(int z=0; z<LZ; z++) {
     getline(inPutFile, val);
     plaq[z] = stod(val);
@@ -58,7 +59,7 @@ void readGaugeLattice(Complex gauge[LX][LY][LZ][3], string name){
       for(int z=0; z<LZ; z++)
 	for(int mu=0; mu<3; mu++) {
 	  getline(inPutFile, val);
-	  gauge[x][y][z][mu] = polar(1.0, stod(val));	  
+	  gauge(x,y,z,mu) = polar(1.0, stod(val));	  
 	}
 
   for(int z=0; z<LZ; z++) {
@@ -74,15 +75,15 @@ void readGaugeLattice(Complex gauge[LX][LY][LZ][3], string name){
   return;
 }
 
-void printLattice(Complex gauge[LX][LY][LZ][3]){
+void printLattice(const latField3D<Complex> &gauge){
   
   for(int x=0; x<LX; x++)    
     for(int y=0; y<LY; y++)
       for(int z=0; z<LZ; z++) {
 	cout << "["<< x << "," << y << "," << z << "] = ";
-	cout << gauge[x][y][z][0] << " "
-	     << gauge[x][y][z][1] << " "
-	     << gauge[x][y][z][2] << endl;
+	cout << gauge(x,y,z,0) << " "
+	     << gauge(x,y,z,1) << " "
+	     << gauge(x,y,z,2) << endl;
       }
   return;
 }
@@ -92,29 +93,29 @@ void printLattice(Complex gauge[LX][LY][LZ][3]){
 // Perimeter Law:  Wilson Loop = exp[ - 4 sigma L ]   sigma = - Log[ <cos(theta)> ]
 //=================================================================================
 
-void gaussStart(Complex gauge[LX][LY][LZ][3], param_t p){  
+void gaussStart(latField3D<Complex> &gauge, param_t p){  
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++)
       for(int z=0; z<LZ; z++)
 	for(int mu=0; mu<3; mu++) {
-	  gauge[x][y][z][mu] = polar(1.0, TWO_PI*drand48());
-	  if(p.lockedZ && mu == 2) gauge[x][y][z][mu] = 1.0;
+	  gauge(x,y,z,mu) = polar(1.0, TWO_PI*drand48());
+	  if(p.lockedZ && mu == 2) gauge(x,y,z,mu) = 1.0;
 	}
   return;
 }  
 
-void coldStart(Complex gauge[LX][LY][LZ][3], param_t p){
+void coldStart(latField3D<Complex> &gauge, param_t p){
 
   for(int x=0; x<LX; x++)
     for(int y=0; y<LY; y++)
       for(int z=0; z<LZ; z++) 
 	for(int mu=0; mu<3; mu++)
-	  gauge[x][y][z][mu] = Complex(1.0,0.0);
+	  gauge(x,y,z,mu) = Complex(1.0,0.0);
   return;
 }  
 
 
-void gaussReal_F(double field[LX][LY][LZ][3]) {
+void gaussReal_F(latField3D<double> &field) {
   //normalized gaussian exp[ - phi*phi/2]  <phi|phi> = 1
   double r, theta, sum;
   for(int x=0; x<LX; x++)
@@ -122,11 +123,11 @@ void gaussReal_F(double field[LX][LY][LZ][3]) {
       for(int z=0; z<LZ; z++){
 	r = sqrt(-2.0*log(drand48()));
 	theta = TWO_PI*drand48();
-	field[x][y][z][0] = r*cos(theta);
+	field(x,y,z,0) = r*cos(theta);
 	
 	r = sqrt(-2.0*log(drand48()));
 	theta = TWO_PI*drand48();
-	field[x][y][z][1] = r*cos(theta);
+	field(x,y,z,1) = r*cos(theta);
 	//sum += field[x][y][0]*field[x][y][0] + field[x][y][1]*field[x][y][1];
       }
   
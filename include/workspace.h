@@ -0,0 +1,103 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <vector>
+#include "latField.h"
+
+using namespace std;
+
+//Scratch field workspace
+//---------------------------------------------------------------------------
+// Routines check their temporaries out of one shared pool rather than
+// borrowing fixed global buffers. A tmpField hands its memory back when it
+// goes out of scope, and the next checkout of the same size picks it up
+// again, so the pool only grows to the peak number of temporaries that are
+// live at the same time. Checkout/return is thread safe, so independent
+// solvers and measurements can run concurrently without sharing scratch.
+
+class workspace {
+
+  struct block {
+    void *v;
+    size_t bytes;
+    bool inUse;
+  };
+
+  vector<block> blocks;
+  size_t liveBytes = 0;
+  size_t peakBytes = 0;
+  size_t allocBytes = 0;
+
+public:
+
+  void *checkout(size_t bytes) {
+
+    void *v = nullptr;
+#pragma omp critical(workspace)
+    {
+      //Best fit among the free blocks
+      int best = -1;
+      for(int i=0; i<(int)blocks.size(); i++)
+	if(!blocks[i].inUse && blocks[i].bytes >= bytes &&
+	   (best < 0 || blocks[i].bytes < blocks[best].bytes)) best = i;
+
+      if(best < 0) {
+	if(posix_memalign(&v, FIELD_ALIGN, bytes) != 0) {
+	  cout << "Error in workspace: failed to allocate " << bytes << " bytes" << endl;
+	  exit(0);
+	}
+	blocks.push_back({v, bytes, true});
+	allocBytes += bytes;
+	best = blocks.size() - 1;
+      }
+
+      blocks[best].inUse = true;
+      v = blocks[best].v;
+      liveBytes += blocks[best].bytes;
+      if(liveBytes > peakBytes) peakBytes = liveBytes;
+    }
+    return v;
+  }
+
+  void checkin(void *v) {
+#pragma omp critical(workspace)
+    {
+      for(auto &b : blocks)
+	if(b.v == v) {
+	  b.inUse = false;
+	  liveBytes -= b.bytes;
+	  break;
+	}
+    }
+  }
+
+  void report() {
+    cout << "Workspace peak memory : " << fixed << setprecision(3)
+	 << peakBytes/(1024.0*1024.0) << " MB (" 
+	 << allocBytes/(1024.0*1024.0) << " MB allocated in " << blocks.size() << " blocks)" << endl;
+  }
+
+  ~workspace() {
+    for(auto &b : blocks) free(b.v);
+  }
+};
+
+inline workspace &wsPool() {
+  static workspace ws;
+  return ws;
+}
+
+// Scoped scratch field. Contents are undefined on checkout.
+template<typename T> class tmpField : public latField<T> {
+
+public:
+  tmpField(int nd_ = 2, int nx_ = LX, int ny_ = LY) :
+    latField<T>((T*)wsPool().checkout((size_t)nx_*ny_*nd_*sizeof(T)), nd_, nx_, ny_) {}
+
+  ~tmpField() { wsPool().checkin(this->v); }
+};
+
+#endif
@@ -7,15 +7,14 @@
 
 using namespace std;
 
-#define LX __LX__
-#define LY __LY__
 #define D 2
 #define NEV 24
-#define NKR 32
+#define NKR 64
 #define PI 3.141592653589793
 #define TWO_PI 6.283185307179586
 
 typedef complex<double> Complex;
+typedef complex<float> ComplexF;
 #define I Complex(0,1.0)
 #define cUnit Complex(1.0,0)
 
@@ -26,77 +25,108 @@ typedef complex<double> Complex;
 #include "dOpHelpers.h"
 #include "inverters.h"
 #include "hmcHelpers.h"
+#include "integrators.h"
 
-#ifdef USE_ARPACK
-#include "arpack_interface_staggered.h"
-#endif
 
 //Dimension dependent HMC functions defined in main file
 //----------------------------------------------------------------------------
-void trajectory(double mom[LX][LY][D], Complex gauge[LX][LY][D],
-		Complex phi[LX][LY], param_t p, int iter);
-int hmc(Complex gauge[LX][LY][D], param_t p, int iter);
-void forceU(double fU[LX][LY][D], Complex gauge[LX][LY][D], param_t p);
-void update_mom(double fU[LX][LY][D], double fD[LX][LY][D],
-		double mom[LX][LY][D], double dtau);
-void update_gauge(Complex gauge[LX][LY][D], double mom[LX][LY][D], double dtau);
+void trajectory(latField<double> &mom, latField<Complex> &gauge,
+		latField<Complex> &phi, chronoGuess &guess, param_t p, int iter);
+int hmc(latField<Complex> &gauge, param_t p, int iter);
+void forceU(latField<double> &fU, const latField<Complex> &gauge, param_t p);
+void update_mom(const latField<double> &fU, const latField<double> &fD,
+		latField<double> &mom, double dtau);
+void update_gauge(latField<Complex> &gauge, const latField<double> &mom, double dtau);
 //----------------------------------------------------------------------------
 
 //Global variables.
+int LX, LY, LZ = 1;
 int hmccount = 0;
 double expdHAve = 0.0;
 double dHAve = 0.0;
 
+global_struct gst;
+
 int main(int argc, char **argv) {
 
+  //Lattice extents
+  if(argc < 28) {
+    cout << "Error in main: need 27 arguments, have " << argc-1 << " (see launcher.sh)" << endl;
+    exit(0);
+  }
+  LX = atoi(argv[1]);
+  LY = atoi(argv[2]);
+  if(LX <= 0 || LY <= 0 || LX%2 || LY%2) {
+    cout << "Error in main: LX = " << LX << ", LY = " << LY
+	 << ", need both positive and even" << endl;
+    exit(0);
+  }
+  initNeighbours();
+  selectDiracKernels();
+
   param_t p;
   
-  p.beta = atof(argv[1]); 
-  p.iterHMC = atoi(argv[2]);
-  p.therm = atoi(argv[3]);
-  p.skip = atoi(argv[4]);
-  p.chkpt = atoi(argv[5]);
-  p.checkpointStart = atoi(argv[6]);  
-  p.nstep = atoi(argv[7]);
-  p.tau = atof(argv[8]);
+  p.beta = atof(argv[3]); 
+  p.iterHMC = atoi(argv[4]);
+  p.therm = atoi(argv[5]);
+  p.skip = atoi(argv[6]);
+  p.chkpt = atoi(argv[7]);
+  p.checkpointStart = atoi(argv[8]);  
+  p.nstep = atoi(argv[9]);
+  p.tau = atof(argv[10]);
   
-  p.smearIter = atoi(argv[9]);
-  p.alpha = atof(argv[10]);  
-  long iseed = (long)atoi(argv[11]);
+  p.smearIter = atoi(argv[11]);
+  p.alpha = atof(argv[12]);  
+  long iseed = (long)atoi(argv[13]);
   //Pseudo RNG seed
   srand48(iseed);
   
-  if(atoi(argv[12]) == 0) 
+  if(atoi(argv[14]) == 0) 
     p.dynamic = false;
   else
     p.dynamic = true;
 
-  p.m = atof(argv[13]);
-  p.maxIterCG = atoi(argv[14]);
-  p.eps = atof(argv[15]);
+  p.m = atof(argv[15]);
+  p.maxIterCG = atoi(argv[16]);
+  p.eps = atof(argv[17]);
   
-  //Arpack params
+  //Eigensolver params
   p.nKr = NKR;
   p.nEv = NEV;
-  p.arpackTol = atof(argv[16]);
-  p.arpackMaxiter = atoi(argv[17]);
-  p.polyACC = atoi(argv[18]);
-  p.amax = atof(argv[19]);
-  p.amin = atof(argv[20]);
-  p.n_poly = atoi(argv[21]);
+  p.arpackTol = atof(argv[18]);
+  p.arpackMaxiter = atoi(argv[19]);
+  p.polyACC = atoi(argv[20]);
+  p.amax = atof(argv[21]);
+  p.amin = atof(argv[22]);
+  p.n_poly = atoi(argv[23]);
 
   //Measurements
-  if(atoi(argv[22]) == 0) p.measPL = false;
+  if(atoi(argv[24]) == 0) p.measPL = false;
   else p.measPL = true;
 
-  if(atoi(argv[23]) == 0) p.measWL = false;
+  if(atoi(argv[25]) == 0) p.measWL = false;
   else p.measWL = true;
   
-  if(atoi(argv[24]) == 0) p.measPC = false;
+  if(atoi(argv[26]) == 0) p.measPC = false;
   else p.measPC = true;
   
-  if(atoi(argv[25]) == 0) p.measVT = false;
+  if(atoi(argv[27]) == 0) p.measVT = false;
   else p.measVT = true;  
+
+  //HMC integrator, solvers of the fermion force and of the pion and
+  //vacuum trace propagators (SOLVER_*), and valence masses for the pion
+  //correlator (optional)
+  vector<double> mValence;
+  if(argc > 28) p.integrator = atoi(argv[28]);
+  if(argc > 29) p.solverHMC = atoi(argv[29]);
+  if(argc > 30) p.solverPC = atoi(argv[30]);
+  if(argc > 31) p.solverVT = atoi(argv[31]);
+  const vector<int> propSolvers = {SOLVER_CG, SOLVER_BICGSTAB, SOLVER_GCR,
+				   SOLVER_EIGCG, SOLVER_MG, SOLVER_SAP};
+  checkSolver("solverHMC", p.solverHMC, {SOLVER_CG});
+  checkSolver("solverPC", p.solverPC, propSolvers);
+  checkSolver("solverVT", p.solverVT, propSolvers);
+  if(argc > 32) parseMassList(mValence, argv[32]);
   
   //Topology
   double top = 0.0;
@@ -110,8 +140,7 @@ int main(int argc, char **argv) {
   int index = 0;
   for(int i = 0; i < histL; i++) histQ[i] = 0;
   
-  Complex gauge[LX][LY][D];
-  zeroLat(gauge);  
+  latField<Complex> gauge(D);
     
   int count = 0;
   string name;
@@ -123,6 +152,7 @@ int main(int argc, char **argv) {
   FILE *fp;
 
   printParams(p);  
+  printMassList("Valence:  Masses (BiCGStab-M) =", mValence);
   gaussStart(gauge,p);  // hot start
 
   //Start simulation
@@ -162,6 +192,18 @@ int main(int argc, char **argv) {
     iter_offset = 2*p.therm;    
   }
 
+  //Measure-only run: with no trajectories requested, the configuration
+  //read in is measured as it is, its low modes taken from the file saved
+  //next to it when there is one (see deflationFile)
+  if(p.checkpointStart > 0 && p.iterHMC == 0) {
+    iter = p.checkpointStart - 1;
+    top_old = round(measTopCharge(gauge, p));
+    if(p.measPL || p.measWL) measWilsonLoops(gauge, iter, p);
+    if(p.measPC && mValence.empty()) measPionCorrelation(gauge, top_old, iter, p);
+    if(p.measPC && !mValence.empty()) measPionCorrelationMulti(gauge, mValence, top_old, iter, p);
+    if(p.measVT) measVacuumTrace(gauge, top_old, iter, p);
+  }
+
   //Begin thermalised trajectories
   //---------------------------------------------------------------------
   for(iter=iter_offset; iter<p.iterHMC + iter_offset; iter++){
@@ -248,32 +290,32 @@ int main(int argc, char **argv) {
 
       //Physical observables
       //-------------------------------------------------------------      
-      //Polyakov Loops      
-      if(p.measPL) measPolyakovLoops(gauge, iter, p);
-      
-      //Creutz Ratios
-      if(p.measWL) measWilsonLoops(gauge, plaq, iter, p);
+      //Gauge observables
+      if(p.measPL || p.measWL) measWilsonLoops(gauge, iter, p);
 
       //Pion Correlation
-      if(p.measPC) measPionCorrelation(gauge, top_old, iter, p);
+      if(p.measPC && mValence.empty()) measPionCorrelation(gauge, top_old, iter, p);
+      if(p.measPC && !mValence.empty()) measPionCorrelationMulti(gauge, mValence, top_old, iter, p);
 
       //Vacuum Trace
       if(p.measVT) measVacuumTrace(gauge, top_old, iter, p);
       //-------------------------------------------------------------
     }
   }
+  wsPool().report();
+
   return 0;
 }
 
 // HMC Routines
 //---------------------------------------------------------------------
-int hmc(Complex gauge[LX][LY][2], param_t p, int iter) {
+int hmc(latField<Complex> &gauge, param_t p, int iter) {
 
   int accept = 0;
   
-  double mom[LX][LY][2];
-  Complex gaugeOld[LX][LY][2];
-  Complex phi[LX][LY], chi[LX][LY];
+  tmpField<double> mom;
+  tmpField<Complex> gaugeOld;
+  tmpField<Complex> phi(1), chi(1);
   double H, Hold;
 
   copyLat(gaugeOld, gauge);
@@ -292,15 +334,20 @@ int hmc(Complex gauge[LX][LY][2], param_t p, int iter) {
     //Create pseudo fermion field phi = D chi
     Dpsi(phi, chi, gauge, p);
 
+#pragma omp parallel for
     for(int x=0; x<LX; x++)  //Masks out odd sites.
       for(int y=0; y<LY; y++)
-        if((x+y)%2 == 1) phi[x][y] = 0.0;
+        if((x+y)%2 == 1) phi[x][y][0] = 0.0;
     
   }
   
-  if (iter >= p.therm) Hold = measAction(mom, gauge, phi, p, false);
-  trajectory(mom, gauge, phi, p, iter);
-  if (iter >= p.therm) H = measAction(mom, gauge, phi, p, true);
+  //Chronological initial guesses and low modes for the action and
+  //force solves of this trajectory
+  chronoGuess guess;
+
+  if (iter >= p.therm) Hold = measAction(mom, gauge, phi, p, false, &guess);
+  trajectory(mom, gauge, phi, guess, p, iter);
+  if (iter >= p.therm) H = measAction(mom, gauge, phi, p, true, &guess);
   
   if (iter >= 2*p.therm) {      
     hmccount++;
@@ -317,61 +364,27 @@ int hmc(Complex gauge[LX][LY][2], param_t p, int iter) {
   return accept;
 }
 
-void trajectory(double mom[LX][LY][2], Complex gauge[LX][LY][2],
-		Complex phi[LX][LY], param_t p, int iter) {
-
-  double dtau = p.tau/p.nstep;
-  double H = 0.0;
-  Complex guess[LX][LY];
-#ifdef USE_ARPACK
-  zeroField(guess);
-  /*
-  //deflate using phi as source
-  //Deflation eigenvectors
-  Complex defl_evecs[NEV][LX][LY][2];
-  //Deflation eigenvalues
-  Complex defl_evals[NEV];
-  
-  copyField(guess, phi);
-  arpack_solve(gauge, defl_evecs, defl_evals, 0, 0, p);
-  deflate(guess, phi, defl_evecs, defl_evals, p);
-  */
-#else
-  zeroField(guess);
-#endif
+void trajectory(latField<double> &mom, latField<Complex> &gauge,
+		latField<Complex> &phi, chronoGuess &guess, param_t p, int iter) {
 
   //gauge force
-  double fU[LX][LY][2];
+  tmpField<double> fU;
   //fermion fermion
-  double fD[LX][LY][2];
-  //Both arrays are zeroed in forceU/D function call
-  
-  //Initial half step.
-  //P_{1/2} = P_0 - dtau/2 * (fU - fD)
-  forceU(fU, gauge, p);
-  forceD(fD, gauge, phi, guess, p);
-  update_mom(fU, fD, mom, 0.5*dtau);  
-  
-  for(int k=1; k<p.nstep; k++) {
-    
-    //U_{k} = exp(i dtau P_{k-1/2}) * U_{k-1}
-    update_gauge(gauge, mom, dtau);
-    
-    //P_{k+1/2} = P_{k-1/2} - dtau * (fU - fD)
+  tmpField<double> fD;
+  //Both arrays are zeroed in forceU/D function call; fD stays zero
+  //for quenched runs.
+  zeroLat(fD);
+
+  //P = P - dtau * (fU - fD) and U = exp(i dtau P) * U, in the sequence
+  //of p.integrator
+  auto force = [&]() {
     forceU(fU, gauge, p);
     forceD(fD, gauge, phi, guess, p);
-    update_mom(fU, fD, mom, dtau);
-  }
-  
-  //Final half step.
-  //U_{n} = exp(i dtau P_{n-1/2}) * U_{n-1}
-  update_gauge(gauge, mom, dtau);
-  
-  //P_{n} = P_{n-1/2} - dtau/2 * (fU - fD)
-  forceU(fU, gauge, p);
-  forceD(fD, gauge, phi, guess, p);
-  update_mom(fU, fD, mom, 0.5*dtau);
-  
+  };
+  auto kick = [&](latField<double> &P, double dtau) { update_mom(fU, fD, P, dtau); };
+  auto drift = [&](const latField<double> &P, double dtau) { update_gauge(gauge, P, dtau); };
+  integrate(mom, gauge, force, kick, drift, p);
+
   //trajectory complete
 }
 //-------------------------------------------------------------------------------
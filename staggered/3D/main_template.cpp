@@ -7,16 +7,14 @@
 
 using namespace std;
 
-#define LX __LX__
-#define LY __LY__
-#define LZ __LZ__
 #define D 3
 #define NEV 24
-#define NKR 32
+#define NKR 64
 #define PI 3.141592653589793
 #define TWO_PI 6.283185307179586
 
 typedef complex<double> Complex;
+typedef complex<float> ComplexF;
 #define I Complex(0,1)
 #define cUnit Complex(1,0)
 
@@ -30,83 +28,110 @@ typedef complex<double> Complex;
 #include "dOpHelpers.h"
 #include "inverters.h"
 #include "hmcHelpers3D.h"
+#include "integrators.h"
 
-#ifdef USE_ARPACK
-#include "arpack_interface_staggered.h"
-#endif
 
 ////Dimension dependent HMC functions defined in main file
 //----------------------------------------------------------------------------
-void trajectory(double mom[LX][LY][LZ][D], Complex gauge[LX][LY][LZ][D],
-		Complex phi[LX][LY], param_t p);
-int hmc(Complex gauge[LX][LY][LZ][D], param_t p, int iter);
-void forceU(double fU[LX][LY][LZ][D], const Complex gauge[LX][LY][LZ][D], param_t p);
-void update_mom(double fU[LX][LY][LZ][D], double fD[LX][LY][2],
-		double mom[LX][LY][LZ][D], double dtau, param_t p);
-void update_gauge(Complex gauge[LX][LY][LZ][D], double mom[LX][LY][LZ][D], double dtau, param_t p);
+void trajectory(latField3D<double> &mom, latField3D<Complex> &gauge,
+		latField<Complex> &phi, chronoGuess &guess, param_t p);
+int hmc(latField3D<Complex> &gauge, param_t p, int iter);
 //----------------------------------------------------------------------------
 
 //Global variables.
+global_struct gst;
+int LX, LY, LZ;
 int hmccount = 0;
 double expdHAve = 0.0;
 double dHAve = 0.0;
 
 int main(int argc, char **argv) {
 
+  //Lattice extents
+  if(argc < 31) {
+    cout << "Error in main: need 30 arguments, have " << argc-1 << " (see launcher.sh)" << endl;
+    exit(0);
+  }
+  LX = atoi(argv[1]);
+  LY = atoi(argv[2]);
+  LZ = atoi(argv[3]);
+  if(LX <= 0 || LY <= 0 || LX%2 || LY%2 || LZ <= 0) {
+    cout << "Error in main: LX = " << LX << ", LY = " << LY << ", LZ = " << LZ
+	 << ", need LX and LY positive and even, LZ positive" << endl;
+    exit(0);
+  }
+  initNeighbours();
+  selectDiracKernels();
+
   param_t p;
   
-  p.beta = atof(argv[1]);
-  p.betaz = atof(argv[2]);
-  p.iterHMC = atoi(argv[3]);
-  p.therm = atoi(argv[4]);
-  p.skip = atoi(argv[5]);
-  p.chkpt = atoi(argv[6]);
-  p.checkpointStart = atoi(argv[7]);  
-  p.nstep = atoi(argv[8]);
-  p.tau = atof(argv[9]);
+  p.beta = atof(argv[4]);
+  p.betaz = atof(argv[5]);
+  p.iterHMC = atoi(argv[6]);
+  p.therm = atoi(argv[7]);
+  p.skip = atoi(argv[8]);
+  p.chkpt = atoi(argv[9]);
+  p.checkpointStart = atoi(argv[10]);  
+  p.nstep = atoi(argv[11]);
+  p.tau = atof(argv[12]);
   
-  p.smearIter = atoi(argv[10]);
-  p.alpha = atof(argv[11]);  
-  long iseed = (long)atoi(argv[12]);
+  p.smearIter = atoi(argv[13]);
+  p.alpha = atof(argv[14]);  
+  long iseed = (long)atoi(argv[15]);
   //Pseudo RNG seed
   srand48(iseed);
   
-  if(atoi(argv[13]) == 0) 
+  if(atoi(argv[16]) == 0) 
     p.dynamic = false;
   else
     p.dynamic = true;
 
-  if(atoi(argv[14]) != 0)
+  if(atoi(argv[17]) != 0)
     p.lockedZ = true;
   else
     p.lockedZ = true;
   
-  p.m = atof(argv[15]);  
-  p.maxIterCG = atoi(argv[16]);
-  p.eps = atof(argv[17]);
+  p.m = atof(argv[18]);  
+  p.maxIterCG = atoi(argv[19]);
+  p.eps = atof(argv[20]);
   
-  //Arpack params
+  //Eigensolver params
   p.nKr = NKR;
   p.nEv = NEV;
-  p.arpackTol = atof(argv[18]);
-  p.arpackMaxiter = atoi(argv[19]);
-  p.polyACC = atoi(argv[20]);
-  p.amax = atof(argv[21]);
-  p.amin = atof(argv[22]);
-  p.n_poly = atoi(argv[23]);
+  p.arpackTol = atof(argv[21]);
+  p.arpackMaxiter = atoi(argv[22]);
+  p.polyACC = atoi(argv[23]);
+  p.amax = atof(argv[24]);
+  p.amin = atof(argv[25]);
+  p.n_poly = atoi(argv[26]);
 
   //Measurements
-  if(atoi(argv[24]) == 0) p.measPL = false;
+  if(atoi(argv[27]) == 0) p.measPL = false;
   else p.measPL = true;
 
-  if(atoi(argv[25]) == 0) p.measWL = false;
+  if(atoi(argv[28]) == 0) p.measWL = false;
   else p.measWL = true;
   
-  if(atoi(argv[26]) == 0) p.measPC = false;
+  if(atoi(argv[29]) == 0) p.measPC = false;
   else p.measPC = true;
   
-  if(atoi(argv[27]) == 0) p.measVT = false;
+  if(atoi(argv[30]) == 0) p.measVT = false;
   else p.measVT = true;  
+
+  //HMC integrator, solvers of the fermion force and of the pion and
+  //vacuum trace propagators (SOLVER_*), and valence masses for the pion
+  //correlator (optional)
+  vector<double> mValence;
+  if(argc > 31) p.integrator = atoi(argv[31]);
+  if(argc > 32) p.solverHMC = atoi(argv[32]);
+  if(argc > 33) p.solverPC = atoi(argv[33]);
+  if(argc > 34) p.solverVT = atoi(argv[34]);
+  const vector<int> propSolvers = {SOLVER_CG, SOLVER_BICGSTAB, SOLVER_GCR,
+				   SOLVER_EIGCG, SOLVER_MG, SOLVER_SAP};
+  checkSolver("solverHMC", p.solverHMC, {SOLVER_CG});
+  checkSolver("solverPC", p.solverPC, propSolvers);
+  checkSolver("solverVT", p.solverVT, propSolvers);
+  if(argc > 35) parseMassList(mValence, argv[35]);
   
   //Topology
   double top = 0.0;
@@ -129,10 +154,8 @@ int main(int argc, char **argv) {
     for(int i = 0; i < histL; i++) histQ[z][i] = 0;
   }
   
-  Complex gauge[LX][LY][LZ][D];
-  zeroLat(gauge);  
-  Complex gauge2D[LX][LY][2];
-  zeroLat(gauge2D);
+  latField3D<Complex> gauge;
+  latField<Complex> gauge2D;
   
   int count = 0;
   string name;
@@ -144,6 +167,7 @@ int main(int argc, char **argv) {
   FILE *fp;
 
   printParams(p);  
+  printMassList("Valence:  Masses (BiCGStab-M) =", mValence);
   gaussStart(gauge,p);  // hot start
 
   //Start simulation
@@ -183,6 +207,19 @@ int main(int argc, char **argv) {
     iter_offset = 2*p.therm;    
   }
 
+  //Measure-only run: with no trajectories requested, the configuration
+  //read in is measured as it is, on the central slice
+  if(p.checkpointStart > 0 && p.iterHMC == 0) {
+    iter = p.checkpointStart - 1;
+    int cz = (LZ-1)/2;
+    extractLatSlice(gauge, gauge2D, cz);
+    top_old[cz] = round(measTopCharge(gauge2D, p));
+    if(p.measPL || p.measWL) measWilsonLoops(gauge2D, iter, p);
+    if(p.measPC && mValence.empty()) measPionCorrelation(gauge2D, top_old[cz], iter, p);
+    if(p.measPC && !mValence.empty()) measPionCorrelationMulti(gauge2D, mValence, top_old[cz], iter, p);
+    if(p.measVT) measVacuumTrace(gauge2D, top_old[cz], iter, p);
+  }
+
   //Begin thermalised trajectories
   //---------------------------------------------------------------------
   for(iter=iter_offset; iter<p.iterHMC + iter_offset; iter++){
@@ -276,34 +313,33 @@ int main(int argc, char **argv) {
       int cz = (LZ-1)/2;
       extractLatSlice(gauge, gauge2D, cz);
       
-      //Polyakov Loops      
-      if(p.measPL) measPolyakovLoops(gauge2D, iter, p);
-      
-      //Creutz Ratios
-      if(p.measWL) measWilsonLoops(gauge2D, plaq[cz], iter, p);
+      //Gauge observables
+      if(p.measPL || p.measWL) measWilsonLoops(gauge2D, iter, p);
       
       //Pion Correlation
-      if(p.measPC) measPionCorrelation(gauge2D, top_old[cz], iter, p);
+      if(p.measPC && mValence.empty()) measPionCorrelation(gauge2D, top_old[cz], iter, p);
+      if(p.measPC && !mValence.empty()) measPionCorrelationMulti(gauge2D, mValence, top_old[cz], iter, p);
       
       //Vacuum Trace
       if(p.measVT) measVacuumTrace(gauge2D, top_old[cz], iter, p);
       //-------------------------------------------------------------
     }
   }      
+  wsPool().report();
+
   return 0;
 }
 
 // HMC Routines
 //---------------------------------------------------------------------
-int hmc(Complex gauge[LX][LY][LZ][D], param_t p, int iter) {
+int hmc(latField3D<Complex> &gauge, param_t p, int iter) {
 
   int accept = 0;
   
-  double mom[LX][LY][LZ][D];
-  double mom2D[LX][LY][2];
-  Complex gaugeOld[LX][LY][LZ][D];
-  Complex gauge2D[LX][LY][2];
-  Complex phi[LX][LY], chi[LX][LY];
+  latField3D<double> mom;
+  latField3D<Complex> gaugeOld;
+  tmpField<Complex> gauge2D;
+  tmpField<Complex> phi(1), chi(1);
   double H, Hold;
   
   copyLat(gaugeOld, gauge);
@@ -323,14 +359,19 @@ int hmc(Complex gauge[LX][LY][LZ][D], param_t p, int iter) {
     extractLatSlice(gauge, gauge2D, (LZ-1)/2);
     Dpsi(phi, chi, gauge2D, p);
     
+#pragma omp parallel for
     for(int x=0; x<LX; x++)  //Masks out odd sites.
       for(int y=0; y<LY; y++)
-        if((x+y)%2 == 1) phi[x][y] = 0.0;
+        if((x+y)%2 == 1) phi[x][y][0] = 0.0;
   }
   
-  if (iter >= p.therm) Hold = measAction(mom, gauge, phi, p, false);    
-  trajectory(mom, gauge, phi, p);
-  if (iter >= p.therm) H = measAction(mom, gauge, phi, p, true);
+  //Chronological initial guesses and low modes for the action and
+  //force solves of this trajectory
+  chronoGuess guess;
+
+  if (iter >= p.therm) Hold = measAction(mom, gauge, phi, p, false, &guess);    
+  trajectory(mom, gauge, phi, guess, p);
+  if (iter >= p.therm) H = measAction(mom, gauge, phi, p, true, &guess);
   
   if (iter >= 2*p.therm) {      
     hmccount++;
@@ -347,62 +388,27 @@ int hmc(Complex gauge[LX][LY][LZ][D], param_t p, int iter) {
   return accept;
 }
 
-void trajectory(double mom[LX][LY][LZ][D], Complex gauge[LX][LY][LZ][D],
-		Complex phi[LX][LY], param_t p) {  
-
-  double dtau = p.tau/p.nstep;
-  double H = 0.0;
-  Complex guess[LX][LY];
-  Complex gauge2D[LX][LY][2];
-  extractLatSlice(gauge, gauge2D, (LZ-1)/2);
-#ifdef USE_ARPACK
-  //deflate using phi as source
-  //Deflation eigenvectors
-  //Complex defl_evecs[NEV][LX][LY][2];
-  //Deflation eigenvalues
-  //Complex defl_evals[NEV];
-  //copyField(guess, phi);
-  //arpack_solve(gauge2D, defl_evecs, defl_evals, 0, 0, p);
-  //deflate(guess, phi, defl_evecs, defl_evals, p);
-  zeroField(guess);
-#else
-  zeroField(guess);
-#endif
+void trajectory(latField3D<double> &mom, latField3D<Complex> &gauge,
+		latField<Complex> &phi, chronoGuess &guess, param_t p) {  
+
+  tmpField<Complex> gauge2D;
   
   //gauge force
-  double fU[LX][LY][LZ][D];
-  zeroLat(fU);
+  latField3D<double> fU;
   //fermion fermion
-  double fD[LX][LY][2];
-  zeroField(fD);
+  tmpField<double> fD;
+  zeroLat(fD);
   
-  //Initial half step.
-  //P_{1/2} = P_0 - dtau/2 * (fU + fD)
-  forceU(fU, gauge, p);
-  forceD(fD, gauge2D, phi, guess, p);
-  update_mom(fU, fD, mom, 0.5*dtau, p);  
-  
-  for(int k=1; k<p.nstep; k++) {
-    
-    //U_{k} = exp(i dtau P_{k-1/2}) * U_{k-1}
-    update_gauge(gauge, mom, dtau, p);
-    
-    //P_{k+1/2} = P_{k-1/2} - dtau * (fU - fD)
+  //P = P - dtau * (fU + fD) and U = exp(i dtau P) * U, in the sequence
+  //of p.integrator
+  auto force = [&]() {
     forceU(fU, gauge, p);
     extractLatSlice(gauge, gauge2D, (LZ-1)/2);
     forceD(fD, gauge2D, phi, guess, p);
-    update_mom(fU, fD, mom, dtau, p);  
-  }
-  
-  //Final half step.
-  //U_{n} = exp(i dtau P_{n-1/2}) * U_{n-1}
-  update_gauge(gauge, mom, dtau, p);
-  
-  //P_{n} = P_{n-1/2} - dtau/2 * (fU + fD)
-  forceU(fU, gauge, p);
-  extractLatSlice(gauge, gauge2D, (LZ-1)/2);
-  forceD(fD, gauge2D, phi, guess, p);
-  update_mom(fU, fD, mom, 0.5*dtau, p);
+  };
+  auto kick = [&](latField3D<double> &P, double dtau) { update_mom(fU, fD, P, dtau, p); };
+  auto drift = [&](const latField3D<double> &P, double dtau) { update_gauge(gauge, P, dtau, p); };
+  integrate(mom, gauge, force, kick, drift, p);
   
   //trajectory complete
 }
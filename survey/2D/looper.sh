@@ -11,10 +11,6 @@ cp Makefile_template Makefile
 LX=$1
 LY=$2
 
-sed -i '.bak' -e s/__LX__/${LX}/g main.cpp Makefile
-sed -i '.bak' -e s/__LY__/${LY}/g main.cpp Makefile
-
-rm *.bak
 rm *template*
 make
 
@@ -12,11 +12,6 @@ LX=$1
 LY=$2
 LZ=$3
 
-sed -i '.bak' -e s/__LX__/${LX}/g main.cpp Makefile
-sed -i '.bak' -e s/__LY__/${LY}/g main.cpp Makefile
-sed -i '.bak' -e s/__LZ__/${LZ}/g main.cpp Makefile
-
-rm *.bak
 rm *template*
 make
 
@@ -1,9 +1,8 @@
 #!/bin/bash
 
 # Simple test script to demonstrate how to use the 2D U(1) code
-# The size of the lattice (L) is hardcoded in the main.cpp file
-# to make writing new code simpler. Please please edit and remake
-# if you wish to vary L.
+# The lattice extents are passed on the command line, so one
+# executable serves every lattice size.
 
 rm -rf {gauge,data}
 mkdir -p {gauge,data/{data,plaq,creutz,polyakov,rect,top,pion,vacuum}}
@@ -21,10 +20,7 @@ export OMP_NUM_THREADS=64
 cp main_template.cpp main.cpp
 cp Makefile_template Makefile
 
-sed -i '.bak' -e s/__LX__/${LX}/g main.cpp Makefile
-sed -i '.bak' -e s/__LY__/${LY}/g main.cpp Makefile
 
-rm *.bak
 make
 #---------------------------------------------------------------
 
@@ -39,12 +35,20 @@ HMC_THERM=5 #25
 HMC_SKIP=5
 # Dump the gauge field every HMC_CHKPT iterations after thermalisation.
 HMC_CHKPT=5000
-# If non-zero, read in the HMC_CHKPT_START gauge field. 
+# If non-zero, read in the HMC_CHKPT_START gauge field. With HMC_ITER=0 it
+# is only measured, with the low modes saved next to it (DEFL_SAVE).
 HMC_CHKPT_START=0
 # HMC time steps in the integration 
 HMC_NSTEP=40
 # HMC trajectory time
 HMC_TAU=1.0
+# HMC integrator: 0 = leapfrog, 1 = Omelyan 2MN (2 forces a step, about
+# twice the leapfrog step at the same acceptance), 2 = Omelyan 4MN (5
+# forces), 3 = force gradient (3 forces)
+HMC_INTEGRATOR=0
+# Solver of the fermion force: 1 = CG on the normal equations,
+# 5 = multigrid, 6 = GCR with the Schwarz (SAP) preconditioner
+HMC_SOLVER=1
 
 # Number of APE smearing hits to perform when measuring topology
 APE_ITER=5
@@ -71,14 +75,15 @@ CG_EPS=1e-16
 # Eigensolver parameters
 # Tolerance on the residual
 TOL=1e-8
-# Maximum ARPACK iterations
+# Maximum eigensolver restarts
 ARPACK_MAXITER=100000
 
-#polyACC (experimental)
-USE_ACC=0
-AMAX=11
-AMIN=1.0
-N_POLY=100
+# Chebyshev acceleration of the eigensolver (1 = on): a filter of degree
+# N_POLY damps the spectrum in [AMIN, AMAX]. A bound <= 0 is estimated.
+USE_ACC=1
+AMAX=0
+AMIN=0
+N_POLY=50
 
 # Measuremets: 1 = measure, 0 = no measure
 # Polyakov loops
@@ -89,11 +94,23 @@ MEAS_WL=0
 MEAS_PC=1
 # Vacuum trace
 MEAS_VT=0
-
-command="./2D-Wilson-LX$LX-LY$LY $BETA $HMC_ITER $HMC_THERM $HMC_SKIP $HMC_CHKPT 
+# Solvers of the pion correlation and vacuum trace propagators:
+# 1 = CG on the normal equations, 2 = BiCGStab on D, 3 = GCR on D,
+# 4 = eigCG on the normal equations, 5 = multigrid on D,
+# 6 = GCR on D with the Schwarz (SAP) preconditioner
+PC_SOLVER=1
+VT_SOLVER=1
+# Valence masses for the pion correlation function, solved together with
+# the multi-shift inverter, e.g. -0.04,-0.02,0.00,0.02. Leave empty to
+# use MASS only. They are always solved by BiCGStab-M without deflation,
+# whatever PC_SOLVER is.
+VAL_MASS=
+
+command="./2D-Wilson $LX $LY $BETA $HMC_ITER $HMC_THERM $HMC_SKIP $HMC_CHKPT 
          $HMC_CHKPT_START $HMC_NSTEP $HMC_TAU $APE_ITER $APE_ALPHA $RNG_SEED 
 	 $DYN_QUENCH $MASS $MAX_CG_ITER $CG_EPS $TOL $ARPACK_MAXITER $USE_ACC $AMAX 
-    	 $AMIN $N_POLY $MEAS_PL $MEAS_WL $MEAS_PC $MEAS_VT"
+    	 $AMIN $N_POLY $MEAS_PL $MEAS_WL $MEAS_PC $MEAS_VT
+    	 $HMC_INTEGRATOR $HMC_SOLVER $PC_SOLVER $VT_SOLVER $VAL_MASS"
 
 echo $command
 
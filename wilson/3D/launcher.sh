@@ -1,9 +1,8 @@
 #!/bin/bash
 
 # Simple test script to demonstrate how to use the 2D U(1) code
-# The size of the lattice (L) is hardcoded in the main.cpp file
-# to make writing new code simpler. Please please edit and remake
-# if you wish to vary L.
+# The lattice extents are passed on the command line, so one
+# executable serves every lattice size.
 
 rm -rf {gauge,data}
 mkdir -p {gauge,data/{data,plaq,creutz,polyakov,rect,top,pion,vacuum}}
@@ -16,11 +15,7 @@ LZ=3
 # Construct the correct executable
 cp main_template.cpp main.cpp
 cp Makefile_template Makefile
-sed -i '.bak' -e s/__LX__/${LX}/g main.cpp Makefile
-sed -i '.bak' -e s/__LY__/${LY}/g main.cpp Makefile
-sed -i '.bak' -e s/__LZ__/${LZ}/g main.cpp Makefile
 
-rm *.bak
 make
 #---------------------------------------------------------------
 
@@ -38,12 +33,20 @@ HMC_THERM=25
 HMC_SKIP=5
 # Dump the gauge field every HMC_CHKPT iterations after thermalisation.
 HMC_CHKPT=5000
-# If non-zero, read in the HMC_CHKPT_START gauge field. 
+# If non-zero, read in the HMC_CHKPT_START gauge field. With HMC_ITER=0 it
+# is only measured, with the low modes saved next to it (DEFL_SAVE).
 HMC_CHKPT_START=0
 # Number of HMC steps in the integration 
 HMC_NSTEP=40
 # HMC trajectory time
 HMC_TAU=1.0
+# HMC integrator: 0 = leapfrog, 1 = Omelyan 2MN (2 forces a step, about
+# twice the leapfrog step at the same acceptance), 2 = Omelyan 4MN (5
+# forces), 3 = force gradient (3 forces)
+HMC_INTEGRATOR=0
+# Solver of the fermion force: 1 = CG on the normal equations,
+# 5 = multigrid, 6 = GCR with the Schwarz (SAP) preconditioner
+HMC_SOLVER=1
 
 # Number of APE smearing hits to perform when measuring topology
 APE_ITER=100
@@ -70,14 +73,15 @@ CG_EPS=1e-16
 # Eigensolver parameters
 # Tolerance on the residual
 TOL=1e-8
-# Maximum ARPACK iterations
+# Maximum eigensolver restarts
 ARPACK_MAXITER=100000
 
-#polyACC
-USE_ACC=0
-AMAX=11
-AMIN=1.0
-N_POLY=100
+# Chebyshev acceleration of the eigensolver (1 = on): a filter of degree
+# N_POLY damps the spectrum in [AMIN, AMAX]. A bound <= 0 is estimated.
+USE_ACC=1
+AMAX=0
+AMIN=0
+N_POLY=50
 
 # Measuremets: 1 = measure, 0 = no measure
 # Polyakov loops
@@ -88,14 +92,26 @@ MEAS_WL=1
 MEAS_PC=1
 # Vacuum trace
 MEAS_VT=0
-
-#./2p1D-Wilson-LX48-LY48-LZ3 5.0 1 1000 25 5 5000 0 40 1.0 5 0.5 1234 1 1 0.00 1000 1e-16 1e-8 100000 0 11 1.0 100 1 1 1 0
-
-command="./2p1D-Wilson-LX$LX-LY$LY-LZ$LZ $BETA $BETAZ $HMC_ITER $HMC_THERM $HMC_SKIP 
+# Solvers of the pion correlation and vacuum trace propagators:
+# 1 = CG on the normal equations, 2 = BiCGStab on D, 3 = GCR on D,
+# 4 = eigCG on the normal equations, 5 = multigrid on D,
+# 6 = GCR on D with the Schwarz (SAP) preconditioner
+PC_SOLVER=1
+VT_SOLVER=1
+# Valence masses for the pion correlation function, solved together with
+# the multi-shift inverter, e.g. -0.04,-0.02,0.00,0.02. Leave empty to
+# use MASS only. They are always solved by BiCGStab-M without deflation,
+# whatever PC_SOLVER is.
+VAL_MASS=
+
+#./2p1D-Wilson 48 48 3 5.0 1 1000 25 5 5000 0 40 1.0 5 0.5 1234 1 1 0.00 1000 1e-16 1e-8 100000 0 11 1.0 100 1 1 1 0
+
+command="./2p1D-Wilson $LX $LY $LZ $BETA $BETAZ $HMC_ITER $HMC_THERM $HMC_SKIP 
 	      $HMC_CHKPT $HMC_CHKPT_START $HMC_NSTEP $HMC_TAU $APE_ITER $APE_ALPHA 
 	      $RNG_SEED $DYN_QUENCH $ZLOCKED $MASS $MAX_CG_ITER $CG_EPS $TOL 
 	      $ARPACK_MAXITER $USE_ACC $AMAX $AMIN $N_POLY $MEAS_PL $MEAS_WL $MEAS_PC 
-	      $MEAS_VT"
+	      $MEAS_VT
+	      $HMC_INTEGRATOR $HMC_SOLVER $PC_SOLVER $VT_SOLVER $VAL_MASS"
 
 echo $command
 